@@ -0,0 +1,28 @@
+#!/bin/bash
+#Usage: ./benchmark-async.sh TRAIN TEST THREADS ITERATIONS [TRAIN_SGD_OPTIONS...]
+#Trains with synchronous and asynchronous updates and prints the training and
+#test likelihoods of every iteration against the cumulative training time.
+
+TRAIN_SGD=$(dirname $0)/../bin/train_sgd
+TRAIN=$1
+TEST=$2
+THREADS=$3
+ITERATIONS=$4
+shift 4
+
+for ASYNC in 0 1; do
+  $TRAIN_SGD -i $TRAIN --test-set $TEST --threads $THREADS \
+      --iterations $ITERATIONS --asynchronous $ASYNC \
+      --model-out benchmark-async.$ASYNC "$@" 2>&1 >/dev/null |
+    awk -v async=$ASYNC '
+      /^\tMinibatch/ { for (i = 1; i <= NF; ++i) {
+                         if ($i == "Likelihood:") test = $(i + 1);
+                         if ($i == "Perplexity:") ppl = $(i + 1); } }
+      /^Iteration:/ { sub(",", "", $2); iter = $2; total += $4;
+                      for (i = 1; i <= NF; ++i)
+                        if ($i == "Likelihood:") train = $(i + 1); }
+      /^Done with training iteration/ {
+        print async, iter, total, train, test, ppl }'
+  rm -f benchmark-async.$ASYNC*
+done | awk 'BEGIN { print "async\titer\tseconds\tlikelihood\ttest-likelihood\ttest-perplexity" }
+            { print $1 "\t" $2 "\t" $3 "\t" $4 "\t" $5 "\t" $6 }'
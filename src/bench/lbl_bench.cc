@@ -0,0 +1,365 @@
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <boost/make_shared.hpp>
+
+#include "corpus/dict.h"
+#include "corpus/model_config.h"
+#include "corpus/parse_data_set.h"
+#include "lbl/minibatch_words.h"
+#include "lbl/tagged_parsed_factored_metadata.h"
+#include "lbl/tagged_parsed_factored_weights.h"
+#include "lbl/word_to_class_index.h"
+
+using namespace oxlm;
+using namespace std;
+
+namespace {
+
+// Bytes requested from the allocator by the whole process.
+atomic<size_t> allocated_bytes(0);
+
+}  // namespace
+
+#ifdef __GLIBC__
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+// Interposing malloc also counts the Eigen temporaries, which do not go
+// through operator new.
+void* malloc(size_t size) {
+  allocated_bytes.fetch_add(size, memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  allocated_bytes.fetch_add(count * size, memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  allocated_bytes.fetch_add(size, memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+}  // extern "C"
+#endif
+
+namespace {
+
+// Sizes of the synthetic model, set from the command line.
+struct BenchmarkOptions {
+  int vocab_size = 10000;
+  int representation_size = 128;
+  int classes = 0;
+  int context_width = 12;
+  int labels = 40;
+  int tags = 45;
+  int examples = 512;
+  int noise_samples = 10;
+};
+
+// Metadata with a Zipfian unigram distribution instead of corpus counts.
+class SyntheticMetadata : public TaggedParsedFactoredMetadata {
+ public:
+  SyntheticMetadata(const boost::shared_ptr<ModelConfig>& config,
+                    boost::shared_ptr<Dict>& dict,
+                    const boost::shared_ptr<WordToClassIndex>& index)
+      : TaggedParsedFactoredMetadata(config, dict, index) {
+    unigram = VectorReal(config->vocab_size);
+    for (int i = 0; i < config->vocab_size; ++i) {
+      unigram(i) = 1.0 / (i + 1);
+    }
+    unigram /= unigram.sum();
+    smoothed_unigram = unigram;
+  }
+};
+
+struct SyntheticModel {
+  boost::shared_ptr<ModelConfig> config;
+  boost::shared_ptr<TaggedParsedFactoredMetadata> metadata;
+  boost::shared_ptr<TaggedParsedFactoredWeights> weights;
+  boost::shared_ptr<ParseDataSet> examples;
+
+  size_t numExamples() const {
+    return examples->word_example_size() + examples->action_example_size() +
+           examples->tag_example_size();
+  }
+};
+
+SyntheticModel buildModel(const BenchmarkOptions& options) {
+  SyntheticModel model;
+  model.config = boost::make_shared<ModelConfig>();
+  boost::shared_ptr<ModelConfig> config = model.config;
+  config->vocab_size = options.vocab_size;
+  config->num_features = options.vocab_size;
+  config->representation_size = options.representation_size;
+  config->ngram_order = options.context_width + 1;
+  config->num_labels = options.labels;
+  config->num_tags = options.tags;
+  config->noise_samples = options.noise_samples;
+  config->activation = Activation::sigmoid;
+  config->lexicalised = true;
+  config->predict_pos = true;
+  config->step_size = 0.05;
+  config->l2_lbl = 1;
+
+  // Classes of equal size, sqrt(vocab_size) of them by default.
+  int classes = options.classes > 0
+                    ? options.classes
+                    : static_cast<int>(sqrt(options.vocab_size));
+  vector<int> class_markers;
+  for (int i = 0; i < classes; ++i) {
+    class_markers.push_back(
+        static_cast<long long>(i) * options.vocab_size / classes);
+  }
+  class_markers.push_back(options.vocab_size);
+
+  boost::shared_ptr<Dict> dict = boost::make_shared<Dict>();
+  boost::shared_ptr<TaggedParsedFactoredMetadata> metadata =
+      boost::make_shared<SyntheticMetadata>(
+          config, dict, boost::make_shared<WordToClassIndex>(class_markers));
+  model.metadata = metadata;
+  model.weights =
+      boost::make_shared<TaggedParsedFactoredWeights>(config, metadata, true);
+
+  // Words and context features follow the unigram distribution.
+  VectorReal unigram = metadata->getUnigram();
+  mt19937 gen(1);
+  discrete_distribution<int> words(unigram.data(),
+                                   unigram.data() + unigram.size());
+  uniform_int_distribution<int> actions(0, config->numActions() - 1);
+  uniform_int_distribution<int> tags(0, options.tags - 1);
+  auto context = [&]() {
+    vector<int> context_words;
+    vector<vector<int>> features;
+    for (int i = 0; i < options.context_width; ++i) {
+      context_words.push_back(words(gen));
+      features.push_back({context_words.back()});
+    }
+    return Context(context_words, features);
+  };
+
+  model.examples = boost::make_shared<ParseDataSet>();
+  for (int i = 0; i < options.examples; ++i) {
+    model.examples->add_word_example(DataPoint(words(gen), context()));
+    model.examples->add_action_example(DataPoint(actions(gen), context()));
+    model.examples->add_tag_example(DataPoint(tags(gen), context()));
+  }
+
+  return model;
+}
+
+// Reports the throughput and the bytes allocated per example of a loop
+// processing a number of examples in every iteration.
+class AllocationCounter {
+ public:
+  AllocationCounter(benchmark::State& state, size_t examples)
+      : state(state), examples(examples), start(allocated_bytes.load()) {}
+
+  ~AllocationCounter() {
+    size_t processed = state.iterations() * examples;
+    state.SetItemsProcessed(processed);
+    state.counters["bytes/example"] = benchmark::Counter(
+        static_cast<double>(allocated_bytes.load() - start) /
+        max<size_t>(processed, 1));
+  }
+
+ private:
+  benchmark::State& state;
+  size_t examples;
+  size_t start;
+};
+
+void getGradient(benchmark::State& state, const SyntheticModel& model) {
+  boost::shared_ptr<TaggedParsedFactoredWeights> gradient =
+      boost::make_shared<TaggedParsedFactoredWeights>(
+          model.config, model.metadata, false, true);
+  AllocationCounter counter(state, model.numExamples());
+  for (auto _ : state) {
+    Real objective = 0;
+    MinibatchWords words;
+    model.weights->getGradient(model.examples, gradient, objective, words);
+    gradient->clear(words, false);
+    benchmark::DoNotOptimize(objective);
+  }
+}
+
+void estimateGradient(benchmark::State& state, const SyntheticModel& model) {
+  boost::shared_ptr<TaggedParsedFactoredWeights> gradient =
+      boost::make_shared<TaggedParsedFactoredWeights>(
+          model.config, model.metadata, false, true);
+  AllocationCounter counter(state, model.numExamples());
+  for (auto _ : state) {
+    Real objective = 0;
+    MinibatchWords words;
+    model.weights->estimateGradient(model.examples, gradient, objective,
+                                    words);
+    gradient->clear(words, false);
+    benchmark::DoNotOptimize(objective);
+  }
+}
+
+void predictWord(benchmark::State& state, const SyntheticModel& model) {
+  const ParseDataSet& examples = *model.examples;
+  AllocationCounter counter(state, examples.word_example_size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < examples.word_example_size(); ++i) {
+      benchmark::DoNotOptimize(model.weights->predictWord(
+          examples.word_at(i), examples.word_context_at(i)));
+    }
+  }
+}
+
+void predictAction(benchmark::State& state, const SyntheticModel& model) {
+  const ParseDataSet& examples = *model.examples;
+  AllocationCounter counter(state, examples.action_example_size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < examples.action_example_size(); ++i) {
+      benchmark::DoNotOptimize(model.weights->predictAction(
+          examples.action_at(i), examples.action_context_at(i)));
+    }
+  }
+}
+
+void predictTag(benchmark::State& state, const SyntheticModel& model) {
+  const ParseDataSet& examples = *model.examples;
+  AllocationCounter counter(state, examples.tag_example_size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < examples.tag_example_size(); ++i) {
+      benchmark::DoNotOptimize(model.weights->predictTag(
+          examples.tag_at(i), examples.tag_context_at(i)));
+    }
+  }
+}
+
+// The update benchmarks apply the gradient of the synthetic examples to a
+// copy of the model, as the training loop does after every minibatch.
+struct Update {
+  boost::shared_ptr<TaggedParsedFactoredWeights> weights;
+  boost::shared_ptr<TaggedParsedFactoredWeights> gradient;
+  boost::shared_ptr<TaggedParsedFactoredWeights> global_gradient;
+  boost::shared_ptr<TaggedParsedFactoredWeights> adagrad;
+  MinibatchWords words;
+  MinibatchWords global_words;
+
+  explicit Update(const SyntheticModel& model) {
+    boost::shared_ptr<TaggedParsedFactoredMetadata> metadata = model.metadata;
+    weights = boost::make_shared<TaggedParsedFactoredWeights>(*model.weights);
+    gradient = boost::make_shared<TaggedParsedFactoredWeights>(
+        model.config, metadata, false, true);
+    global_gradient = boost::make_shared<TaggedParsedFactoredWeights>(
+        model.config, metadata, false);
+    adagrad = boost::make_shared<TaggedParsedFactoredWeights>(
+        model.config, metadata, false);
+
+    Real objective = 0;
+    weights->getGradient(model.examples, gradient, objective, words);
+    global_gradient->syncUpdate(words, gradient);
+    global_words.merge(words);
+    global_words.transform();
+  }
+};
+
+void syncUpdate(benchmark::State& state, const SyntheticModel& model) {
+  Update update(model);
+  AllocationCounter counter(state, model.numExamples());
+  for (auto _ : state) {
+    update.global_gradient->syncUpdate(update.words, update.gradient);
+  }
+}
+
+void updateAdaGrad(benchmark::State& state, const SyntheticModel& model) {
+  Update update(model);
+  AllocationCounter counter(state, model.numExamples());
+  for (auto _ : state) {
+    update.weights->updateAdaGrad(update.global_words, update.global_gradient,
+                                  update.adagrad);
+  }
+}
+
+void regularizerUpdate(benchmark::State& state, const SyntheticModel& model) {
+  Update update(model);
+  Real minibatch_factor = 1.0 / 1000;
+  AllocationCounter counter(state, model.numExamples());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(update.weights->regularizerUpdate(
+        update.global_words, update.global_gradient, minibatch_factor));
+  }
+}
+
+void asyncUpdate(benchmark::State& state, const SyntheticModel& model) {
+  Update update(model);
+  AllocationCounter counter(state, model.numExamples());
+  for (auto _ : state) {
+    update.weights->asyncUpdate(update.words, update.gradient, update.adagrad);
+  }
+}
+
+bool parseOption(const string& arg, const string& name, int& value) {
+  string prefix = "--" + name + "=";
+  if (arg.compare(0, prefix.size(), prefix) != 0) {
+    return false;
+  }
+  value = stoi(arg.substr(prefix.size()));
+  return true;
+}
+
+}  // namespace
+
+// Microbenchmarks of the gradient, prediction and update functions of the
+// neural parsing model on synthetic examples. Besides the Google Benchmark
+// flags, the model sizes are set with --vocab-size, --representation-size,
+// --classes, --context-width, --labels, --tags, --examples and
+// --noise-samples.
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+
+  BenchmarkOptions options;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (!parseOption(arg, "vocab-size", options.vocab_size) &&
+        !parseOption(arg, "representation-size",
+                     options.representation_size) &&
+        !parseOption(arg, "classes", options.classes) &&
+        !parseOption(arg, "context-width", options.context_width) &&
+        !parseOption(arg, "labels", options.labels) &&
+        !parseOption(arg, "tags", options.tags) &&
+        !parseOption(arg, "examples", options.examples) &&
+        !parseOption(arg, "noise-samples", options.noise_samples)) {
+      cerr << "Unknown option: " << arg << endl;
+      return 1;
+    }
+  }
+
+  SyntheticModel model = buildModel(options);
+
+  benchmark::RegisterBenchmark("getGradient", getGradient, model);
+  benchmark::RegisterBenchmark("estimateGradient", estimateGradient, model);
+  benchmark::RegisterBenchmark("predictWord", predictWord, model);
+  benchmark::RegisterBenchmark("predictAction", predictAction, model);
+  benchmark::RegisterBenchmark("predictTag", predictTag, model);
+  benchmark::RegisterBenchmark("syncUpdate", syncUpdate, model);
+  benchmark::RegisterBenchmark("updateAdaGrad", updateAdaGrad, model);
+  benchmark::RegisterBenchmark("regularizerUpdate", regularizerUpdate, model);
+  benchmark::RegisterBenchmark("asyncUpdate", asyncUpdate, model);
+
+  benchmark::AddCustomContext("vocab_size", to_string(options.vocab_size));
+  benchmark::AddCustomContext("representation_size",
+                              to_string(options.representation_size));
+  benchmark::AddCustomContext("examples", to_string(options.examples));
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
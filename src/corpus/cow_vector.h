@@ -0,0 +1,138 @@
+#ifndef _CORPUS_COW_VECTOR_H_
+#define _CORPUS_COW_VECTOR_H_
+
+#include <stdexcept>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+namespace oxlm {
+
+// Copy-on-write vector used to store parser state. Elements are kept in
+// fixed-size chunks that are shared between copies, so copying a vector only
+// copies the chunk pointers and a write only clones the chunk it touches.
+// This lets beam and particle successors share their predecessor's state
+// instead of deep-copying it for every expansion.
+template <typename T>
+class CowVector {
+  static const size_t kChunkBits = 5;
+  static const size_t kChunkSize = 1 << kChunkBits;
+  static const size_t kChunkMask = kChunkSize - 1;
+
+  typedef std::vector<T> Chunk;
+  typedef boost::shared_ptr<Chunk> ChunkPtr;
+
+ public:
+  class const_iterator {
+   public:
+    const_iterator(const CowVector* vec, size_t pos) : vec_(vec), pos_(pos) {}
+
+    const T& operator*() const { return (*vec_)[pos_]; }
+
+    const_iterator& operator++() {
+      ++pos_;
+      return *this;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return pos_ == other.pos_;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return pos_ != other.pos_;
+    }
+
+   private:
+    const CowVector* vec_;
+    size_t pos_;
+  };
+
+  CowVector() : chunks_(), size_(0) {}
+
+  CowVector(size_t n, const T& value) : chunks_(), size_(0) {
+    for (size_t i = 0; i < n; ++i) push_back(value);
+  }
+
+  CowVector(const std::vector<T>& values) : chunks_(), size_(0) {
+    for (const T& value : values) push_back(value);
+  }
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  const T& operator[](size_t i) const {
+    return (*chunks_[i >> kChunkBits])[i & kChunkMask];
+  }
+
+  const T& at(size_t i) const {
+    if (i >= size_) throw std::out_of_range("CowVector::at");
+    return (*this)[i];
+  }
+
+  const T& back() const { return (*this)[size_ - 1]; }
+
+  // Returns a writable reference, cloning the enclosing chunk if shared.
+  T& mutable_at(size_t i) {
+    if (i >= size_) throw std::out_of_range("CowVector::mutable_at");
+    return (*detach(i >> kChunkBits))[i & kChunkMask];
+  }
+
+  void set(size_t i, const T& value) { mutable_at(i) = value; }
+
+  void push_back(const T& value) {
+    if ((size_ & kChunkMask) == 0) {
+      chunks_.push_back(boost::make_shared<Chunk>());
+      chunks_.back()->reserve(kChunkSize);
+    }
+    detach(chunks_.size() - 1)->push_back(value);
+    ++size_;
+  }
+
+  void pop_back() {
+    --size_;
+    if ((size_ & kChunkMask) == 0) {
+      chunks_.pop_back();
+    } else {
+      detach(chunks_.size() - 1)->pop_back();
+    }
+  }
+
+  void clear() {
+    chunks_.clear();
+    size_ = 0;
+  }
+
+  std::vector<T> to_vector() const {
+    std::vector<T> values;
+    values.reserve(size_);
+    for (const ChunkPtr& chunk : chunks_) {
+      values.insert(values.end(), chunk->begin(), chunk->end());
+    }
+    return values;
+  }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+
+  const_iterator end() const { return const_iterator(this, size_); }
+
+ private:
+  Chunk* detach(size_t c) {
+    ChunkPtr& chunk = chunks_[c];
+    if (!chunk.unique()) {
+      ChunkPtr copy = boost::make_shared<Chunk>();
+      copy->reserve(kChunkSize);
+      copy->assign(chunk->begin(), chunk->end());
+      chunk = copy;
+    }
+    return chunk.get();
+  }
+
+  std::vector<ChunkPtr> chunks_;
+  size_t size_;
+};
+
+}  // namespace oxlm
+
+#endif
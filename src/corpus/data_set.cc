@@ -4,6 +4,11 @@ namespace oxlm {
 
 void DataSet::addExample(DataPoint example) { examples_.push_back(example); }
 
+void DataSet::extend(const DataSet& examples) {
+  examples_.insert(examples_.end(), examples.examples_.begin(),
+                   examples.examples_.end());
+}
+
 void DataSet::clear() { examples_.clear(); }
 
 DataPoint DataSet::exampleAt(unsigned i) const { return examples_.at(i); }
@@ -12,6 +12,9 @@ class DataSet {
 
   void addExample(DataPoint example);
 
+  // Appends all the examples of another set.
+  void extend(const DataSet& examples);
+
   void clear();
 
   DataPoint exampleAt(unsigned i) const;
@@ -0,0 +1,47 @@
+#include "corpus/flat_context.h"
+
+namespace oxlm {
+
+FlatContext::FlatContext() : offsets_(1, 0) {}
+
+FlatContext::FlatContext(const Context& context) : offsets_(1, 0) {
+  assign(context);
+}
+
+void FlatContext::clear() {
+  words_.clear();
+  features_.clear();
+  offsets_.resize(1);
+}
+
+void FlatContext::assign(const Context& context) {
+  clear();
+  words_.insert(words_.end(), context.words.begin(), context.words.end());
+  for (const auto& features : context.features) {
+    features_.insert(features_.end(), features.begin(), features.end());
+    endPosition();
+  }
+}
+
+Context FlatContext::toContext() const {
+  std::vector<std::vector<int>> features;
+  for (std::size_t i = 0; i < size(); ++i) {
+    features.push_back(std::vector<int>(begin(i), end(i)));
+  }
+
+  return Context(words_, features);
+}
+
+FlatContextBatch::FlatContextBatch() : size_(0) {}
+
+FlatContext& FlatContextBatch::add() {
+  if (size_ == contexts_.size()) {
+    contexts_.push_back(FlatContext());
+  }
+
+  FlatContext& context = contexts_[size_++];
+  context.clear();
+  return context;
+}
+
+}  // namespace oxlm
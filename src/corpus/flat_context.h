@@ -0,0 +1,89 @@
+#ifndef _CORPUS_FLAT_CONTEXT_H_
+#define _CORPUS_FLAT_CONTEXT_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "corpus/context.h"
+
+namespace oxlm {
+
+// Flat representation of the conditioning context of a prediction. The
+// features of all context positions are stored in one buffer and delimited by
+// offsets. Clearing the context keeps the allocated capacity, so a context
+// which is refilled for every prediction stops allocating once it has grown
+// to the size of the largest context.
+class FlatContext {
+ public:
+  FlatContext();
+
+  explicit FlatContext(const Context& context);
+
+  void clear();
+
+  void assign(const Context& context);
+
+  Context toContext() const;
+
+  void addWord(int word) { words_.push_back(word); }
+
+  // Appends a feature to the open position.
+  void addFeature(int feature) { features_.push_back(feature); }
+
+  // Closes the open position.
+  void endPosition() { offsets_.push_back(features_.size()); }
+
+  // Appends a feature to the last closed position.
+  void addToLastPosition(int feature) {
+    features_.push_back(feature);
+    ++offsets_.back();
+  }
+
+  // Number of closed positions.
+  std::size_t size() const { return offsets_.size() - 1; }
+
+  const std::vector<int>& words() const { return words_; }
+
+  const int* begin(std::size_t i) const {
+    return features_.data() + offsets_[i];
+  }
+
+  const int* end(std::size_t i) const {
+    return features_.data() + offsets_[i + 1];
+  }
+
+  std::size_t size(std::size_t i) const {
+    return offsets_[i + 1] - offsets_[i];
+  }
+
+ private:
+  std::vector<int> words_;
+  std::vector<int> features_;
+  std::vector<std::size_t> offsets_;
+};
+
+// Batch of flat contexts, scored together by the batched predictions.
+// Clearing the batch keeps its contexts and their buffers for reuse.
+class FlatContextBatch {
+ public:
+  FlatContextBatch();
+
+  void clear() { size_ = 0; }
+
+  // Returns an empty context appended to the batch.
+  FlatContext& add();
+
+  std::size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  const FlatContext& operator[](std::size_t i) const { return contexts_[i]; }
+
+ private:
+  std::vector<FlatContext> contexts_;
+  std::size_t size_;
+};
+
+}  // namespace oxlm
+
+#endif
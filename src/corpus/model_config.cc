@@ -20,6 +20,7 @@ ModelConfig::ModelConfig()
       diagonal_contexts(false),
       vocab_size(0),
       noise_samples(0),
+      shared_noise(false),
       parser_type(ParserType::arcstandard),
       activation(Activation::linear),
       pyp_model(false),
@@ -36,6 +37,12 @@ ModelConfig::ModelConfig()
       sum_over_beam(false),
       resample(false),
       sample_decoding(false),
+      parallel_decoding(false),
+      cache_size(0),
+      cache_examples(true),
+      extraction_threads(0),
+      quantization(Quantization::none),
+      asynchronous(false),
       root_first(true),
       complete_parse(true),
       bootstrap(false),
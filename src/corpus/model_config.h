@@ -13,6 +13,7 @@ namespace oxlm {
 
 enum class ParserType { ngram, arcstandard, arcstandard2 };
 enum class Activation { linear, sigmoid, tanh, rectifier };
+enum class Quantization { none, fp16, int8 };
 
 // Represents a set of global model parameters.
 struct ModelConfig {
@@ -45,6 +46,7 @@ struct ModelConfig {
   bool diagonal_contexts;
   int vocab_size;
   int noise_samples;
+  bool shared_noise;
   ParserType parser_type;
   Activation activation;
   bool pyp_model;
@@ -62,6 +64,12 @@ struct ModelConfig {
   bool sum_over_beam;
   bool resample;
   bool sample_decoding;
+  bool parallel_decoding;
+  int cache_size;
+  bool cache_examples;
+  int extraction_threads;
+  Quantization quantization;
+  bool asynchronous;
   bool root_first;
   bool complete_parse;
   bool bootstrap;
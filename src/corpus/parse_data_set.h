@@ -25,15 +25,9 @@ class ParseDataSet {
   }
 
   void extend(const boost::shared_ptr<ParseDataSet>& examples) {
-    for (unsigned i = 0; i < examples->word_example_size(); ++i) {
-      add_word_example(examples->word_example_at(i));
-    }
-    for (unsigned i = 0; i < examples->tag_example_size(); ++i) {
-      add_tag_example(examples->tag_example_at(i));
-    }
-    for (unsigned i = 0; i < examples->action_example_size(); ++i) {
-      add_action_example(examples->action_example_at(i));
-    }
+    word_examples_->extend(*examples->word_examples());
+    tag_examples_->extend(*examples->tag_examples());
+    action_examples_->extend(*examples->action_examples());
   }
 
   void clear() {
@@ -104,75 +104,83 @@ void ParsedCorpus::convertWhitespaceDelimitedConllLine(
   }
 }
 
-void ParsedCorpus::readFile(const std::string& filename,
-                            const boost::shared_ptr<Dict>& dict, bool frozen) {
+bool ParsedCorpus::readSentence(std::istream& in,
+                                const boost::shared_ptr<Dict>& dict,
+                                bool frozen, int index,
+                                ParsedSentence* sent_out) {
   Words sent;
   Words tags;
   WordsList features;
   Indices arcs;
   Words labels;
 
-  std::cerr << "Reading from " << filename << std::endl;
-  std::ifstream in(filename);
-  assert(in);
   std::string line;
-  int state = 1; 
+  bool in_sentence = false;
 
   while (getline(in, line)) {
     // End of sentence processing.
     if (line == "") {
-      // Adds end-of-sentence symbol if defined.
-      if (dict->eos() != -1) {
-        sent.push_back(dict->eos());
-        tags.push_back(dict->eos());
+      if (in_sentence) break;
+      continue;
+    }
+
+    // Start of sentence processing.
+    if (!in_sentence) {
+      // Adds start-of-sentence symbol if defined.
+      if (dict->sos() != -1) {
+        sent.push_back(dict->sos());
+        tags.push_back(dict->sos());
         if (!config_->pyp_model && config_->lexicalised &&
             config_->predict_pos) {
-          features.push_back(Words(2, dict->eos()));
+          features.push_back(Words(2, dict->sos()));
         } else {
-          features.push_back(Words(1, dict->eos()));
+          features.push_back(Words(1, dict->sos()));
         }
         arcs.push_back(-1);
         labels.push_back(-1);
       }
+      in_sentence = true;
+    }
 
-      // Updates word-to-feature mapping.
-      for (unsigned i = 0; i < sent.size(); ++i) {
-        dict->setWordFeatures(sent[i], Words(1, features[i][1]));
-      }
+    convertWhitespaceDelimitedConllLine(line, dict, &sent, &tags, &features,
+                                        &arcs, &labels, frozen);
+  }
 
-      int index = config_->num_train_sentences + sentences_.size() + 1;
+  if (!in_sentence) return false;
 
-      sentences_.push_back(
-          ParsedSentence(sent, tags, features, arcs, labels, index));
-      state = 1;
+  // Adds end-of-sentence symbol if defined.
+  if (dict->eos() != -1) {
+    sent.push_back(dict->eos());
+    tags.push_back(dict->eos());
+    if (!config_->pyp_model && config_->lexicalised && config_->predict_pos) {
+      features.push_back(Words(2, dict->eos()));
     } else {
-      // Start of sentence processing.
-      if (state == 1) {
-        sent.clear();
-        tags.clear();
-        features.clear();
-        arcs.clear();
-        labels.clear();
-
-        // Adds start-of-sentence symbol if defined.
-        if (dict->sos() != -1) {
-          sent.push_back(dict->sos());
-          tags.push_back(dict->sos());
-          if (!config_->pyp_model && config_->lexicalised &&
-              config_->predict_pos) {
-            features.push_back(Words(2, dict->sos()));
-          } else {
-            features.push_back(Words(1, dict->sos()));
-          }
-          arcs.push_back(-1);
-          labels.push_back(-1);
-        }
-        state = 0;
-      }
-
-      convertWhitespaceDelimitedConllLine(line, dict, &sent, &tags, &features,
-                                          &arcs, &labels, frozen);
+      features.push_back(Words(1, dict->eos()));
     }
+    arcs.push_back(-1);
+    labels.push_back(-1);
+  }
+
+  // Updates word-to-feature mapping.
+  for (unsigned i = 0; i < sent.size(); ++i) {
+    dict->setWordFeatures(sent[i], Words(1, features[i][1]));
+  }
+
+  *sent_out = ParsedSentence(sent, tags, features, arcs, labels, index);
+  return true;
+}
+
+void ParsedCorpus::readFile(const std::string& filename,
+                            const boost::shared_ptr<Dict>& dict, bool frozen) {
+  std::cerr << "Reading from " << filename << std::endl;
+  std::ifstream in(filename);
+  assert(in);
+
+  ParsedSentence sent;
+  int index = config_->num_train_sentences + sentences_.size() + 1;
+  while (readSentence(in, dict, frozen, index, &sent)) {
+    sentences_.push_back(sent);
+    ++index;
   }
 
   // Updates vocabulary sizes.
@@ -221,39 +229,37 @@ void ParsedCorpus::convertWhitespaceDelimitedTxtLine(
   }
 }
 
-void ParsedCorpus::readTxtFile(const std::string& filename,
-                               const boost::shared_ptr<Dict>& dict,
-                               bool frozen) {
-  std::cerr << "Reading from " << filename << std::endl;
-  std::ifstream in(filename);
-  assert(in);
+bool ParsedCorpus::readTxtSentence(std::istream& in,
+                                   const boost::shared_ptr<Dict>& dict,
+                                   bool frozen, int index,
+                                   ParsedSentence* sent_out) {
   std::string line;
+  if (!getline(in, line)) return false;
 
   Words sent;
   WordsList features;
-  Words tags;
-  Indices arcs;
-  Words labels;
+  convertWhitespaceDelimitedTxtLine(line, dict, &sent, &features, frozen);
 
-  while (getline(in, line)) {
-    sent.clear();
-    features.clear();
-    tags.clear();
-    arcs.clear();
-    labels.clear();
-
-    convertWhitespaceDelimitedTxtLine(line, dict, &sent, &features, frozen);
-
-    for (unsigned i = 0; i < sent.size(); ++i) {
-      tags.push_back(1);
-      arcs.push_back(-1);
-      labels.push_back(-1);
-    }
+  Words tags(sent.size(), 1);
+  Indices arcs(sent.size(), -1);
+  Words labels(sent.size(), -1);
 
-    int index = config_->num_train_sentences + sentences_.size() + 1;
+  *sent_out = ParsedSentence(sent, tags, features, arcs, labels, index);
+  return true;
+}
+
+void ParsedCorpus::readTxtFile(const std::string& filename,
+                               const boost::shared_ptr<Dict>& dict,
+                               bool frozen) {
+  std::cerr << "Reading from " << filename << std::endl;
+  std::ifstream in(filename);
+  assert(in);
 
-    sentences_.push_back(
-        ParsedSentence(sent, tags, features, arcs, labels, index));
+  ParsedSentence sent;
+  int index = config_->num_train_sentences + sentences_.size() + 1;
+  while (readTxtSentence(in, dict, frozen, index, &sent)) {
+    sentences_.push_back(sent);
+    ++index;
   }
 
   config_->vocab_size = dict->size();
@@ -33,6 +33,15 @@ class ParsedCorpus : public CorpusInterface {
                                          Words* sent_out,
                                          WordsList* features_out, bool frozen);
 
+  // Reads the next sentence from a CoNLL formatted stream. Returns false if
+  // the stream contains no further sentences.
+  bool readSentence(std::istream& in, const boost::shared_ptr<Dict>& dict,
+                    bool frozen, int index, ParsedSentence* sent_out);
+
+  // Reads the next line of a stream of whitespace delimited sentences.
+  bool readTxtSentence(std::istream& in, const boost::shared_ptr<Dict>& dict,
+                       bool frozen, int index, ParsedSentence* sent_out);
+
   void readFile(const std::string& filename,
                 const boost::shared_ptr<Dict>& dict, bool frozen) override;
 
@@ -53,10 +53,10 @@ class ParsedSentence : public TaggedSentence {
   }
 
   virtual void set_arc(WordIndex i, WordIndex j) {
-    if ((j >= 0) && (j < size())) arcs_[i] = j;
+    if ((j >= 0) && (j < size())) arcs_.set(i, j);
   }
 
-  void set_label(WordIndex i, WordId l) { labels_[i] = l; }
+  void set_label(WordIndex i, WordId l) { labels_.set(i, l); }
 
   virtual void push_arc() {
     arcs_.push_back(-1);
@@ -122,8 +122,8 @@ class ParsedSentence : public TaggedSentence {
   }
 
  private:
-  Indices arcs_;
-  Words labels_;
+  CowVector<WordIndex> arcs_;
+  CowVector<WordId> labels_;
 };
 
 }  // namespace oxlm
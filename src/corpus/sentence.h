@@ -1,6 +1,7 @@
 #ifndef _CORPUS_SENT_H_
 #define _CORPUS_SENT_H_
 
+#include "corpus/cow_vector.h"
 #include "corpus/dict.h"
 
 namespace oxlm {
@@ -40,7 +41,7 @@ class Sentence {
   WordId word_at(WordIndex i) const { return sentence_.at(i); }
 
  private:
-  Words sentence_;
+  CowVector<WordId> sentence_;
   int id_;
 };
 
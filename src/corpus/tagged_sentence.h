@@ -29,12 +29,12 @@ class TaggedSentence : public Sentence {
   }
 
   void set_tag_at(WordIndex i, WordId tag, WordId feat) {
-    tags_.at(i) = tag;
-    features_.at(i)[0] = feat;
+    tags_.set(i, tag);
+    features_.mutable_at(i)[0] = feat;
   }
 
   void add_feature_at(WordIndex i, WordId feat) {
-    features_.at(i).push_back(feat);
+    features_.mutable_at(i).push_back(feat);
   }
 
   size_t size() const override { return features_.size(); }
@@ -45,11 +45,11 @@ class TaggedSentence : public Sentence {
 
   WordId tag_at(WordIndex i) const { return tags_.at(i); }
 
-  Words features_at(WordIndex i) const { return features_.at(i); }
+  const Words& features_at(WordIndex i) const { return features_.at(i); }
 
  private:
-  Words tags_;
-  WordsList features_;
+  CowVector<WordId> tags_;
+  CowVector<Words> features_;
 };
 
 }  // namespace oxlm
@@ -1,6 +1,7 @@
 #ifndef _CORPUS_UTILS_H_
 #define _CORPUS_UTILS_H_
 
+#include <cmath>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -24,6 +24,8 @@ AccuracyCounts::AccuracyCounts(boost::shared_ptr<Dict> dict)
       directed_count_lab_{0},
       directed_count_nopunc_{0},
       directed_count_lab_nopunc_{0},
+      unheaded_count_{0},
+      unheaded_count_nopunc_{0},
       undirected_count_{0},
       undirected_count_nopunc_{0},
       root_count_{0},
@@ -156,6 +158,41 @@ void AccuracyCounts::countGoldLikelihood(Real parse_l, Real gold_l) {
   if (gold_l < parse_l) inc_gold_more_likely_count();
 }
 
+void AccuracyCounts::merge(const AccuracyCounts& other) {
+  likelihood_ += other.likelihood_;
+  beam_likelihood_ += other.beam_likelihood_;
+  importance_likelihood_ += other.importance_likelihood_;
+  gold_likelihood_ += other.gold_likelihood_;
+  marginal_likelihood_ += other.marginal_likelihood_;
+  reduce_count_ += other.reduce_count_;
+  reduce_gold_ += other.reduce_gold_;
+  shift_count_ += other.shift_count_;
+  shift_gold_ += other.shift_gold_;
+  final_reduce_error_count_ += other.final_reduce_error_count_;
+  total_length_ += other.total_length_;
+  total_length_punc_ += other.total_length_punc_;
+  total_length_punc_headed_ += other.total_length_punc_headed_;
+  total_length_nopunc_ += other.total_length_nopunc_;
+  total_length_nopunc_headed_ += other.total_length_nopunc_headed_;
+  tag_count_ += other.tag_count_;
+  directed_count_ += other.directed_count_;
+  directed_count_lab_ += other.directed_count_lab_;
+  directed_count_nopunc_ += other.directed_count_nopunc_;
+  directed_count_lab_nopunc_ += other.directed_count_lab_nopunc_;
+  unheaded_count_ += other.unheaded_count_;
+  unheaded_count_nopunc_ += other.unheaded_count_nopunc_;
+  undirected_count_ += other.undirected_count_;
+  undirected_count_nopunc_ += other.undirected_count_nopunc_;
+  root_count_ += other.root_count_;
+  gold_more_likely_count_ += other.gold_more_likely_count_;
+  num_actions_ += other.num_actions_;
+  complete_sentences_ += other.complete_sentences_;
+  complete_sentences_lab_ += other.complete_sentences_lab_;
+  complete_sentences_nopunc_ += other.complete_sentences_nopunc_;
+  complete_sentences_lab_nopunc_ += other.complete_sentences_lab_nopunc_;
+  num_sentences_ += other.num_sentences_;
+}
+
 void AccuracyCounts::printAccuracy() const {
   std::cerr << "Labelled Accuracy No Punct: " << directed_accuracy_lab_nopunc()
             << std::endl;
@@ -93,6 +93,9 @@ class AccuracyCounts {
 
   void countGoldLikelihood(Real parse_l, Real gold_l);
 
+  // Adds the counts of another instance, e.g. one filled by another thread.
+  void merge(const AccuracyCounts& other);
+
   void printAccuracy() const;
 
   Real directed_accuracy() const {
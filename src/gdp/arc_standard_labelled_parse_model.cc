@@ -121,15 +121,79 @@ void ArcStandardLabelledParseModel<ParsedWeights>::resampleParticles(
   }
 }
 
+template <class ParsedWeights>
+template <class Weights>
+void ArcStandardLabelledParseModel<ParsedWeights>::predictConfigurationBatch(
+    const boost::shared_ptr<Weights>& weights,
+    const std::vector<const ArcStandardLabelledParser*>& parsers,
+    FlatContextBatch& contexts, std::vector<Reals>& action_probs,
+    Reals& tag_probs, Reals& word_probs, std::true_type) const {
+  Words tags;
+  Words words;
+  Words tag_features;
+  contexts.clear();
+  for (const ArcStandardLabelledParser* parser : parsers) {
+    parser->actionContext(contexts.add());
+    tags.push_back(parser->next_tag());
+    words.push_back(parser->next_word());
+    if (config_->predict_pos) {
+      tag_features.push_back(parser->next_tag_feature());
+    }
+  }
+
+  HiddenLayer hidden;
+  weights->getHiddenLayer(contexts, hidden);
+  action_probs = weights->predictActionBatch(hidden);
+  tag_probs = weights->predictTagBatch(tags, hidden);
+  if (config_->predict_pos) {
+    HiddenLayer word_hidden;
+    weights->extendHiddenLayer(hidden, tag_features, word_hidden);
+    word_probs = weights->predictWordBatch(words, word_hidden);
+  } else {
+    word_probs = weights->predictWordBatch(words, hidden);
+  }
+}
+
+template <class ParsedWeights>
+template <class Weights>
+void ArcStandardLabelledParseModel<ParsedWeights>::predictConfigurationBatch(
+    const boost::shared_ptr<Weights>& weights,
+    const std::vector<const ArcStandardLabelledParser*>& parsers,
+    FlatContextBatch& contexts, std::vector<Reals>& action_probs,
+    Reals& tag_probs, Reals& word_probs, std::false_type) const {
+  Words tags;
+  Words words;
+  contexts.clear();
+  for (const ArcStandardLabelledParser* parser : parsers) {
+    parser->actionContext(contexts.add());
+    tags.push_back(parser->next_tag());
+    words.push_back(parser->next_word());
+  }
+  action_probs = weights->predictActionBatch(contexts);
+
+  contexts.clear();
+  for (const ArcStandardLabelledParser* parser : parsers) {
+    parser->tagContext(contexts.add());
+  }
+  tag_probs = weights->predictTagBatch(tags, contexts);
+
+  contexts.clear();
+  for (const ArcStandardLabelledParser* parser : parsers) {
+    parser->wordContext(contexts.add());
+  }
+  word_probs = weights->predictWordBatch(words, contexts);
+}
+
 template <class ParsedWeights>
 ArcStandardLabelledParser
 ArcStandardLabelledParseModel<ParsedWeights>::greedyParseSentence(
     const ParsedSentence& sent,
     const boost::shared_ptr<ParsedWeights>& weights) {
   ArcStandardLabelledParser parser(static_cast<TaggedSentence>(sent), config_);
+  FlatContext context;
 
   while (!parser.buffer_empty()) {
-    Reals action_probs = weights->predictAction(parser.actionContext());
+    Reals action_probs = weights->predictAction(parser.actionContext(context));
     WordIndex pred = arg_min(action_probs, 0);
     if ((parser.stack_depth() < 2) ||
         (config_->root_first && (parser.stack_depth() == 2))) {
@@ -152,7 +216,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::greedyParseSentence(
       }
       parser.add_particle_weight(action_probs[pred]);
 
-      action_probs = weights->predictAction(parser.actionContext());
+      action_probs = weights->predictAction(parser.actionContext(context));
       pred = arg_min(action_probs, 0);
       if ((parser.stack_depth() < 2) ||
           (config_->root_first && (parser.stack_depth() == 2))) {
@@ -165,8 +229,10 @@ ArcStandardLabelledParseModel<ParsedWeights>::greedyParseSentence(
     }
 
     // Shift.
-    Real tagp = weights->predictTag(parser.next_tag(), parser.tagContext());
-    Real wordp = weights->predictWord(parser.next_word(), parser.wordContext());
+    Real tagp =
+        weights->predictTag(parser.next_tag(), parser.tagContext(context));
+    Real wordp =
+        weights->predictWord(parser.next_word(), parser.wordContext(context));
     parser.shift();
     parser.add_particle_weight(tagp);
     parser.add_particle_weight(wordp);
@@ -174,7 +240,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::greedyParseSentence(
 
   // Final reduce actions.
   while (!parser.inTerminalConfiguration()) {
-    Reals action_probs = weights->predictAction(parser.actionContext());
+    Reals action_probs = weights->predictAction(parser.actionContext(context));
     WordIndex pred = arg_min(action_probs, 1);
     if (!parser.left_arc_valid()) {
       pred = arg_min(action_probs, config_->num_labels + 1);
@@ -201,34 +267,69 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParseSentence(
   AslParserList beam_stack;
   beam_stack.push_back(boost::make_shared<ArcStandardLabelledParser>(
       static_cast<TaggedSentence>(sent), config_));
+  // Context buffers are reused across all the predictions of the sentence.
+  FlatContext context;
+  FlatContextBatch action_contexts;
+  FlatContextBatch tag_contexts;
+  FlatContextBatch word_contexts;
 
   for (unsigned i = 0; ((i < sent.size() - 1) ||
                         ((config_->root_first || !config_->complete_parse) &&
                          (i == sent.size() - 1)));
        ++i) {
-    for (unsigned j = 0; j < beam_stack.size(); ++j) {
-      if (beam_stack[j]->num_particles() < 0) {
-        beam_stack[j]->set_num_particles(1);
-        continue;
+    // Items are expanded in waves: successors created while expanding one
+    // wave form the next, so all items of a wave can be scored together.
+    for (unsigned start = 0; start < beam_stack.size();) {
+      unsigned end = beam_stack.size();
+
+      std::vector<unsigned> active;
+      std::vector<const ArcStandardLabelledParser*> parsers;
+      for (unsigned j = start; j < end; ++j) {
+        if (beam_stack[j]->num_particles() < 0) {
+          beam_stack[j]->set_num_particles(1);
+        } else {
+          active.push_back(j);
+          parsers.push_back(beam_stack[j].get());
+        }
       }
+      start = end;
+      if (active.empty()) continue;
 
-      // Reduce actions are taken direction deterministic.
-      Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
-      Real shiftp = action_probs[0];
-
-      if ((beam_stack[j]->stack_depth() >= 2) && (j < beam_size)) {
-        // Add best reduce action.
-        WordIndex reduce_pred = arg_min(action_probs, 1);
-        if (!beam_stack[j]->left_arc_valid()) {
-          reduce_pred = arg_min(action_probs, config_->num_labels + 1);
+      std::vector<Reals> action_probs_list;
+      Reals next_tag_probs;
+      Reals next_word_probs;
+      if (config_->tag_pos) {
+        action_contexts.clear();
+        for (unsigned j : active) {
+          beam_stack[j]->actionContext(action_contexts.add());
         }
+        action_probs_list = weights->predictActionBatch(action_contexts);
+      } else {
+        // Items are not modified before they are shifted, so their shifts
+        // are scored together with their actions.
+        predictConfigurationBatch(weights, parsers, action_contexts,
+                                  action_probs_list, next_tag_probs,
+                                  next_word_probs, SharedHiddenLayer());
+      }
+      Reals shift_probs(active.size(), 0);
 
-        Real reducep = action_probs[reduce_pred];
-        kAction re_act = beam_stack[j]->lookup_action(reduce_pred);
-        WordId re_label = beam_stack[j]->lookup_label(reduce_pred);
+      for (unsigned k = 0; k < active.size(); ++k) {
+        unsigned j = active[k];
+        // Reduce actions are taken direction deterministic.
+        const Reals& action_probs = action_probs_list[k];
+        Real shiftp = action_probs[0];
+
+        if ((beam_stack[j]->stack_depth() >= 2) && (j < beam_size)) {
+          // Add best reduce action.
+          WordIndex reduce_pred = arg_min(action_probs, 1);
+          if (!beam_stack[j]->left_arc_valid()) {
+            reduce_pred = arg_min(action_probs, config_->num_labels + 1);
+          }
+
+          Real reducep = action_probs[reduce_pred];
+          kAction re_act = beam_stack[j]->lookup_action(reduce_pred);
+          WordId re_label = beam_stack[j]->lookup_label(reduce_pred);
 
-        if (j < beam_size) {
           beam_stack.push_back(
               boost::make_shared<ArcStandardLabelledParser>(*beam_stack[j]));
           if (re_act == kAction::la) {
@@ -237,58 +338,74 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParseSentence(
             beam_stack.back()->rightArc(re_label);
           }
           beam_stack.back()->add_particle_weight(reducep);
+        } else {
+          shiftp = 0;
+        }
+        shift_probs[k] = shiftp;
+
+        // Shift.
+        if (config_->tag_pos) {
+          Reals tag_probs =
+              weights->predictTag(beam_stack[j]->tagContext(context));
+          Reals word_probs = weights->predictWordOverTags(
+              beam_stack[j]->next_word(), beam_stack[j]->wordContext());
+          for (unsigned l = 0; l < tag_probs.size(); ++l) {
+            tag_probs[l] += word_probs[l];
+          }
+
+          // Sort tag+word probability.
+          std::vector<int> indices(tag_probs.size());
+          std::iota(indices.begin(), indices.end(), 0);
+          std::sort(indices.begin(), indices.end(),
+                    [&tag_probs](const int i, const int j) {
+                      return (tag_probs[i] < tag_probs[j]);
+                    });
+
+          // Most likely tag.
+          WordIndex tag_pred = indices[0];
+          beam_stack[j]->update_tag(i, tag_pred);
+
+          // Second most likely tag.
+          WordIndex tag2_pred = indices[1];
+
+          beam_stack.push_back(
+              boost::make_shared<ArcStandardLabelledParser>(*beam_stack[j]));
+          beam_stack.back()->update_tag(i, tag2_pred);
+          beam_stack.back()->shift();
+          beam_stack.back()->add_particle_weight(shiftp);
+          // Hack to communicate that item should be skipped.
+          beam_stack.back()->set_num_particles(-1);
+
+          beam_stack.back()->add_particle_weight(tag_probs[tag2_pred]);
+          beam_stack.back()->add_importance_weight(tag_probs[tag2_pred]);
         }
-      } else {
-        shiftp = 0;
       }
 
-      // Shift.
       if (config_->tag_pos) {
-        Reals tag_probs = weights->predictTag(beam_stack[j]->tagContext());
-        Reals word_probs = weights->predictWordOverTags(
-            beam_stack[j]->next_word(), beam_stack[j]->wordContext());
-        for (unsigned k = 0; k < tag_probs.size(); ++k) {
-          tag_probs[k] += word_probs[k];
+        // Tags have been updated, so the shifts are scored separately.
+        Words tags;
+        Words words;
+        tag_contexts.clear();
+        word_contexts.clear();
+        for (unsigned j : active) {
+          tags.push_back(beam_stack[j]->next_tag());
+          beam_stack[j]->tagContext(tag_contexts.add());
+          words.push_back(beam_stack[j]->next_word());
+          beam_stack[j]->wordContext(word_contexts.add());
         }
-
-        // Sort tag+word probability.
-        std::vector<int> indices(tag_probs.size());
-        std::iota(indices.begin(), indices.end(), 0);
-        std::sort(indices.begin(), indices.end(),
-                  [&tag_probs](const int i, const int j) {
-                    return (tag_probs[i] < tag_probs[j]);
-                  });
-
-        // Most likely tag.
-        WordIndex tag_pred = indices[0];
-        beam_stack[j]->update_tag(i, tag_pred);
-
-        // Second most likely tag.
-        WordIndex tag2_pred = indices[1];
-
-        beam_stack.push_back(
-            boost::make_shared<ArcStandardLabelledParser>(*beam_stack[j]));
-        beam_stack.back()->update_tag(i, tag2_pred);
-        beam_stack.back()->shift();
-        beam_stack.back()->add_particle_weight(shiftp);
-        // Hack to communicate that item should be skipped.
-        beam_stack.back()->set_num_particles(-1);  
-
-        beam_stack.back()->add_particle_weight(tag_probs[tag2_pred]);
-        beam_stack.back()->add_importance_weight(tag_probs[tag2_pred]);
+        next_tag_probs = weights->predictTagBatch(tags, tag_contexts);
+        next_word_probs = weights->predictWordBatch(words, word_contexts);
       }
 
-      Real tagp = weights->predictTag(beam_stack[j]->next_tag(),
-                                      beam_stack[j]->tagContext());
-      Real wordp = weights->predictWord(beam_stack[j]->next_word(),
-                                        beam_stack[j]->wordContext());
-
-      beam_stack[j]->shift();
-      beam_stack[j]->add_particle_weight(shiftp);
-      beam_stack[j]->add_particle_weight(wordp);
-      beam_stack[j]->add_particle_weight(tagp);
-      beam_stack[j]->add_importance_weight(wordp);
-      beam_stack[j]->add_importance_weight(tagp);
+      for (unsigned k = 0; k < active.size(); ++k) {
+        unsigned j = active[k];
+        beam_stack[j]->shift();
+        beam_stack[j]->add_particle_weight(shift_probs[k]);
+        beam_stack[j]->add_particle_weight(next_word_probs[k]);
+        beam_stack[j]->add_particle_weight(next_tag_probs[k]);
+        beam_stack[j]->add_importance_weight(next_word_probs[k]);
+        beam_stack[j]->add_importance_weight(next_tag_probs[k]);
+      }
     }
 
     // Prune the beam.
@@ -301,11 +418,24 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParseSentence(
     }
   }
 
-  // Completion: Greedily reduce each item.
-  for (unsigned j = 0; (j < beam_stack.size()); ++j) {
-    while (beam_stack[j]->stack_depth() >= 2) {
-      Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+  // Completion: Greedily reduce each item, scoring all unfinished items
+  // together.
+  while (true) {
+    std::vector<unsigned> active;
+    action_contexts.clear();
+    for (unsigned j = 0; (j < beam_stack.size()); ++j) {
+      if (beam_stack[j]->stack_depth() >= 2) {
+        active.push_back(j);
+        beam_stack[j]->actionContext(action_contexts.add());
+      }
+    }
+    if (active.empty()) break;
+
+    std::vector<Reals> action_probs_list =
+        weights->predictActionBatch(action_contexts);
+    for (unsigned k = 0; k < active.size(); ++k) {
+      unsigned j = active[k];
+      const Reals& action_probs = action_probs_list[k];
       WordIndex reduce_pred = arg_min(action_probs, 1);
       if (!beam_stack[j]->left_arc_valid())
         reduce_pred = arg_min(action_probs, config_->num_labels + 1);
@@ -321,14 +451,17 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParseSentence(
       }
       beam_stack[j]->add_particle_weight(reducep);
     }
+  }
 
+  for (unsigned j = 0; (j < beam_stack.size()); ++j) {
     // For root-last: final shift and reduce.
     if (config_->complete_parse && !config_->root_first) {
-      Real shiftp = weights->predictAction(0, beam_stack[j]->actionContext());
+      Real shiftp =
+          weights->predictAction(0, beam_stack[j]->actionContext(context));
       Real tagp = weights->predictTag(beam_stack[j]->next_tag(),
-                                      beam_stack[j]->tagContext());
+                                      beam_stack[j]->tagContext(context));
       Real wordp = weights->predictWord(beam_stack[j]->next_word(),
-                                        beam_stack[j]->wordContext());
+                                        beam_stack[j]->wordContext(context));
 
       beam_stack[j]->shift();
       beam_stack[j]->add_particle_weight(shiftp);
@@ -338,7 +471,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParseSentence(
       beam_stack[j]->add_importance_weight(tagp);
 
       Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+          weights->predictAction(beam_stack[j]->actionContext(context));
       // Oonly left-arc is valid.
       WordId reduce_pred = arg_min(action_probs, 1, config_->num_labels + 1);
       WordId re_label = beam_stack[j]->lookup_label(reduce_pred);
@@ -391,222 +524,258 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParticleParseSentence(
   beam_stack.push_back(boost::make_shared<ArcStandardLabelledParser>(
       static_cast<TaggedSentence>(sent), static_cast<int>(num_particles),
       config_));
+  // Context buffers are reused across all the predictions of the sentence.
+  FlatContext context;
+  FlatContextBatch action_contexts;
+  FlatContextBatch tag_contexts;
+  FlatContextBatch word_contexts;
 
   for (unsigned i = 0; ((i < sent.size() - 1) ||
                         ((config_->root_first || !config_->complete_parse) &&
                          (i == sent.size() - 1)));
        ++i) {
-    for (unsigned j = 0; j < beam_stack.size(); ++j) {
-      int num_samples = beam_stack[j]->num_particles();
-      if (num_samples == 0) {
-        continue;
-      } else if (num_samples < 0) {
-        beam_stack[j]->set_num_particles(-num_samples);
-        continue;
+    // Items are expanded in waves: successors created while expanding one
+    // wave form the next, so all items of a wave can be scored together.
+    for (unsigned start = 0; start < beam_stack.size();) {
+      unsigned end = beam_stack.size();
+
+      std::vector<unsigned> active;
+      action_contexts.clear();
+      for (unsigned j = start; j < end; ++j) {
+        int num_samples = beam_stack[j]->num_particles();
+        if (num_samples < 0) {
+          beam_stack[j]->set_num_particles(-num_samples);
+        } else if (num_samples > 0) {
+          active.push_back(j);
+          beam_stack[j]->actionContext(action_contexts.add());
+        }
       }
+      start = end;
+      if (active.empty()) continue;
+
+      std::vector<Reals> action_probs_list =
+          weights->predictActionBatch(action_contexts);
+      std::vector<unsigned> shifted;
+      Reals shift_probs;
+      std::vector<int> shift_counts;
+
+      for (unsigned k = 0; k < active.size(); ++k) {
+        unsigned j = active[k];
+        int num_samples = beam_stack[j]->num_particles();
+        Reals& action_probs = action_probs_list[k];
+        int shift_count = 0;
+        int reduce_count = 0;
+
+        Real shiftp = action_probs[0];
+        Real tot_reducep = log_one_min(shiftp);
+
+        if ((beam_stack[j]->stack_depth() < 2) ||
+            (config_->root_first && config_->complete_parse &&
+             (beam_stack[j]->stack_depth() == 2))) {
+          shift_count = num_samples;
+          shiftp = 0;
+        } else {
+          shift_count = std::round(std::exp(-shiftp) * num_samples);
+          reduce_count = num_samples - shift_count;
 
-      Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
-      int shift_count = 0;
-      int reduce_count = 0;
+          if (config_->direction_deterministic) {
+            WordIndex reduce_pred =
+                arg_min(action_probs, 1, 2 * config_->num_labels + 1);
+            if (config_->parser_type == ParserType::arcstandard2) {
+              reduce_pred = arg_min(action_probs, 1);
+            }
 
-      Real shiftp = action_probs[0];
-      Real tot_reducep = log_one_min(shiftp);
+            if (!beam_stack[j]->left_arc2_valid() &&
+                (reduce_pred <= 3 * config_->num_labels)) {
+              reduce_pred =
+                  arg_min(action_probs, 1, 2 * config_->num_labels + 1);
+            }
+            if (!beam_stack[j]->left_arc_valid()) {
+              reduce_pred = arg_min(action_probs, config_->num_labels + 1);
+            }
 
-      if ((beam_stack[j]->stack_depth() < 2) ||
-          (config_->root_first && config_->complete_parse &&
-           (beam_stack[j]->stack_depth() == 2))) {
-        shift_count = num_samples;
-        shiftp = 0;
-      } else {
-        shift_count = std::round(std::exp(-shiftp) * num_samples);
-        reduce_count = num_samples - shift_count;
+            if (reduce_count > 0) {
+              kAction re_act = beam_stack[j]->lookup_action(reduce_pred);
+              WordId re_label = beam_stack[j]->lookup_label(reduce_pred);
 
-        if (config_->direction_deterministic) {
-          WordIndex reduce_pred =
-              arg_min(action_probs, 1, 2 * config_->num_labels + 1);
-          if (config_->parser_type == ParserType::arcstandard2) {
-            reduce_pred = arg_min(action_probs, 1);
-          }
-
-          if (!beam_stack[j]->left_arc2_valid() &&
-              (reduce_pred <= 3 * config_->num_labels)) {
-            reduce_pred = arg_min(action_probs, 1, 2 * config_->num_labels + 1);
-          }
-          if (!beam_stack[j]->left_arc_valid()) {
-            reduce_pred = arg_min(action_probs, config_->num_labels + 1);
-          }
+              beam_stack.push_back(
+                  boost::make_shared<ArcStandardLabelledParser>(
+                      *beam_stack[j]));
+              if (re_act == kAction::la) {
+                beam_stack.back()->leftArc(re_label);
+              } else if (re_act == kAction::ra) {
+                beam_stack.back()->rightArc(re_label);
+              } else if (re_act == kAction::la2) {
+                beam_stack.back()->leftArc2(re_label);
+              } else if (re_act == kAction::ra2) {
+                beam_stack.back()->rightArc2(re_label);
+              }
+              beam_stack.back()->add_particle_weight(action_probs[reduce_pred]);
+              beam_stack.back()->set_num_particles(reduce_count);
+            }
+          } else {
+            if (config_->parser_type == ParserType::arcstandard2) {
+              WordIndex left_reduce2_pred =
+                  arg_min(action_probs, 2 * config_->num_labels + 1,
+                          3 * config_->num_labels + 1);
+              WordIndex right_reduce2_pred =
+                  arg_min(action_probs, 3 * config_->num_labels + 1,
+                          4 * config_->num_labels + 1);
+              Real left_reduce2p = L_MAX;
+              for (unsigned l = 2 * config_->num_labels + 1;
+                   l < 3 * config_->num_labels + 1; ++l) {
+                left_reduce2p = neg_log_sum_exp(left_reduce2p, action_probs[l]);
+              }
+              Real right_reduce2p = L_MAX;
+              for (unsigned l = 3 * config_->num_labels + 1;
+                   l < 4 * config_->num_labels + 1; ++l) {
+                right_reduce2p =
+                    neg_log_sum_exp(right_reduce2p, action_probs[l]);
+              }
 
-          if (reduce_count > 0) {
-            kAction re_act = beam_stack[j]->lookup_action(reduce_pred);
-            WordId re_label = beam_stack[j]->lookup_label(reduce_pred);
+              int left_reduce2_count =
+                  std::round(std::exp(-left_reduce2p) * num_samples);
+              if (!beam_stack[j]->left_arc2_valid()) left_reduce2_count = 0;
+              int right_reduce2_count =
+                  std::round(std::exp(-right_reduce2p) * num_samples);
+              reduce_count =
+                  reduce_count - left_reduce2_count - right_reduce2_count;
+
+              if (left_reduce2_count > 0) {
+                WordId re_label =
+                    beam_stack[j]->lookup_label(left_reduce2_pred);
+
+                beam_stack.push_back(
+                    boost::make_shared<ArcStandardLabelledParser>(
+                        *beam_stack[j]));
+                beam_stack.back()->leftArc2(re_label);
+                beam_stack.back()->add_particle_weight(
+                    action_probs[left_reduce2_pred]);
+                beam_stack.back()->set_num_particles(left_reduce2_count);
+              }
 
-            beam_stack.push_back(
-                boost::make_shared<ArcStandardLabelledParser>(*beam_stack[j]));
-            if (re_act == kAction::la) {
-              beam_stack.back()->leftArc(re_label);
-            } else if (re_act == kAction::ra) {
-              beam_stack.back()->rightArc(re_label);
-            } else if (re_act == kAction::la2) {
-              beam_stack.back()->leftArc2(re_label);
-            } else if (re_act == kAction::ra2) {
-              beam_stack.back()->rightArc2(re_label);
+              if (right_reduce2_count > 0) {
+                WordId re_label =
+                    beam_stack[j]->lookup_label(right_reduce2_pred);
+
+                beam_stack.push_back(
+                    boost::make_shared<ArcStandardLabelledParser>(
+                        *beam_stack[j]));
+                beam_stack.back()->rightArc2(re_label);
+                beam_stack.back()->add_particle_weight(
+                    action_probs[right_reduce2_pred]);
+                beam_stack.back()->set_num_particles(right_reduce2_count);
+              }
             }
-            beam_stack.back()->add_particle_weight(action_probs[reduce_pred]);
-            beam_stack.back()->set_num_particles(reduce_count);
-          }
-        } else {
-          if (config_->parser_type == ParserType::arcstandard2) {
-            WordIndex left_reduce2_pred =
-                arg_min(action_probs, 2 * config_->num_labels + 1,
-                        3 * config_->num_labels + 1);
-            WordIndex right_reduce2_pred =
-                arg_min(action_probs, 3 * config_->num_labels + 1,
-                        4 * config_->num_labels + 1);
-            Real left_reduce2p = L_MAX;
-            for (unsigned l = 2 * config_->num_labels + 1;
-                 l < 3 * config_->num_labels + 1; ++l) {
-              left_reduce2p = neg_log_sum_exp(left_reduce2p, action_probs[l]);
+
+            Real left_reducep = L_MAX;
+            for (unsigned l = 1; l < config_->num_labels + 1; ++l) {
+              left_reducep = neg_log_sum_exp(left_reducep, action_probs[l]);
             }
-            Real right_reduce2p = L_MAX;
-            for (unsigned l = 3 * config_->num_labels + 1;
-                 l < 4 * config_->num_labels + 1; ++l) {
-              right_reduce2p = neg_log_sum_exp(right_reduce2p, action_probs[l]);
+            Real right_reducep = L_MAX;
+            for (unsigned l = config_->num_labels + 1;
+                 l < 2 * config_->num_labels + 1; ++l) {
+              right_reducep = neg_log_sum_exp(right_reducep, action_probs[l]);
             }
 
-            int left_reduce2_count =
-                std::round(std::exp(-left_reduce2p) * num_samples);
-            if (!beam_stack[j]->left_arc2_valid()) left_reduce2_count = 0;
-            int right_reduce2_count =
-                std::round(std::exp(-right_reduce2p) * num_samples);
-            reduce_count =
-                reduce_count - left_reduce2_count - right_reduce2_count;
-
-            if (left_reduce2_count > 0) {
-              WordId re_label = beam_stack[j]->lookup_label(left_reduce2_pred);
+            WordIndex left_reduce_pred =
+                arg_min(action_probs, 1, config_->num_labels + 1);
+            Real left_reduce_pred_prob = action_probs[left_reduce_pred];
+
+            WordIndex right_reduce_pred =
+                arg_min(action_probs, config_->num_labels + 1,
+                        2 * config_->num_labels + 1);
+            Real right_reduce_pred_prob = action_probs[right_reduce_pred];
+
+            // Second best labels.
+            action_probs[left_reduce_pred] = std::numeric_limits<Real>::max();
+            WordIndex left_reduce_pred2 =
+                arg_min(action_probs, 1, config_->num_labels + 1);
+            Real left_reduce_pred_prob2 = action_probs[left_reduce_pred];
+
+            action_probs[right_reduce_pred] = std::numeric_limits<Real>::max();
+            WordIndex right_reduce_pred2 =
+                arg_min(action_probs, config_->num_labels + 1,
+                        2 * config_->num_labels + 1);
+            Real right_reduce_pred_prob2 = action_probs[right_reduce_pred];
+
+            int left_reduce_count =
+                std::round(std::exp(-left_reducep) * num_samples);
+            if (!beam_stack[j]->left_arc_valid()) left_reduce_count = 0;
+            double left_pred_sum =
+                neg_log_sum_exp(left_reduce_pred_prob, left_reduce_pred_prob2);
+            int left_reduce_count2 =
+                std::floor(std::exp(-left_reduce_pred_prob2 + left_pred_sum) *
+                           left_reduce_count);
+
+            int right_reduce_count = reduce_count - left_reduce_count;
+            left_reduce_count -= left_reduce_count2;
+            double right_pred_sum =
+                neg_log_sum_exp(right_reduce_pred_prob,
+                                right_reduce_pred_prob2);
+            int right_reduce_count2 =
+                std::floor(std::exp(-right_reduce_pred_prob2 + right_pred_sum) *
+                           right_reduce_count);
+            right_reduce_count -= right_reduce_count2;
+
+            if (left_reduce_count > 0) {
+              WordId re_label = beam_stack[j]->lookup_label(left_reduce_pred);
 
               beam_stack.push_back(
                   boost::make_shared<ArcStandardLabelledParser>(
                       *beam_stack[j]));
-              beam_stack.back()->leftArc2(re_label);
-              beam_stack.back()->add_particle_weight(
-                  action_probs[left_reduce2_pred]);
-              beam_stack.back()->set_num_particles(left_reduce2_count);
+              beam_stack.back()->leftArc(re_label);
+              beam_stack.back()->add_particle_weight(left_reduce_pred_prob);
+              beam_stack.back()->set_num_particles(left_reduce_count);
             }
 
-            if (right_reduce2_count > 0) {
-              WordId re_label = beam_stack[j]->lookup_label(right_reduce2_pred);
+            if (left_reduce_count2 > 0) {
+              WordId re_label = beam_stack[j]->lookup_label(left_reduce_pred2);
 
               beam_stack.push_back(
                   boost::make_shared<ArcStandardLabelledParser>(
                       *beam_stack[j]));
-              beam_stack.back()->rightArc2(re_label);
-              beam_stack.back()->add_particle_weight(
-                  action_probs[right_reduce2_pred]);
-              beam_stack.back()->set_num_particles(right_reduce2_count);
+              beam_stack.back()->leftArc(re_label);
+              beam_stack.back()->add_particle_weight(left_reduce_pred_prob2);
+              beam_stack.back()->set_num_particles(left_reduce_count2);
             }
-          }
-
-          Real left_reducep = L_MAX;
-          for (unsigned l = 1; l < config_->num_labels + 1; ++l) {
-            left_reducep = neg_log_sum_exp(left_reducep, action_probs[l]);
-          }
-          Real right_reducep = L_MAX;
-          for (unsigned l = config_->num_labels + 1;
-               l < 2 * config_->num_labels + 1; ++l) {
-            right_reducep = neg_log_sum_exp(right_reducep, action_probs[l]);
-          }
-
-          WordIndex left_reduce_pred =
-              arg_min(action_probs, 1, config_->num_labels + 1);
-          Real left_reduce_pred_prob = action_probs[left_reduce_pred];
-
-          WordIndex right_reduce_pred =
-              arg_min(action_probs, config_->num_labels + 1,
-                      2 * config_->num_labels + 1);
-          Real right_reduce_pred_prob = action_probs[right_reduce_pred];
-
-          // Second best labels.
-          action_probs[left_reduce_pred] = std::numeric_limits<Real>::max();
-          WordIndex left_reduce_pred2 =
-              arg_min(action_probs, 1, config_->num_labels + 1);
-          Real left_reduce_pred_prob2 = action_probs[left_reduce_pred];
-
-          action_probs[right_reduce_pred] = std::numeric_limits<Real>::max();
-          WordIndex right_reduce_pred2 =
-              arg_min(action_probs, config_->num_labels + 1,
-                      2 * config_->num_labels + 1);
-          Real right_reduce_pred_prob2 = action_probs[right_reduce_pred];
-
-          int left_reduce_count =
-              std::round(std::exp(-left_reducep) * num_samples);
-          if (!beam_stack[j]->left_arc_valid()) left_reduce_count = 0;
-          double left_pred_sum =
-              neg_log_sum_exp(left_reduce_pred_prob, left_reduce_pred_prob2);
-          int left_reduce_count2 =
-              std::floor(std::exp(-left_reduce_pred_prob2 + left_pred_sum) *
-                         left_reduce_count);
-
-          int right_reduce_count = reduce_count - left_reduce_count;
-          left_reduce_count -= left_reduce_count2;
-          double right_pred_sum =
-              neg_log_sum_exp(right_reduce_pred_prob, right_reduce_pred_prob2);
-          int right_reduce_count2 =
-              std::floor(std::exp(-right_reduce_pred_prob2 + right_pred_sum) *
-                         right_reduce_count);
-          right_reduce_count -= right_reduce_count2;
-
-          if (left_reduce_count > 0) {
-            WordId re_label = beam_stack[j]->lookup_label(left_reduce_pred);
-
-            beam_stack.push_back(
-                boost::make_shared<ArcStandardLabelledParser>(*beam_stack[j]));
-            beam_stack.back()->leftArc(re_label);
-            beam_stack.back()->add_particle_weight(left_reduce_pred_prob);
-            beam_stack.back()->set_num_particles(left_reduce_count);
-          }
 
-          if (left_reduce_count2 > 0) {
-            WordId re_label = beam_stack[j]->lookup_label(left_reduce_pred2);
+            if (right_reduce_count > 0) {
+              WordId re_label = beam_stack[j]->lookup_label(right_reduce_pred);
 
-            beam_stack.push_back(
-                boost::make_shared<ArcStandardLabelledParser>(*beam_stack[j]));
-            beam_stack.back()->leftArc(re_label);
-            beam_stack.back()->add_particle_weight(left_reduce_pred_prob2);
-            beam_stack.back()->set_num_particles(left_reduce_count2);
-          }
+              beam_stack.push_back(
+                  boost::make_shared<ArcStandardLabelledParser>(
+                      *beam_stack[j]));
+              beam_stack.back()->rightArc(re_label);
+              beam_stack.back()->add_particle_weight(right_reduce_pred_prob);
+              beam_stack.back()->set_num_particles(right_reduce_count);
+            }
 
-          if (right_reduce_count > 0) {
-            WordId re_label = beam_stack[j]->lookup_label(right_reduce_pred);
+            if (right_reduce_count2 > 0) {
+              WordId re_label = beam_stack[j]->lookup_label(right_reduce_pred2);
 
-            beam_stack.push_back(
-                boost::make_shared<ArcStandardLabelledParser>(*beam_stack[j]));
-            beam_stack.back()->rightArc(re_label);
-            beam_stack.back()->add_particle_weight(right_reduce_pred_prob);
-            beam_stack.back()->set_num_particles(right_reduce_count);
+              beam_stack.push_back(
+                  boost::make_shared<ArcStandardLabelledParser>(
+                      *beam_stack[j]));
+              beam_stack.back()->rightArc(re_label);
+              beam_stack.back()->add_particle_weight(right_reduce_pred_prob2);
+              beam_stack.back()->set_num_particles(right_reduce_count2);
+            }
           }
+        }
 
-          if (right_reduce_count2 > 0) {
-            WordId re_label = beam_stack[j]->lookup_label(right_reduce_pred2);
-
-            beam_stack.push_back(
-                boost::make_shared<ArcStandardLabelledParser>(*beam_stack[j]));
-            beam_stack.back()->rightArc(re_label);
-            beam_stack.back()->add_particle_weight(right_reduce_pred_prob2);
-            beam_stack.back()->set_num_particles(right_reduce_count2);
-          }
+        if (shift_count == 0) {
+          beam_stack[j]->set_num_particles(0);
+          continue;
         }
-      }
 
-      if (shift_count == 0) {
-        beam_stack[j]->set_num_particles(0);
-      } else {
         if (config_->tag_pos) {
-          Reals tag_probs = weights->predictTag(beam_stack[j]->tagContext());
+          Reals tag_probs =
+              weights->predictTag(beam_stack[j]->tagContext(context));
           Reals word_probs = weights->predictWordOverTags(
               beam_stack[j]->next_word(), beam_stack[j]->wordContext());
-          for (unsigned k = 0; k < tag_probs.size(); ++k) {
-            tag_probs[k] += word_probs[k];
+          for (unsigned l = 0; l < tag_probs.size(); ++l) {
+            tag_probs[l] += word_probs[l];
           }
 
           // Sort tag+word probobility.
@@ -662,31 +831,59 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParticleParseSentence(
           }
         }
 
-        Real tagp = weights->predictTag(beam_stack[j]->next_tag(),
-                                        beam_stack[j]->tagContext());
-        Real wordp = weights->predictWord(beam_stack[j]->next_word(),
-                                          beam_stack[j]->wordContext());
+        shifted.push_back(j);
+        shift_probs.push_back(shiftp);
+        shift_counts.push_back(shift_count);
+      }
 
+      Words tags;
+      Words words;
+      tag_contexts.clear();
+      word_contexts.clear();
+      for (unsigned j : shifted) {
+        tags.push_back(beam_stack[j]->next_tag());
+        beam_stack[j]->tagContext(tag_contexts.add());
+        words.push_back(beam_stack[j]->next_word());
+        beam_stack[j]->wordContext(word_contexts.add());
+      }
+      Reals tag_probs = weights->predictTagBatch(tags, tag_contexts);
+      Reals word_probs = weights->predictWordBatch(words, word_contexts);
+
+      for (unsigned k = 0; k < shifted.size(); ++k) {
+        unsigned j = shifted[k];
         beam_stack[j]->shift();
-        beam_stack[j]->add_particle_weight(shiftp);
-        beam_stack[j]->set_num_particles(shift_count);
+        beam_stack[j]->add_particle_weight(shift_probs[k]);
+        beam_stack[j]->set_num_particles(shift_counts[k]);
 
-        beam_stack[j]->add_particle_weight(wordp);
-        beam_stack[j]->add_particle_weight(tagp);
-        beam_stack[j]->add_importance_weight(wordp);
-        beam_stack[j]->add_importance_weight(tagp);
+        beam_stack[j]->add_particle_weight(word_probs[k]);
+        beam_stack[j]->add_particle_weight(tag_probs[k]);
+        beam_stack[j]->add_importance_weight(word_probs[k]);
+        beam_stack[j]->add_importance_weight(tag_probs[k]);
       }
     }
 
     reallocateParticles(&beam_stack, num_particles);
   }
 
-  // Completion: Greedily reduce each item.
-  for (unsigned j = 0; (j < beam_stack.size()); ++j) {
-    while ((beam_stack[j]->num_particles() > 0) &&
-           (beam_stack[j]->stack_depth() >= 2)) {
-      Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+  // Completion: Greedily reduce each item, scoring all unfinished items
+  // together.
+  while (true) {
+    std::vector<unsigned> active;
+    action_contexts.clear();
+    for (unsigned j = 0; (j < beam_stack.size()); ++j) {
+      if ((beam_stack[j]->num_particles() > 0) &&
+          (beam_stack[j]->stack_depth() >= 2)) {
+        active.push_back(j);
+        beam_stack[j]->actionContext(action_contexts.add());
+      }
+    }
+    if (active.empty()) break;
+
+    std::vector<Reals> action_probs_list =
+        weights->predictActionBatch(action_contexts);
+    for (unsigned k = 0; k < active.size(); ++k) {
+      unsigned j = active[k];
+      const Reals& action_probs = action_probs_list[k];
       int num_samples = beam_stack[j]->num_particles();
 
       WordIndex reduce_pred =
@@ -717,14 +914,17 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParticleParseSentence(
       beam_stack[j]->add_particle_weight(reducep);
       beam_stack[j]->set_num_particles(num_samples);
     }
+  }
 
+  for (unsigned j = 0; (j < beam_stack.size()); ++j) {
     // For root-last: final shift and reduce.
     if (config_->complete_parse && !config_->root_first) {
-      Real shiftp = weights->predictAction(0, beam_stack[j]->actionContext());
+      Real shiftp =
+          weights->predictAction(0, beam_stack[j]->actionContext(context));
       Real tagp = weights->predictTag(beam_stack[j]->next_tag(),
-                                      beam_stack[j]->tagContext());
+                                      beam_stack[j]->tagContext(context));
       Real wordp = weights->predictWord(beam_stack[j]->next_word(),
-                                        beam_stack[j]->wordContext());
+                                        beam_stack[j]->wordContext(context));
 
       beam_stack[j]->shift();
       beam_stack[j]->add_particle_weight(shiftp);
@@ -734,7 +934,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParticleParseSentence(
       beam_stack[j]->add_importance_weight(tagp);
 
       Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+          weights->predictAction(beam_stack[j]->actionContext(context));
       // Only left-arc is valid.
       WordId reduce_pred = arg_min(action_probs, 1, config_->num_labels + 1);
       WordId re_label = beam_stack[j]->lookup_label(reduce_pred);
@@ -788,6 +988,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleParseSentence(
   beam_stack.push_back(boost::make_shared<ArcStandardLabelledParser>(
       static_cast<TaggedSentence>(sent), static_cast<int>(num_particles),
       config_));
+  FlatContext context;
   Real marginal_weight = 0;
 
   for (unsigned i = 0; ((i < sent.size() - 1) ||
@@ -804,7 +1005,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleParseSentence(
       }
       
       Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+          weights->predictAction(beam_stack[j]->actionContext(context));
       int shift_count = 0;
       int reduce_count = 0;
 
@@ -954,7 +1155,8 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleParseSentence(
         beam_stack[j]->set_num_particles(0);
       } else {
         if (config_->tag_pos) {
-          Reals tag_probs = weights->predictTag(beam_stack[j]->tagContext());
+          Reals tag_probs =
+              weights->predictTag(beam_stack[j]->tagContext(context));
           Reals word_probs = weights->predictWordOverTags(
               beam_stack[j]->next_word(), beam_stack[j]->wordContext());
           for (unsigned k = 0; k < tag_probs.size(); ++k) {
@@ -1014,7 +1216,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleParseSentence(
         }
 
         Real tagp = weights->predictTag(beam_stack[j]->next_tag(),
-                                        beam_stack[j]->tagContext());
+                                        beam_stack[j]->tagContext(context));
         beam_stack[j]->add_particle_weight(tagp);
         beam_stack[j]->add_importance_weight(tagp);
 
@@ -1037,7 +1239,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleParseSentence(
     for (unsigned j = 0; j < beam_stack.size(); ++j) {
       if (beam_stack[j]->num_particles() == 0) continue;
       Real wordp = weights->predictWord(beam_stack[j]->next_word(),
-                                        beam_stack[j]->wordContext());
+                                        beam_stack[j]->wordContext(context));
       word_marginal_weight = neg_log_sum_exp(word_marginal_weight, 
                                         norm_weights[j] + wordp);
 
@@ -1056,7 +1258,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleParseSentence(
     while ((beam_stack[j]->num_particles() > 0) &&
            (beam_stack[j]->stack_depth() >= 2)) {
       Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+          weights->predictAction(beam_stack[j]->actionContext(context));
       int num_samples = beam_stack[j]->num_particles();
 
       WordIndex reduce_pred =
@@ -1093,11 +1295,12 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleParseSentence(
 
     // For root-last: Final shift and reduce. TODO not now computing marginal.
     if (config_->complete_parse && !config_->root_first) {
-      Real shiftp = weights->predictAction(0, beam_stack[j]->actionContext());
+      Real shiftp =
+          weights->predictAction(0, beam_stack[j]->actionContext(context));
       Real tagp = weights->predictTag(beam_stack[j]->next_tag(),
-                                      beam_stack[j]->tagContext());
+                                      beam_stack[j]->tagContext(context));
       Real wordp = weights->predictWord(beam_stack[j]->next_word(),
-                                        beam_stack[j]->wordContext());
+                                        beam_stack[j]->wordContext(context));
 
       beam_stack[j]->shift();
       beam_stack[j]->add_particle_weight(shiftp);
@@ -1107,7 +1310,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleParseSentence(
       beam_stack[j]->add_importance_weight(tagp);
 
       Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+          weights->predictAction(beam_stack[j]->actionContext(context));
       WordId reduce_pred = arg_min(
           action_probs, 1, config_->num_labels + 1);
       WordId re_label = beam_stack[j]->lookup_label(reduce_pred);
@@ -1168,6 +1371,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParticleGoldParseSentence(
   beam_stack.push_back(boost::make_shared<ArcStandardLabelledParser>(
       static_cast<TaggedSentence>(sent), static_cast<int>(num_particles),
       config_));
+  FlatContext context;
 
   for (unsigned i = 0; (i < sent.size()); ++i) {
     for (unsigned j = 0; j < beam_stack.size(); ++j) {
@@ -1180,7 +1384,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParticleGoldParseSentence(
       }
 
       Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+          weights->predictAction(beam_stack[j]->actionContext(context));
       int shift_count = 0;
       int reduce_count = 0;
 
@@ -1237,9 +1441,9 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParticleGoldParseSentence(
         // Don't generate POS tag.
 
         Real tagp = weights->predictTag(beam_stack[j]->next_tag(),
-                                        beam_stack[j]->tagContext());
+                                        beam_stack[j]->tagContext(context));
         Real wordp = weights->predictWord(beam_stack[j]->next_word(),
-                                          beam_stack[j]->wordContext());
+                                          beam_stack[j]->wordContext(context));
 
         beam_stack[j]->shift();
         beam_stack[j]->add_particle_weight(shiftp);
@@ -1259,7 +1463,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::beamParticleGoldParseSentence(
     while ((beam_stack[j]->num_particles() > 0) &&
            (beam_stack[j]->stack_depth() >= 2)) {
       Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+          weights->predictAction(beam_stack[j]->actionContext(context));
       int num_samples = beam_stack[j]->num_particles();
 
       kAction gold_act = beam_stack[j]->oracleNext(sent);
@@ -1304,6 +1508,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleGoldParseSentence(
   beam_stack.push_back(boost::make_shared<ArcStandardLabelledParser>(
       static_cast<TaggedSentence>(sent), static_cast<int>(num_particles),
       config_));
+  FlatContext context;
 
   for (unsigned i = 0; (i < sent.size()); ++i) {
     for (unsigned j = 0; j < beam_stack.size(); ++j) {
@@ -1316,7 +1521,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleGoldParseSentence(
       }
 
       Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+          weights->predictAction(beam_stack[j]->actionContext(context));
       int shift_count = 0;
       int reduce_count = 0;
 
@@ -1370,9 +1575,9 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleGoldParseSentence(
         beam_stack[j]->set_num_particles(0);
       } else {
         Real tagp = weights->predictTag(beam_stack[j]->next_tag(),
-                                        beam_stack[j]->tagContext());
+                                        beam_stack[j]->tagContext(context));
         Real wordp = weights->predictWord(beam_stack[j]->next_word(),
-                                          beam_stack[j]->wordContext());
+                                          beam_stack[j]->wordContext(context));
 
         beam_stack[j]->shift();
         beam_stack[j]->add_particle_weight(shiftp);
@@ -1392,7 +1597,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::particleGoldParseSentence(
     while ((beam_stack[j]->num_particles() > 0) &&
            (beam_stack[j]->stack_depth() >= 2)) {
       Reals action_probs =
-          weights->predictAction(beam_stack[j]->actionContext());
+          weights->predictAction(beam_stack[j]->actionContext(context));
       int num_samples = beam_stack[j]->num_particles();
 
       kAction gold_act = beam_stack[j]->oracleNext(sent);
@@ -1433,21 +1638,29 @@ ArcStandardLabelledParseModel<ParsedWeights>::staticGoldParseSentence(
     const ParsedSentence& sent,
     const boost::shared_ptr<ParsedWeights>& weights) {
   ArcStandardLabelledParser parser(static_cast<TaggedSentence>(sent), config_);
+  FlatContext context;
+  FlatContextBatch contexts;
   kAction a = kAction::sh;
   while (!parser.inTerminalConfiguration() && (a != kAction::re)) {
     a = parser.oracleNext(sent);
     WordId lab = parser.oracleNextLabel(sent);
     if (a != kAction::re) {
       WordId la = parser.convert_action(a, lab);
-      Real actionp = weights->predictAction(la, parser.actionContext());
-      parser.add_particle_weight(actionp);
-
       if (a == kAction::sh) {
-        Real tagp = weights->predictTag(parser.next_tag(), parser.tagContext());
-        Real wordp =
-            weights->predictWord(parser.next_word(), parser.wordContext());
-        parser.add_particle_weight(tagp);
-        parser.add_particle_weight(wordp);
+        // Shifts are scored from a single hidden layer.
+        std::vector<const ArcStandardLabelledParser*> parsers(1, &parser);
+        std::vector<Reals> action_probs;
+        Reals tag_probs;
+        Reals word_probs;
+        predictConfigurationBatch(weights, parsers, contexts, action_probs,
+                                  tag_probs, word_probs, SharedHiddenLayer());
+        parser.add_particle_weight(action_probs[0][la]);
+        parser.add_particle_weight(tag_probs[0]);
+        parser.add_particle_weight(word_probs[0]);
+      } else {
+        Real actionp =
+            weights->predictAction(la, parser.actionContext(context));
+        parser.add_particle_weight(actionp);
       }
 
       parser.executeAction(a, lab);
@@ -1478,6 +1691,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::generateSentence(
     WordIndex sentence_id) {
   unsigned sent_limit = 100;
   ArcStandardLabelledParser parser(config_);
+  FlatContext context;
   bool terminate_shift = false;
   // Assuming root first.
   parser.push_tag(1);
@@ -1492,7 +1706,8 @@ ArcStandardLabelledParseModel<ParsedWeights>::generateSentence(
         terminate_shift = true;
       }
 
-      Reals action_probs = weights->predictAction(parser.actionContext());
+      Reals action_probs =
+          weights->predictAction(parser.actionContext(context));
 
       if (terminate_shift) action_probs[0] = L_MAX;
       if (!parser.left_arc_valid()) {
@@ -1518,7 +1733,7 @@ ArcStandardLabelledParseModel<ParsedWeights>::generateSentence(
     } else if (act == kAction::sh) {
       std::cout << "sh ";
       // Sample a tag.
-      Reals tag_distr = weights->predictTag(parser.tagContext());
+      Reals tag_distr = weights->predictTag(parser.tagContext(context));
       tag_distr[0] = L_MAX;
       if (config_->root_first || (parser.size() < 2)) tag_distr[1] = L_MAX;
 
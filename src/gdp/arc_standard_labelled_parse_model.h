@@ -1,6 +1,8 @@
 #ifndef _GDP_AS_LAB_PARSE_MODEL_H_
 #define _GDP_AS_LAB_PARSE_MODEL_H_
 
+#include <type_traits>
+
 #include "gdp/accuracy_counts.h"
 #include "gdp/arc_standard_labelled_parser.h"
 #include "gdp/transition_parse_model_interface.h"
@@ -113,6 +115,28 @@ class ArcStandardLabelledParseModel
                           bool acc, size_t beam_size);
 
  private:
+  // Whether the output layers of the weights can share a hidden layer.
+  typedef typename std::is_base_of<ParsedFactoredWeights, ParsedWeights>::type
+      SharedHiddenLayer;
+
+  // Scores the actions of a batch of configurations, together with the tag
+  // and the word of their next shift. For the neural models the tag context
+  // is the action context and the word context only adds the next tag, so a
+  // single hidden layer is computed for the three output layers.
+  template <class Weights>
+  void predictConfigurationBatch(
+      const boost::shared_ptr<Weights>& weights,
+      const std::vector<const ArcStandardLabelledParser*>& parsers,
+      FlatContextBatch& contexts, std::vector<Reals>& action_probs,
+      Reals& tag_probs, Reals& word_probs, std::true_type) const;
+
+  template <class Weights>
+  void predictConfigurationBatch(
+      const boost::shared_ptr<Weights>& weights,
+      const std::vector<const ArcStandardLabelledParser*>& parsers,
+      FlatContextBatch& contexts, std::vector<Reals>& action_probs,
+      Reals& tag_probs, Reals& word_probs, std::false_type) const;
+
   boost::shared_ptr<ModelConfig> config_;
 };
 
@@ -4,16 +4,19 @@ namespace oxlm {
 
 ArcStandardLabelledParser::ArcStandardLabelledParser(
     const boost::shared_ptr<ModelConfig>& config)
-    : TransitionParser(config) {}
+    : TransitionParser(config),
+      context_mapper_(contextMapper(*config)) {}
 
 ArcStandardLabelledParser::ArcStandardLabelledParser(
     const TaggedSentence& parse, const boost::shared_ptr<ModelConfig>& config)
-    : TransitionParser(parse, config) {}
+    : TransitionParser(parse, config),
+      context_mapper_(contextMapper(*config)) {}
 
 ArcStandardLabelledParser::ArcStandardLabelledParser(
     const TaggedSentence& parse, int num_particles,
     const boost::shared_ptr<ModelConfig>& config)
-    : TransitionParser(parse, num_particles, config) {}
+    : TransitionParser(parse, num_particles, config),
+      context_mapper_(contextMapper(*config)) {}
 
 bool ArcStandardLabelledParser::shift() {
   WordIndex i = buffer_next();
@@ -200,47 +203,70 @@ bool ArcStandardLabelledParser::executeAction(kAction a, WordId l) {
 }
 
 //TODO check orders
-Indices ArcStandardLabelledParser::contextIndices() const {
-  if (context_type() == "extended")
-    return extended_children_context();  // order 13
-  if (context_type() == "extended-3rd")
-    return third_extended_children_context();  // order 18
-  else if (context_type() == "more-extended")
-    return more_extended_children_context();  // order 17
-  else if (context_type() == "more-extended-3rd")
-    return third_more_extended_children_context();  // order 24
-  else if (context_type() == "with-ngram")
-    return children_ngram_context();  // order 13
-  else if (context_type() == "extended-with-ngram")
-    return extended_children_ngram_context();  // order 16
-  else if (context_type() == "more-extended-with-ngram")
-    return more_extended_children_ngram_context();  // order 21
-  else if (context_type() == "lookahead")
-    return children_lookahead_context();  // order 10
-  else if (context_type() == "extended-lookahead")
-    return extended_children_lookahead_context();  // order 16
-  else if (context_type() == "standard-3rd")
-    return third_children_context();  // order 10
-  else
-    return children_context();  // order 7
+ArcStandardLabelledParser::ContextMapper
+ArcStandardLabelledParser::contextMapper(const ModelConfig& config) {
+  const std::string& type = config.context_type;
+  if (config.pyp_model || type == "stack-action")
+    return nullptr;
+  else if (type == "extended")  // order 13
+    return &TransitionParser::map_context<
+        TransitionParser::kExtendedChildrenContextSize,
+        &TransitionParser::extended_children_context>;
+  else if (type == "extended-3rd")  // order 18
+    return &TransitionParser::map_context<
+        TransitionParser::kThirdExtendedChildrenContextSize,
+        &TransitionParser::third_extended_children_context>;
+  else if (type == "more-extended")  // order 17
+    return &TransitionParser::map_context<
+        TransitionParser::kMoreExtendedChildrenContextSize,
+        &TransitionParser::more_extended_children_context>;
+  else if (type == "more-extended-3rd")  // order 24
+    return &TransitionParser::map_context<
+        TransitionParser::kThirdMoreExtendedChildrenContextSize,
+        &TransitionParser::third_more_extended_children_context>;
+  else if (type == "with-ngram")  // order 13
+    return &TransitionParser::map_context<
+        TransitionParser::kChildrenNgramContextSize,
+        &TransitionParser::children_ngram_context>;
+  else if (type == "extended-with-ngram")  // order 16
+    return &TransitionParser::map_context<
+        TransitionParser::kExtendedChildrenNgramContextSize,
+        &TransitionParser::extended_children_ngram_context>;
+  else if (type == "more-extended-with-ngram")  // order 21
+    return &TransitionParser::map_context<
+        TransitionParser::kMoreExtendedChildrenNgramContextSize,
+        &TransitionParser::more_extended_children_ngram_context>;
+  else if (type == "lookahead")  // order 10
+    return &TransitionParser::map_context<
+        TransitionParser::kChildrenLookaheadContextSize,
+        &TransitionParser::children_lookahead_context>;
+  else if (type == "extended-lookahead")  // order 16
+    return &TransitionParser::map_context<
+        TransitionParser::kExtendedChildrenLookaheadContextSize,
+        &TransitionParser::extended_children_lookahead_context>;
+  else if (type == "standard-3rd")  // order 10
+    return &TransitionParser::map_context<
+        TransitionParser::kThirdChildrenContextSize,
+        &TransitionParser::third_children_context>;
+  else  // order 7
+    return &TransitionParser::map_context<
+        TransitionParser::kChildrenContextSize,
+        &TransitionParser::children_context>;
 }
 
 Context ArcStandardLabelledParser::wordContext() const {
   if (pyp_model()) {
     return Context(word_tag_next_children_context());  // order 6
-  } else if (context_type() == "stack-action") {
+  } else if (!context_mapper_) {
     Context ctx = stack_action_context();
     if (predict_pos()) {
-      ctx.features.back().push_back(
-          features_at(buffer_next())[0]);  // adds next tag as a feature
+      // Adds next tag as a feature.
+      ctx.features.back().push_back(next_tag_feature());
     }
     return ctx;
   } else {
-    Context ctx = map_context(contextIndices());  // order 9
-    if (predict_pos()) {
-      ctx.features.back().push_back(features_at(buffer_next())[0]);
-    }
-    return ctx;
+    FlatContext context;
+    return wordContext(context).toContext();  // order 9
   }
 }
 
@@ -252,10 +278,11 @@ Context ArcStandardLabelledParser::tagContext() const {
     else {
       return Context(tag_children_context());  // order 7
     }
-  } else if (context_type() == "stack-action") {
+  } else if (!context_mapper_) {
     return stack_action_context();  // order 9
   } else {
-    return map_context(contextIndices());
+    FlatContext context;
+    return tagContext(context).toContext();
   }
 }
 
@@ -266,11 +293,48 @@ Context ArcStandardLabelledParser::actionContext() const {
     } else {
       return Context(tag_children_context());  // order 7
     }
-  } else if (context_type() == "stack-action") {
+  } else if (!context_mapper_) {
     return stack_action_context();  // order 9
   } else {
-    return map_context(contextIndices());
+    FlatContext context;
+    return actionContext(context).toContext();
+  }
+}
+
+const FlatContext& ArcStandardLabelledParser::wordContext(
+    FlatContext& context) const {
+  if (!context_mapper_) {
+    context.assign(wordContext());
+  } else {
+    (this->*context_mapper_)(context);
+    if (predict_pos()) {
+      context.addToLastPosition(next_tag_feature());
+    }
+  }
+
+  return context;
+}
+
+const FlatContext& ArcStandardLabelledParser::tagContext(
+    FlatContext& context) const {
+  if (!context_mapper_) {
+    context.assign(tagContext());
+  } else {
+    (this->*context_mapper_)(context);
+  }
+
+  return context;
+}
+
+const FlatContext& ArcStandardLabelledParser::actionContext(
+    FlatContext& context) const {
+  if (!context_mapper_) {
+    context.assign(actionContext());
+  } else {
+    (this->*context_mapper_)(context);
   }
+
+  return context;
 }
 
 void ArcStandardLabelledParser::extractExamples(
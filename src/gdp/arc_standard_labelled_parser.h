@@ -39,14 +39,20 @@ class ArcStandardLabelledParser : public TransitionParser {
 
   bool executeAction(kAction a, WordId l);
 
-  Indices contextIndices() const;
-
   Context wordContext() const;
 
   Context tagContext() const;
 
   Context actionContext() const;
 
+  // Write the contexts into reused flat contexts, to avoid allocating during
+  // decoding.
+  const FlatContext& wordContext(FlatContext& context) const;
+
+  const FlatContext& tagContext(FlatContext& context) const;
+
+  const FlatContext& actionContext(FlatContext& context) const;
+
   void extractExamples(const boost::shared_ptr<ParseDataSet>& examples,
                        const ParsedSentence& gold_sent) const;
 
@@ -95,6 +101,15 @@ class ArcStandardLabelledParser : public TransitionParser {
       return -1;
     }
   }
+
+ private:
+  typedef void (TransitionParser::*ContextMapper)(FlatContext&) const;
+
+  // Selects the context template of the configured context type, or null if
+  // the contexts are not built from a template.
+  static ContextMapper contextMapper(const ModelConfig& config);
+
+  ContextMapper context_mapper_;
 };
 
 }  // namespace oxlm
@@ -0,0 +1,63 @@
+#include "gdp/example_pipeline.h"
+
+#include <boost/bind.hpp>
+
+namespace oxlm {
+
+ExamplePipeline::ExamplePipeline(const vector<vector<int>>& tasks,
+                                 size_t capacity, int num_threads,
+                                 const Extractor& extractor)
+    : tasks(tasks),
+      extractor(extractor),
+      slots(capacity),
+      nextTask(0),
+      stopped(false) {
+  // A slot is free for task i when its sequence is i and holds the examples
+  // of task i when its sequence is i + 1.
+  for (size_t i = 0; i < capacity; ++i) {
+    slots[i].sequence.store(i, memory_order_relaxed);
+  }
+
+  for (int i = 0; i < num_threads; ++i) {
+    threads.create_thread(boost::bind(&ExamplePipeline::extract, this));
+  }
+}
+
+void ExamplePipeline::extract() {
+  while (true) {
+    size_t task_id = nextTask.fetch_add(1, memory_order_relaxed);
+    if (task_id >= tasks.size()) {
+      return;
+    }
+
+    Slot& slot = slots[task_id % slots.size()];
+    while (slot.sequence.load(memory_order_acquire) != task_id) {
+      if (stopped.load(memory_order_relaxed)) {
+        return;
+      }
+      boost::this_thread::yield();
+    }
+
+    slot.examples = extractor(tasks[task_id]);
+    slot.sequence.store(task_id + 1, memory_order_release);
+  }
+}
+
+boost::shared_ptr<ParseDataSet> ExamplePipeline::take(size_t task_id) {
+  Slot& slot = slots[task_id % slots.size()];
+  while (slot.sequence.load(memory_order_acquire) != task_id + 1) {
+    boost::this_thread::yield();
+  }
+
+  boost::shared_ptr<ParseDataSet> examples = slot.examples;
+  slot.examples.reset();
+  slot.sequence.store(task_id + slots.size(), memory_order_release);
+  return examples;
+}
+
+ExamplePipeline::~ExamplePipeline() {
+  stopped.store(true, memory_order_relaxed);
+  threads.join_all();
+}
+
+}  // namespace oxlm
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "corpus/parse_data_set.h"
+
+using namespace std;
+
+namespace oxlm {
+
+/**
+ * Extracts the training examples of a sequence of tasks on background
+ * threads, so that the extraction of the next minibatch overlaps with the
+ * gradient computation and update of the current one.
+ *
+ * The examples are handed over through a bounded ring of slots without
+ * locks. The extraction of a task waits until its slot is freed by the task
+ * capacity positions before it, so the extraction runs at most capacity
+ * tasks ahead of the training threads.
+ */
+class ExamplePipeline {
+ public:
+  typedef function<boost::shared_ptr<ParseDataSet>(const vector<int>&)>
+      Extractor;
+
+  ExamplePipeline(const vector<vector<int>>& tasks, size_t capacity,
+                  int num_threads, const Extractor& extractor);
+
+  // Waits until the examples of a task are extracted and returns them. Every
+  // task must be taken exactly once. The capacity must exceed the number of
+  // tasks which are waited for at the same time.
+  boost::shared_ptr<ParseDataSet> take(size_t task_id);
+
+  ~ExamplePipeline();
+
+ private:
+  void extract();
+
+  struct Slot {
+    atomic<size_t> sequence;
+    boost::shared_ptr<ParseDataSet> examples;
+  };
+
+  vector<vector<int>> tasks;
+  Extractor extractor;
+  vector<Slot> slots;
+  atomic<size_t> nextTask;
+  atomic<bool> stopped;
+  boost::thread_group threads;
+};
+
+}  // namespace oxlm
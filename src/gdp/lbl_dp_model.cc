@@ -1,4 +1,6 @@
+#include <atomic>
 #include <iomanip>
+#include <sstream>
 
 #include <boost/make_shared.hpp>
 #include <boost/archive/binary_iarchive.hpp>
@@ -170,6 +172,11 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::learn() {
   vector<int> indices(training_corpus->size());
   iota(indices.begin(), indices.end(), 0);
 
+  // The static oracle examples are the same in every iteration, so they are
+  // extracted once per sentence.
+  vector<boost::shared_ptr<ParseDataSet>> sentence_examples(
+      config->cache_examples ? training_corpus->size() : 0);
+
   vector<int> unsup_indices(unsup_training_corpus->size());
   iota(unsup_indices.begin(), unsup_indices.end(), 0);
 
@@ -195,6 +202,7 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::learn() {
   bool objective_improved = true;
   bool stop_training = false;
   Real global_objective = 0;
+  int global_num_examples = 0;
 
   boost::shared_ptr<ParsedWeights> global_gradient =
       boost::make_shared<ParsedWeights>(config, metadata, false);
@@ -202,22 +210,31 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::learn() {
       boost::make_shared<ParsedWeights>(config, metadata, false);
   MinibatchWords global_words;
 
-  int shared_index = 0;
-  // For no particular reason. It just looks like this works best.
-  int task_size =
-      sqrt(config->minibatch_size) / 4;  // to imitate word-level behaviour
+  // Tasks of the current iteration (or unsupervised minibatch) and the index
+  // of the first task of every minibatch. The threads take the tasks of a
+  // minibatch off a shared cursor.
+  vector<vector<int>> tasks;
+  vector<size_t> minibatch_tasks;
+  atomic<size_t> next_task(0);
+  boost::shared_ptr<ExamplePipeline> pipeline;
+  // Time each thread spends waiting for the other threads to finish their
+  // tasks in the current iteration.
+  vector<Real> idle_times(config->threads);
 
   omp_set_num_threads(config->threads);
   #pragma omp parallel
   {
     int minibatch_counter = 1;
     int minibatch_size = config->minibatch_size;
+    int thread_id = omp_get_thread_num();
+    // Only the word vectors touched by a minibatch are stored per thread.
     boost::shared_ptr<ParsedWeights> gradient =
-        boost::make_shared<ParsedWeights>(config, metadata, false);
+        boost::make_shared<ParsedWeights>(config, metadata, false, true);
 
     for (int iter = 0; (iter < config->iterations) && !stop_training; ++iter) {
       Real best_iter_objective = numeric_limits<Real>::infinity();
       auto iteration_start = get_time();
+      idle_times[thread_id] = 0;
 
       #pragma omp master
       {
@@ -226,128 +243,186 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::learn() {
           random_shuffle(indices.begin(), indices.end());
         }
         global_objective = 0;
+
+        // Asynchronous training ignores the minibatch boundaries, but its
+        // tasks are kept as small as the synchronous ones because every task
+        // is a separate update.
+        tasks.clear();
+        minibatch_tasks.assign(1, 0);
+        for (size_t start = 0; start < indices.size();
+             start += minibatch_size) {
+          vector<int> minibatch(
+              indices.begin() + start,
+              indices.begin() + min(start + minibatch_size, indices.size()));
+          addTasks(training_corpus, minibatch, tasks);
+          minibatch_tasks.push_back(tasks.size());
+        }
+        next_task = 0;
+      }
+
+      // Extracting the examples by decoding the training sentences may read
+      // any of the word vectors.
+      bool decodes = (config->bootstrap || config->bootstrap_iter > 0) &&
+                     iter >= config->bootstrap_iter;
+      if (decodes) {
+        weights->applyAllPendingDecay();
       }
 
       // Wait until the master thread finishes shuffling the indices.
       #pragma omp barrier
 
-      size_t start = 0;
-      while (start < training_corpus->size()) {
-        size_t end = min(training_corpus->size(), start + minibatch_size);
-
-        vector<int> minibatch(indices.begin() + start,
-                              min(indices.begin() + end, indices.end()));
-
-        // Reset the set of minibatch words shared across all threads.
+      // Only the static oracle extraction runs on background threads. Decoding
+      // reads the weights, which the training threads update concurrently,
+      // so iterations which decode extract on the training threads.
+      if (config->extraction_threads > 0 && !decodes) {
         #pragma omp master
         {
-          global_words = MinibatchWords();
-          shared_index = 0;
+          // Extract at most one minibatch ahead of the training threads.
+          size_t max_tasks = config->threads;
+          for (size_t i = 1; i < minibatch_tasks.size(); ++i) {
+            max_tasks =
+                max(max_tasks, minibatch_tasks[i] - minibatch_tasks[i - 1]);
+          }
+          // Every task gets its own engine, so the extraction threads never
+          // share one with each other or with the training threads.
+          uint32_t seed = eng();
+          pipeline = boost::make_shared<ExamplePipeline>(
+              tasks, 2 * max_tasks, config->extraction_threads,
+              [this, &training_corpus, &sentence_examples, seed,
+               iter](const vector<int>& task) {
+                MT19937 task_eng(seed + task.front());
+                return extractTaskExamples(training_corpus, task, iter,
+                                           sentence_examples, task_eng);
+              });
         }
 
-        // Wait until the global gradient is initialized. Otherwise, some
-        // gradient updates may be ignored.
+        // Wait until the extraction is started.
         #pragma omp barrier
+      }
 
+      if (config->asynchronous) {
+        // Threads take tasks off the shuffled corpus and apply their updates
+        // to the shared weights as soon as they are computed, without waiting
+        // for each other at the end of every minibatch.
         Real objective = 0;
-        int num_examples = 0;
-        MinibatchWords words;
-        size_t task_start;
         while (true) {
-          #pragma omp critical
-          {
-            task_start = shared_index;
-            shared_index += task_size;
-          }
-
-          if (task_start < minibatch.size()) {
-            size_t task_end = min(task_start + task_size, minibatch.size());
-            vector<int> task(minibatch.begin() + task_start,
-                             minibatch.begin() + task_end);
-            // Collect the training examples for the minibatch.
-            boost::shared_ptr<ParseDataSet> task_examples =
-                boost::make_shared<ParseDataSet>();
-
-            for (int j : task) {
-              if ((!config->bootstrap && (config->bootstrap_iter == 0)) ||
-                  (iter < config->bootstrap_iter)) {
-                parse_model->extractSentence(training_corpus->sentence_at(j),
-                                             task_examples);
-              } else if (config->bootstrap) {
-                parse_model->extractSentence(training_corpus->sentence_at(j),
-                                             weights, task_examples);
-              } else if (config->sample_decoding) {
-                parse_model->extractSentenceUnsupervised(
-                  training_corpus->sentence_at(j), weights, eng, task_examples);
-              } else {
-                parse_model->extractSentenceUnsupervised(
-                  training_corpus->sentence_at(j), weights, task_examples);
-              }
-            }
-
-            num_examples += task_examples->word_example_size() +
-                            task_examples->action_example_size();
-            if (config->predict_pos) {
-              num_examples += task_examples->tag_example_size();
-            }
-
-            if (config->noise_samples > 0) {
-              weights->estimateGradient(task_examples, gradient, objective,
-                                        words);
-            } else {
-              weights->getGradient(task_examples, gradient, objective, words);
-            }
-          } else {
-            break;
-          }
+          size_t task_id = next_task.fetch_add(1);
+          if (task_id >= tasks.size()) break;
+
+          boost::shared_ptr<ParseDataSet> task_examples =
+              pipeline ? pipeline->take(task_id)
+                       : extractTaskExamples(training_corpus, tasks[task_id],
+                                             iter, sentence_examples, eng);
+
+          MinibatchWords words;
+          getTaskGradient(task_examples, gradient, objective, words);
+          weights->asyncUpdate(words, gradient, adagrad);
+          // The cache is cleared after every update, as in synchronous training,
+          // so no sentence is decoded against normalizers of older weights.
+          weights->clearCache();
+          gradient->clear(words, false);
         }
 
-        global_gradient->syncUpdate(words, gradient);
-        
+        // Wait until all the updates of the iteration are applied. The
+        // regularizer is then applied once for the whole iteration.
+        auto tasks_done = get_time();
+        #pragma omp barrier
+        idle_times[thread_id] += get_duration(tasks_done, get_time());
+
+        objective += regularize(global_words, global_gradient, 1);
         #pragma omp critical
-        {
-          global_objective += objective;
-          global_words.merge(words);
-        }
+        global_objective += objective;
 
-        // Wait until the global gradient is fully updated by all threads and
-        // the global words are fully merged.
+        // Wait until the objective is fully accumulated.
         #pragma omp barrier
+        ++minibatch_counter;
+      } else {
+        for (size_t m = 1; m < minibatch_tasks.size(); ++m) {
+          // Reset the set of minibatch words shared across all threads.
+          #pragma omp master
+          {
+            global_words = MinibatchWords();
+            global_num_examples = 0;
+            next_task = minibatch_tasks[m - 1];
+          }
 
-        // Prepare minibatch words for parallel processing.
-        #pragma omp master
-        global_words.transform();
+          if (decodes) {
+            weights->applyAllPendingDecay();
+          }
 
-        // Wait until the minibatch words are fully prepared for parallel
-        // processing.
-        #pragma omp barrier
-        update(global_words, global_gradient, adagrad);
+          // Wait until the global gradient is initialized. Otherwise, some
+          // gradient updates may be ignored.
+          #pragma omp barrier
 
-        // Wait for all threads to finish making the model gradient update.
-        #pragma omp barrier
-        Real minibatch_factor = static_cast<Real>(num_examples) /
-                                (3 * training_corpus->numTokens());
-        if (config->predict_pos)
-          minibatch_factor = static_cast<Real>(num_examples) /
-                             (4 * training_corpus->numTokens());
+          Real objective = 0;
+          int num_examples = 0;
+          MinibatchWords words;
+          while (true) {
+            size_t task_id = next_task.fetch_add(1);
+            if (task_id >= minibatch_tasks[m]) break;
 
-        objective = regularize(global_words, global_gradient, minibatch_factor);
-        #pragma omp critical
-        global_objective += objective;
+            boost::shared_ptr<ParseDataSet> task_examples =
+                pipeline ? pipeline->take(task_id)
+                         : extractTaskExamples(training_corpus, tasks[task_id],
+                                               iter, sentence_examples, eng);
+            num_examples +=
+                getTaskGradient(task_examples, gradient, objective, words);
+          }
 
-        // Clear gradients.
-        gradient->clear(words, false);
-        global_gradient->clear(global_words, true);
+          global_gradient->syncUpdate(words, gradient);
+          
+          #pragma omp critical
+          {
+            global_objective += objective;
+            global_num_examples += num_examples;
+            global_words.merge(words);
+          }
 
-        // Wait the regularization update to finish and make sure the global
-        // words are reset only after the global gradient is fully cleared.
-        #pragma omp barrier
-        ++minibatch_counter;
-        start = end;
+          // Wait until the global gradient is fully updated by all threads and
+          // the global words are fully merged.
+          auto tasks_done = get_time();
+          #pragma omp barrier
+          idle_times[thread_id] += get_duration(tasks_done, get_time());
+
+          // Prepare minibatch words for parallel processing.
+          #pragma omp master
+          global_words.transform();
+
+          // Wait until the minibatch words are fully prepared for parallel
+          // processing.
+          #pragma omp barrier
+          update(global_words, global_gradient, adagrad);
+
+          // Wait for all threads to finish making the model gradient update.
+          #pragma omp barrier
+          // All threads regularize with the factor of the whole minibatch.
+          Real minibatch_factor = static_cast<Real>(global_num_examples) /
+                                  (3 * training_corpus->numTokens());
+          if (config->predict_pos)
+            minibatch_factor = static_cast<Real>(global_num_examples) /
+                               (4 * training_corpus->numTokens());
+
+          objective =
+              regularize(global_words, global_gradient, minibatch_factor);
+          #pragma omp critical
+          global_objective += objective;
+
+          // Clear gradients.
+          gradient->clear(words, false);
+          global_gradient->clear(global_words, true);
+
+          // Wait the regularization update to finish and make sure the global
+          // words are reset only after the global gradient is fully cleared.
+          #pragma omp barrier
+          ++minibatch_counter;
+        }
       }
 
       #pragma omp master
       {
+        // All the tasks of the iteration are taken at this point.
+        pipeline.reset();
+
         Real iteration_time = get_duration(iteration_start, get_time());
         std::cerr << "Iteration: " << iter << ", "
                   << "Time: " << iteration_time << " seconds, "
@@ -356,8 +431,12 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::learn() {
                   << "  Perplexity: "
                   << perplexity(global_objective, training_corpus->numTokens())
                   << "  Objective: "
-                  << global_objective / training_corpus->numTokens() << endl
-                  << endl;
+                  << global_objective / training_corpus->numTokens() << endl;
+        std::cerr << "Idle time per thread:";
+        for (Real idle_time : idle_times) {
+          std::cerr << " " << idle_time;
+        }
+        std::cerr << " seconds" << endl << endl;
 
         if (global_objective <= best_global_objective) {
           best_global_objective = global_objective;
@@ -428,7 +507,10 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::learn() {
         #pragma omp master
         {
           global_words = MinibatchWords();
-          shared_index = 0;
+          global_num_examples = 0;
+          tasks.clear();
+          addTasks(unsup_training_corpus, minibatch, tasks);
+          next_task = 0;
         }
 
         // Wait until the global gradient is initialized. Otherwise, some
@@ -438,43 +520,33 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::learn() {
         Real objective = 0;
         int num_examples = 0;
         MinibatchWords words;
-        size_t task_start;
         while (true) {
-          #pragma omp critical
-          {
-            task_start = shared_index;
-            shared_index += task_size;
+          size_t task_id = next_task.fetch_add(1);
+          if (task_id >= tasks.size()) break;
+
+          // Collect the training examples for the minibatch.
+          boost::shared_ptr<ParseDataSet> task_examples =
+              boost::make_shared<ParseDataSet>();
+
+          //TODO make inference rather than pre-parsing an option
+          for (int j : tasks[task_id]) {
+            parse_model->extractSentence(
+                unsup_training_corpus->sentence_at(j), task_examples);
+            // parse_model->extractSentenceUnsupervised(unsup_training_corpus->sentence_at(j),
+            //   weights, task_examples);
+          }
+          num_examples += task_examples->word_example_size() +
+                          task_examples->action_example_size();
+          if (config->predict_pos) {
+            num_examples += task_examples->tag_example_size();
           }
 
-          if (task_start < minibatch.size()) {
-            size_t task_end = min(task_start + task_size, minibatch.size());
-            vector<int> task(minibatch.begin() + task_start,
-                             minibatch.begin() + task_end);
-            // Collect the training examples for the minibatch.
-            boost::shared_ptr<ParseDataSet> task_examples =
-                boost::make_shared<ParseDataSet>();
-
-            //TODO make inference rather than pre-parsing an option
-            for (int j : task) {
-              parse_model->extractSentence(
-                  unsup_training_corpus->sentence_at(j), task_examples);
-              // parse_model->extractSentenceUnsupervised(unsup_training_corpus->sentence_at(j),
-              //   weights, task_examples);
-            }
-            num_examples += task_examples->word_example_size() +
-                            task_examples->action_example_size();
-            if (config->predict_pos) {
-              num_examples += task_examples->tag_example_size();
-            }
-
-            if (config->noise_samples > 0) {
-              weights->estimateGradient(task_examples, gradient, objective,
-                                        words);
-            } else {
-              weights->getGradient(task_examples, gradient, objective, words);
-            }
+          weights->applyPendingDecay(task_examples);
+          if (config->noise_samples > 0) {
+            weights->estimateGradient(task_examples, gradient, objective,
+                                      words);
           } else {
-            break;
+            weights->getGradient(task_examples, gradient, objective, words);
           }
         }
 
@@ -482,6 +554,7 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::learn() {
         #pragma omp critical
         {
           global_objective += objective;
+          global_num_examples += num_examples;
           global_words.merge(words);
         }
 
@@ -500,10 +573,11 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::learn() {
 
         // Wait for all threads to finish making the model gradient update.
         #pragma omp barrier
-        Real minibatch_factor = static_cast<Real>(num_examples) /
+        // All threads regularize with the factor of the whole minibatch.
+        Real minibatch_factor = static_cast<Real>(global_num_examples) /
                                 (3 * unsup_training_corpus->numTokens());
         if (config->predict_pos)
-          minibatch_factor = static_cast<Real>(num_examples) /
+          minibatch_factor = static_cast<Real>(global_num_examples) /
                              (4 * unsup_training_corpus->numTokens());
 
         objective = regularize(global_words, global_gradient, minibatch_factor);
@@ -566,6 +640,99 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::learn() {
   }
 }
 
+template <class ParseModel, class ParsedWeights, class Metadata>
+void LblDpModel<ParseModel, ParsedWeights, Metadata>::addTasks(
+    const boost::shared_ptr<ParsedCorpus>& corpus,
+    const vector<int>& minibatch, vector<vector<int>>& tasks) const {
+  // The cost of a sentence grows with its length, so the tasks are balanced
+  // by tokens. Taking the longest sentences first leaves the short tasks for
+  // the end of the minibatch, when the threads would otherwise sit idle.
+  vector<pair<size_t, int>> sentences;
+  size_t num_tokens = 0;
+  for (int j : minibatch) {
+    size_t length = corpus->sentence_at(j).size();
+    sentences.push_back(make_pair(length, j));
+    num_tokens += length;
+  }
+  stable_sort(sentences.begin(), sentences.end(),
+              [](const pair<size_t, int>& a, const pair<size_t, int>& b) {
+                return a.first > b.first;
+              });
+
+  // A few tasks per thread let the faster threads pick up the slack.
+  size_t task_tokens = max<size_t>(1, num_tokens / (4 * config->threads));
+
+  size_t tokens = task_tokens;
+  for (const auto& sentence : sentences) {
+    if (tokens >= task_tokens) {
+      tasks.push_back(vector<int>());
+      tokens = 0;
+    }
+    tasks.back().push_back(sentence.second);
+    tokens += sentence.first;
+  }
+}
+
+template <class ParseModel, class ParsedWeights, class Metadata>
+boost::shared_ptr<ParseDataSet>
+LblDpModel<ParseModel, ParsedWeights, Metadata>::extractTaskExamples(
+    const boost::shared_ptr<ParsedCorpus>& training_corpus,
+    const vector<int>& task, int iter,
+    vector<boost::shared_ptr<ParseDataSet>>& sentence_examples, MT19937& eng) {
+  boost::shared_ptr<ParseDataSet> task_examples =
+      boost::make_shared<ParseDataSet>();
+
+  for (int j : task) {
+    if ((!config->bootstrap && (config->bootstrap_iter == 0)) ||
+        (iter < config->bootstrap_iter)) {
+      if (config->cache_examples) {
+        // Every sentence is in a single task, so no locking is needed.
+        if (!sentence_examples[j]) {
+          sentence_examples[j] = boost::make_shared<ParseDataSet>();
+          parse_model->extractSentence(training_corpus->sentence_at(j),
+                                       sentence_examples[j]);
+        }
+        task_examples->extend(sentence_examples[j]);
+      } else {
+        parse_model->extractSentence(training_corpus->sentence_at(j),
+                                     task_examples);
+      }
+    } else if (config->bootstrap) {
+      parse_model->extractSentence(training_corpus->sentence_at(j), weights,
+                                   task_examples);
+    } else if (config->sample_decoding) {
+      parse_model->extractSentenceUnsupervised(training_corpus->sentence_at(j),
+                                               weights, eng, task_examples);
+    } else {
+      parse_model->extractSentenceUnsupervised(training_corpus->sentence_at(j),
+                                               weights, task_examples);
+    }
+  }
+
+  return task_examples;
+}
+
+template <class ParseModel, class ParsedWeights, class Metadata>
+int LblDpModel<ParseModel, ParsedWeights, Metadata>::getTaskGradient(
+    const boost::shared_ptr<ParseDataSet>& task_examples,
+    const boost::shared_ptr<ParsedWeights>& gradient, Real& objective,
+    MinibatchWords& words) {
+  int num_examples = task_examples->word_example_size() +
+                     task_examples->action_example_size();
+  if (config->predict_pos) {
+    num_examples += task_examples->tag_example_size();
+  }
+
+  weights->applyPendingDecay(task_examples);
+  if (config->noise_samples > 0) {
+    weights->estimateGradient(task_examples, gradient, objective, words);
+  } else {
+    weights->getGradient(task_examples, gradient, objective, words);
+  }
+
+  return num_examples;
+}
+
 template <class ParseModel, class ParsedWeights, class Metadata>
 void LblDpModel<ParseModel, ParsedWeights, Metadata>::update(
     const MinibatchWords& global_words,
@@ -573,6 +740,8 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::update(
     const boost::shared_ptr<ParsedWeights>& adagrad) {
   adagrad->updateSquared(global_words, global_gradient);
   weights->updateAdaGrad(global_words, global_gradient, adagrad);
+  // Cached predictions are stale once the weights change.
+  weights->clearCache();
 }
 
 template <class ParseModel, class ParsedWeights, class Metadata>
@@ -580,8 +749,10 @@ Real LblDpModel<ParseModel, ParsedWeights, Metadata>::regularize(
     const MinibatchWords& global_words,
     const boost::shared_ptr<ParsedWeights>& global_gradient,
     Real minibatch_factor) {
-  return weights->regularizerUpdate(global_words, global_gradient,
-                                    minibatch_factor);
+  Real objective = weights->regularizerUpdate(global_words, global_gradient,
+                                              minibatch_factor);
+  weights->clearCache();
+  return objective;
 }
 
 template <class ParseModel, class ParsedWeights, class Metadata>
@@ -607,6 +778,17 @@ template <class ParseModel, class ParsedWeights, class Metadata>
 void LblDpModel<ParseModel, ParsedWeights, Metadata>::evaluate(
     const boost::shared_ptr<ParsedCorpus>& test_corpus, Real& accumulator) {
   if (test_corpus == nullptr) return;
+
+  if (config->parallel_decoding) {
+    if (omp_in_parallel()) {
+      parallelEvaluate(test_corpus, accumulator);
+    } else {
+      #pragma omp parallel num_threads(config->threads)
+      parallelEvaluate(test_corpus, accumulator);
+    }
+    return;
+  }
+
   MT19937 eng;
   
   // Evaluation is done in a single thread.
@@ -642,12 +824,7 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::evaluate(
         objective += parse.weight();
 
         // Write output to conll-format file.
-        for (unsigned i = 1; i < parse.size(); ++i) {
-          outs << i << "\t" << dict->lookup(parse.word_at(i)) << "\t_\t_\t"
-               << dict->lookupTag(parse.tag_at(i)) << "\t_\t" << parse.arc_at(i)
-               << "\t" << dict->lookupLabel(parse.label_at(i)) << "\t_\t_\n";
-        }
-        outs << "\n";
+        writeConll(parse, outs);
 
         accumulator += objective;
       }
@@ -661,17 +838,207 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::evaluate(
                 << " sentences per second, " << static_cast<int>(tokens_per_sec)
                 << " tokens per second)\n";
       acc_counts->printAccuracy();
+      if (config->cache_size > 0) {
+        weights->printCacheStats();
+      }
+
+      weights->clearCache();
+    }
+  }
+}
+
+template <class ParseModel, class ParsedWeights, class Metadata>
+void LblDpModel<ParseModel, ParsedWeights, Metadata>::parallelEvaluate(
+    const boost::shared_ptr<ParsedCorpus>& test_corpus, Real& accumulator) {
+  for (unsigned beam_size: config->beam_sizes) {
+    auto beam_start = get_time();
+
+    #pragma omp master
+    {
+      std::cerr << "parsing with beam size " << beam_size << " on "
+                << omp_get_num_threads() << " threads:\n";
+      accumulator = 0;
+      decoded_sentences.assign(test_corpus->size(), std::string());
+      decoded_counts = boost::make_shared<AccuracyCounts>(dict);
+      decoding_seed = MT19937::GetTrulyRandomSeed();
+    }
+
+    // Wait until the master thread has reset the shared buffers.
+    #pragma omp barrier
+
+    Real objective = 0;
+    boost::shared_ptr<AccuracyCounts> acc_counts =
+        boost::make_shared<AccuracyCounts>(dict);
+
+    // Sentence lengths vary a lot, so sentences are handed out one at a time.
+    #pragma omp for schedule(dynamic) nowait
+    for (size_t j = 0; j < test_corpus->size(); ++j) {
+      Parser parse;
+      if (config->sample_decoding) {
+        // Every sentence draws from its own engine, so its samples do not
+        // depend on which thread decodes it.
+        MT19937 eng(decoding_seed + j);
+        parse = parse_model->particleEvaluateSentence(
+            test_corpus->sentence_at(j), weights, eng, acc_counts, true,
+            beam_size);
+      } else {
+        parse = parse_model->evaluateSentence(
+            test_corpus->sentence_at(j), weights, acc_counts, true, beam_size);
+      }
+
+      objective += parse.weight();
+
+      std::ostringstream out;
+      writeConll(parse, out);
+      decoded_sentences[j] = out.str();
+    }
+
+    #pragma omp critical
+    {
+      accumulator += objective;
+      decoded_counts->merge(*acc_counts);
+    }
+
+    // Wait until all sentences are decoded and all counts are merged.
+    #pragma omp barrier
+
+    #pragma omp master
+    {
+      std::ofstream outs;
+      outs.open(config->test_output_file);
+      for (const std::string& sentence: decoded_sentences) {
+        outs << sentence;
+      }
+      outs.close();
+
+      Real beam_time = get_duration(beam_start, get_time());
+      Real sents_per_sec = static_cast<int>(test_corpus->size()) / beam_time;
+      Real tokens_per_sec =
+          static_cast<int>(test_corpus->numTokens()) / beam_time;
+      std::cerr << "(" << beam_time << "s, " << static_cast<int>(sents_per_sec)
+                << " sentences per second, " << static_cast<int>(tokens_per_sec)
+                << " tokens per second)\n";
+      decoded_counts->printAccuracy();
+      if (config->cache_size > 0) {
+        weights->printCacheStats();
+      }
 
+      // Every thread is done decoding, so clearing the cache wipes no cache
+      // still in use.
       weights->clearCache();
     }
+
+    // The shared buffers are reset for the next beam size.
+    #pragma omp barrier
   }
 }
 
+template <class ParseModel, class ParsedWeights, class Metadata>
+void LblDpModel<ParseModel, ParsedWeights, Metadata>::parse(
+    std::istream& in, std::ostream& out, bool txt_input) {
+  boost::shared_ptr<ParsedCorpus> corpus =
+      boost::make_shared<ParsedCorpus>(config);
+  unsigned beam_size = config->beam_sizes.back();
+  size_t chunk_size = std::max(config->minibatch_size, 1);
+
+  std::vector<ParsedSentence> sentences;
+  int num_sentences = 0;
+  size_t num_tokens = 0;
+  auto parse_start = get_time();
+
+  omp_set_num_threads(config->threads);
+  #pragma omp parallel
+  {
+    MT19937 eng;
+    boost::shared_ptr<AccuracyCounts> acc_counts =
+        boost::make_shared<AccuracyCounts>(dict);
+
+    while (true) {
+      // Only the next chunk of the input is held in memory.
+      #pragma omp master
+      {
+        sentences.clear();
+        ParsedSentence sent;
+        int index = config->num_train_sentences + num_sentences + 1;
+        while (sentences.size() < chunk_size &&
+               (txt_input
+                    ? corpus->readTxtSentence(in, dict, true, index, &sent)
+                    : corpus->readSentence(in, dict, true, index, &sent))) {
+          sentences.push_back(sent);
+          num_tokens += sent.size();
+          ++num_sentences;
+          ++index;
+        }
+        decoded_sentences.assign(sentences.size(), std::string());
+      }
+
+      // Wait until the master thread has read the next chunk.
+      #pragma omp barrier
+
+      if (sentences.empty()) break;
+
+      #pragma omp for schedule(dynamic)
+      for (size_t j = 0; j < sentences.size(); ++j) {
+        Parser parse;
+        if (config->sample_decoding) {
+          parse = parse_model->particleEvaluateSentence(
+              sentences[j], weights, eng, acc_counts, false, beam_size);
+        } else {
+          parse = parse_model->evaluateSentence(sentences[j], weights,
+                                                acc_counts, false, beam_size);
+        }
+
+        std::ostringstream sentence_out;
+        writeConll(parse, sentence_out);
+        decoded_sentences[j] = sentence_out.str();
+      }
+
+      #pragma omp master
+      {
+        for (const std::string& sentence: decoded_sentences) {
+          out << sentence;
+        }
+        out.flush();
+      }
+
+      // Wait until the output is written before reading the next chunk.
+      #pragma omp barrier
+    }
+
+    weights->clearCache();
+  }
+
+  Real parse_time = get_duration(parse_start, get_time());
+  std::cerr << "Parsed " << num_sentences << " sentences (" << parse_time
+            << "s, " << static_cast<int>(num_sentences / parse_time)
+            << " sentences per second, "
+            << static_cast<int>(num_tokens / parse_time)
+            << " tokens per second)\n";
+  if (config->cache_size > 0) {
+    weights->printCacheStats();
+  }
+}
+
+template <class ParseModel, class ParsedWeights, class Metadata>
+void LblDpModel<ParseModel, ParsedWeights, Metadata>::writeConll(
+    const Parser& parse, std::ostream& out) const {
+  for (unsigned i = 1; i < parse.size(); ++i) {
+    out << i << "\t" << dict->lookup(parse.word_at(i)) << "\t_\t_\t"
+        << dict->lookupTag(parse.tag_at(i)) << "\t_\t" << parse.arc_at(i)
+        << "\t" << dict->lookupLabel(parse.label_at(i)) << "\t_\t_\n";
+  }
+  out << "\n";
+}
+
 template <class ParseModel, class ParsedWeights, class Metadata>
 void LblDpModel<ParseModel, ParsedWeights, Metadata>::evaluate(
     const boost::shared_ptr<ParsedCorpus>& test_corpus,
     const Time& iteration_start, int minibatch_counter, Real& log_likelihood,
     Real& best_perplexity) {
+  // Decoding and saving read all the word vectors.
+  weights->applyAllPendingDecay();
+  #pragma omp barrier
+
   if (test_corpus != nullptr) {
     evaluate(test_corpus, log_likelihood);
 
@@ -731,11 +1098,18 @@ void LblDpModel<ParseModel, ParsedWeights, Metadata>::load(
     iar >> dict;
     iar >> weights;
     iar >> metadata;
+    parse_model = boost::make_shared<ParseModel>(config);
     cerr << "Reading model took " << get_duration(start_time, get_time())
          << " seconds..." << endl;
   }
 }
 
+template <class ParseModel, class ParsedWeights, class Metadata>
+void LblDpModel<ParseModel, ParsedWeights, Metadata>::quantize(
+    Quantization quantization) {
+  weights->quantize(quantization);
+}
+
 template <class ParseModel, class ParsedWeights, class Metadata>
 void LblDpModel<ParseModel, ParsedWeights, Metadata>::clearCache() {
   weights->clearCache();
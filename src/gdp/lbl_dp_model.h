@@ -1,5 +1,10 @@
 #pragma once
 
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
 #include <boost/shared_ptr.hpp>
 
 #include "corpus/dict.h"
@@ -27,6 +32,7 @@
 #include "gdp/transition_parser.h"
 #include "gdp/arc_standard_labelled_parse_model.h"
 #include "gdp/accuracy_counts.h"
+#include "gdp/example_pipeline.h"
 
 namespace oxlm {
 
@@ -57,6 +63,11 @@ class LblDpModel {
   void evaluate(const boost::shared_ptr<ParsedCorpus>& corpus,
                 Real& accumulator);
 
+  // Parses the sentences read from a CoNLL or plain text stream and writes
+  // the parses to another stream in CoNLL format. Sentences are read in chunks
+  // of minibatch_size sentences, each of which is decoded in parallel.
+  void parse(std::istream& in, std::ostream& out, bool txt_input);
+
   Real predict(int word_id, const vector<int>& context) const;
 
   MatrixReal getWordVectors() const;
@@ -67,6 +78,10 @@ class LblDpModel {
 
   void load(const string& filename);
 
+  // Quantizes the word vectors of a loaded model for decoding. The model can
+  // no longer be trained or saved afterwards.
+  void quantize(Quantization quantization);
+
   void clearCache();
 
   bool operator==(
@@ -77,11 +92,42 @@ class LblDpModel {
                 Real& objective, Real& best_perplexity);
 
  private:
+  // Splits a minibatch into tasks of roughly the same number of tokens, with
+  // the longest sentences first, and appends them to the tasks.
+  void addTasks(const boost::shared_ptr<ParsedCorpus>& corpus,
+                const vector<int>& minibatch,
+                vector<vector<int>>& tasks) const;
+
+  // Extracts the training examples of a task of sentences.
+  boost::shared_ptr<ParseDataSet> extractTaskExamples(
+      const boost::shared_ptr<ParsedCorpus>& training_corpus,
+      const vector<int>& task, int iter,
+      vector<boost::shared_ptr<ParseDataSet>>& sentence_examples,
+      MT19937& eng);
+
+  // Adds the gradient of the training examples of a task. Returns the number
+  // of examples.
+  int getTaskGradient(const boost::shared_ptr<ParseDataSet>& task_examples,
+                      const boost::shared_ptr<ParsedWeights>& gradient,
+                      Real& objective, MinibatchWords& words);
+
+  // Decodes the corpus with every thread of the current team. Must be reached
+  // by all threads of the team.
+  void parallelEvaluate(const boost::shared_ptr<ParsedCorpus>& corpus,
+                        Real& accumulator);
+
+  void writeConll(const Parser& parse, std::ostream& out) const;
+
   boost::shared_ptr<ModelConfig> config;
   boost::shared_ptr<Dict> dict;
   boost::shared_ptr<Metadata> metadata;
   boost::shared_ptr<ParsedWeights> weights;
   boost::shared_ptr<ParseModel> parse_model;
+
+  // Shared between the threads during parallel decoding.
+  std::vector<std::string> decoded_sentences;
+  boost::shared_ptr<AccuracyCounts> decoded_counts;
+  uint32_t decoding_seed;
 };
 
 }  // namespace oxlm
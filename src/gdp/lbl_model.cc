@@ -86,6 +86,7 @@ void LblModel<GlobalWeights, MinibatchWeights, Metadata>::learn() {
 
   Real best_perplexity = numeric_limits<Real>::infinity();
   Real global_objective = 0, test_objective = 0;
+  int global_num_examples = 0;
   boost::shared_ptr<MinibatchWeights> global_gradient =
       boost::make_shared<MinibatchWeights>(config, metadata, false);
   boost::shared_ptr<GlobalWeights> adagrad =
@@ -113,109 +114,164 @@ void LblModel<GlobalWeights, MinibatchWeights, Metadata>::learn() {
           random_shuffle(indices.begin(), indices.end());
         }
         global_objective = 0;
+        shared_index = 0;
       }
 
       #pragma omp barrier
-      size_t start = 0;
-      while (start < training_corpus->size()) {
-        size_t end = min(training_corpus->size(), start + minibatch_size);
-
-        vector<int> minibatch(indices.begin() + start,
-                              min(indices.begin() + end, indices.end()));
-
-        // Reset the set of minibatch words shared across all threads.
-        #pragma omp master
-        {
-          global_words = MinibatchWords();
-          shared_index = 0;
-        }
-
-        // Wait until the global gradient is initialized. Otherwise, some
-        // gradient updates may be ignored.
-        #pragma omp barrier
-
+      if (config->asynchronous) {
+        // Threads take tasks off the shuffled corpus and apply their updates
+        // to the shared weights as soon as they are computed, without waiting
+        // for each other at the end of every minibatch.
         Real objective = 0;
-        int num_examples = 0;
-        MinibatchWords words;
         size_t task_start;
         while (true) {
-
           #pragma omp critical
           {
             task_start = shared_index;
             shared_index += task_size;
           }
 
-          if (task_start < minibatch.size()) {
-            size_t task_end = min(task_start + task_size, minibatch.size());
-            vector<int> task(minibatch.begin() + task_start,
-                             minibatch.begin() + task_end);
-            boost::shared_ptr<DataSet> task_examples =
-                boost::make_shared<DataSet>();
+          if (task_start >= indices.size()) break;
 
-            for (int j : task) {
-              ngram_model->extractSentence(training_corpus->sentence_at(j),
-                                           task_examples);
-            }
-            num_examples += task_examples->size();
+          size_t task_end = min(task_start + task_size, indices.size());
+          boost::shared_ptr<DataSet> task_examples =
+              boost::make_shared<DataSet>();
+          for (size_t k = task_start; k < task_end; ++k) {
+            ngram_model->extractSentence(
+                training_corpus->sentence_at(indices[k]), task_examples);
+          }
 
-            if (config->noise_samples > 0) {
-              weights->estimateGradient(task_examples, gradient, objective,
-                                        words);
-            } else {
-              weights->getGradient(task_examples, gradient, objective, words);
-            }
+          MinibatchWords words;
+          weights->applyPendingDecay(task_examples);
+          if (config->noise_samples > 0) {
+            weights->estimateGradient(task_examples, gradient, objective,
+                                      words);
           } else {
-            break;
+            weights->getGradient(task_examples, gradient, objective, words);
           }
+          weights->asyncUpdate(words, gradient, adagrad);
+          // Cached normalizers are stale once the weights change.
+          weights->clearCache();
+          gradient->clear(words, false);
         }
 
-        global_gradient->syncUpdate(words, gradient);
+        // Wait until all the updates of the iteration are applied. The
+        // regularizer is then applied once for the whole iteration.
+        #pragma omp barrier
+        objective += regularize(global_words, global_gradient, 1);
         #pragma omp critical
-        {
-          global_objective += objective;
-          global_words.merge(words);
-        }
+        global_objective += objective;
 
-        // Wait until the global gradient is fully updated by all threads and
-        // the global words are fully merged.
+        // Wait until the objective is fully accumulated.
         #pragma omp barrier
+        ++minibatch_counter;
+      } else {
+        size_t start = 0;
+        while (start < training_corpus->size()) {
+          size_t end = min(training_corpus->size(), start + minibatch_size);
 
-        // Prepare minibatch words for parallel processing.
-        #pragma omp master
-        global_words.transform();
+          vector<int> minibatch(indices.begin() + start,
+                                min(indices.begin() + end, indices.end()));
 
-        // Wait until the minibatch words are fully prepared for parallel
-        // processing.
-        #pragma omp barrier
-        update(global_words, global_gradient, adagrad);
+          // Reset the set of minibatch words shared across all threads.
+          #pragma omp master
+          {
+            global_words = MinibatchWords();
+            global_num_examples = 0;
+            shared_index = 0;
+          }
 
-        // Wait for all threads to finish making the model gradient update.
-        #pragma omp barrier
+          // Wait until the global gradient is initialized. Otherwise, some
+          // gradient updates may be ignored.
+          #pragma omp barrier
 
-        Real minibatch_factor =
-            static_cast<Real>(num_examples) / training_corpus->numTokens();
-        objective = regularize(global_words, global_gradient, minibatch_factor);
-        
-        #pragma omp critical
-        global_objective += objective;
+          Real objective = 0;
+          int num_examples = 0;
+          MinibatchWords words;
+          size_t task_start;
+          while (true) {
 
-        // Clear gradients.
-        gradient->clear(words, false);
-        global_gradient->clear(global_words, true);
+            #pragma omp critical
+            {
+              task_start = shared_index;
+              shared_index += task_size;
+            }
 
-        // Wait the regularization update to finish and make sure the global
-        // words are reset only after the global gradient is fully cleared.
-        #pragma omp barrier
+            if (task_start < minibatch.size()) {
+              size_t task_end = min(task_start + task_size, minibatch.size());
+              vector<int> task(minibatch.begin() + task_start,
+                               minibatch.begin() + task_end);
+              boost::shared_ptr<DataSet> task_examples =
+                  boost::make_shared<DataSet>();
+
+              for (int j : task) {
+                ngram_model->extractSentence(training_corpus->sentence_at(j),
+                                             task_examples);
+              }
+              num_examples += task_examples->size();
+
+              weights->applyPendingDecay(task_examples);
+              if (config->noise_samples > 0) {
+                weights->estimateGradient(task_examples, gradient, objective,
+                                          words);
+              } else {
+                weights->getGradient(task_examples, gradient, objective, words);
+              }
+            } else {
+              break;
+            }
+          }
+
+          global_gradient->syncUpdate(words, gradient);
+          #pragma omp critical
+          {
+            global_objective += objective;
+            global_num_examples += num_examples;
+            global_words.merge(words);
+          }
 
-        // don't evaluate before end of iteration
-        if ((minibatch_counter % 100000 == 0) && (iter == 0)) {
-          evaluate(test_corpus, iteration_start, minibatch_counter,
-                   test_objective, best_perplexity);
-        } 
+          // Wait until the global gradient is fully updated by all threads and
+          // the global words are fully merged.
+          #pragma omp barrier
 
-        ++minibatch_counter;
-        start = end;
+          // Prepare minibatch words for parallel processing.
+          #pragma omp master
+          global_words.transform();
+
+          // Wait until the minibatch words are fully prepared for parallel
+          // processing.
+          #pragma omp barrier
+          update(global_words, global_gradient, adagrad);
+
+          // Wait for all threads to finish making the model gradient update.
+          #pragma omp barrier
+
+          // All threads regularize with the factor of the whole minibatch.
+          Real minibatch_factor = static_cast<Real>(global_num_examples) /
+                                  training_corpus->numTokens();
+          objective =
+              regularize(global_words, global_gradient, minibatch_factor);
+          
+          #pragma omp critical
+          global_objective += objective;
+
+          // Clear gradients.
+          gradient->clear(words, false);
+          global_gradient->clear(global_words, true);
+
+          // Wait the regularization update to finish and make sure the global
+          // words are reset only after the global gradient is fully cleared.
+          #pragma omp barrier
+
+          // don't evaluate before end of iteration
+          if ((minibatch_counter % 100000 == 0) && (iter == 0)) {
+            evaluate(test_corpus, iteration_start, minibatch_counter,
+                     test_objective, best_perplexity);
+          } 
+
+          ++minibatch_counter;
+          start = end;
+        }
       }
 
       evaluate(test_corpus, iteration_start, minibatch_counter, test_objective,
@@ -322,6 +378,10 @@ void LblModel<GlobalWeights, MinibatchWeights, Metadata>::evaluate(
     const boost::shared_ptr<SentenceCorpus>& test_corpus,
     const Time& iteration_start, int minibatch_counter, Real& log_likelihood,
     Real& best_perplexity) const {
+  // Evaluating and saving read all the word vectors.
+  weights->applyAllPendingDecay();
+  #pragma omp barrier
+
   if (test_corpus != nullptr) {
     evaluate(test_corpus, log_likelihood);
 
@@ -0,0 +1,137 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/program_options.hpp>
+#include <boost/serialization/shared_ptr.hpp>
+
+#include "corpus/model_config.h"
+#include "lbl/parsed_factored_metadata.h"
+#include "lbl/parsed_factored_weights.h"
+#include "lbl/tagged_parsed_factored_metadata.h"
+#include "lbl/tagged_parsed_factored_weights.h"
+
+#include "gdp/lbl_dp_model.h"
+
+using namespace boost::program_options;
+using namespace oxlm;
+using namespace std;
+
+template <class ParseModel, class ParsedWeights, class Metadata>
+void parse(const boost::shared_ptr<ModelConfig>& options, bool txt_input) {
+  LblDpModel<ParseModel, ParsedWeights, Metadata> model;
+  model.load(options->model_input_file);
+
+  // Decoding settings are taken from the command line, not from the model.
+  boost::shared_ptr<ModelConfig> config = model.getConfig();
+  config->context_type = options->context_type;
+  config->beam_sizes = options->beam_sizes;
+  config->sample_decoding = options->sample_decoding;
+  config->tag_pos = options->tag_pos;
+  config->threads = options->threads;
+  config->minibatch_size = options->minibatch_size;
+  config->cache_size = options->cache_size;
+  model.quantize(options->quantization);
+
+  model.parse(cin, cout, txt_input);
+}
+
+// Parses sentences read from standard input with a trained model and writes
+// the parses to standard output in CoNLL format.
+int main(int argc, char** argv) {
+  options_description desc("Command line options");
+  desc.add_options()
+     ("help,h", "Print available options")
+     ("model-in,m", value<string>()->required(), "File containing the model")
+     ("input-format", value<string>()->default_value("conll"),
+        "Format of the input: conll, or txt for one tokenised sentence per "
+        "line.")
+     ("context-type", value<string>()->default_value("more-extended"),
+        "Conditioning context used when training the model.")
+     ("beam-size", value<int>()->default_value(8),
+        "Beam size for decoding, or number of particles for sample decoding. "
+        "If zero, greedy decoding is used.")
+     ("sample-decoding", value<bool>()->default_value(false),
+        "Particle filter sampling during decoding.")
+     ("tag-pos", value<bool>()->default_value(false),
+        "Tag POS during decoding.")
+     ("threads", value<int>()->default_value(1), "number of worker threads.")
+     ("cache-size", value<int>()->default_value(0),
+        "Maximum number of cached normalizers and distributions per thread. "
+        "If zero, predictions are not cached.")
+     ("chunk-size", value<int>()->default_value(1000),
+        "Number of sentences held in memory and decoded in parallel.")
+     ("quantization", value<string>()->default_value("none"),
+        "Precision of the word vectors when decoding: none, fp16, or int8 "
+        "with a scale per word.");
+
+  variables_map vm;
+  store(parse_command_line(argc, argv, desc), vm);
+  if (vm.count("help")) {
+    cerr << desc << endl;
+    return 1;
+  }
+
+  notify(vm);
+
+  boost::shared_ptr<ModelConfig> options = boost::make_shared<ModelConfig>();
+  options->model_input_file = vm["model-in"].as<string>();
+  options->context_type = vm["context-type"].as<string>();
+  options->beam_sizes = {static_cast<unsigned>(vm["beam-size"].as<int>())};
+  options->sample_decoding = vm["sample-decoding"].as<bool>();
+  options->tag_pos = vm["tag-pos"].as<bool>();
+  options->threads = vm["threads"].as<int>();
+  options->minibatch_size = vm["chunk-size"].as<int>();
+  options->cache_size = vm["cache-size"].as<int>();
+
+  string quantization = vm["quantization"].as<string>();
+  if (quantization == "none") {
+    options->quantization = Quantization::none;
+  } else if (quantization == "fp16") {
+    options->quantization = Quantization::fp16;
+  } else if (quantization == "int8") {
+    options->quantization = Quantization::int8;
+  } else {
+    cerr << "Unknown quantization: " << quantization << endl;
+    return 1;
+  }
+
+  string input_format = vm["input-format"].as<string>();
+  if (input_format != "conll" && input_format != "txt") {
+    cerr << "Unknown input format: " << input_format << endl;
+    return 1;
+  }
+  bool txt_input = (input_format == "txt");
+
+  // The model type is determined by the configuration stored with the model.
+  boost::shared_ptr<ModelConfig> model_config;
+  {
+    ifstream fin(options->model_input_file);
+    if (!fin) {
+      cerr << "Could not open model file " << options->model_input_file
+           << endl;
+      return 1;
+    }
+    boost::archive::binary_iarchive iar(fin);
+    iar >> model_config;
+  }
+
+  if (model_config->pyp_model ||
+      (model_config->parser_type != ParserType::arcstandard &&
+       model_config->parser_type != ParserType::arcstandard2)) {
+    cerr << "Only arc-standard neural parsing models are supported." << endl;
+    return 1;
+  }
+
+  if (model_config->lexicalised && model_config->predict_pos) {
+    parse<ArcStandardLabelledParseModel<TaggedParsedFactoredWeights>,
+          TaggedParsedFactoredWeights, TaggedParsedFactoredMetadata>(
+        options, txt_input);
+  } else {
+    parse<ArcStandardLabelledParseModel<ParsedFactoredWeights>,
+          ParsedFactoredWeights, ParsedFactoredMetadata>(options, txt_input);
+  }
+
+  return 0;
+}
@@ -29,25 +29,25 @@ class Parser : public ParsedSentence {
     if ((j < 0) || (j >= size())) return;
 
     if (i < j) {
+      Indices& children = left_children_.mutable_at(j);
       bool inserted = false;
-      for (auto p = left_children_.at(j).begin();
-           (p < left_children_.at(j).end()) && !inserted; ++p) {
+      for (auto p = children.begin(); (p < children.end()) && !inserted; ++p) {
         if (*p > i) {
-          left_children_.at(j).insert(p, i);
+          children.insert(p, i);
           inserted = true;
         }
       }
-      if (!inserted) left_children_.at(j).push_back(i);
+      if (!inserted) children.push_back(i);
     } else if (i > j) {
+      Indices& children = right_children_.mutable_at(j);
       bool inserted = false;
-      for (auto p = right_children_.at(j).begin();
-           (p < right_children_.at(j).end()) && !inserted; ++p) {
+      for (auto p = children.begin(); (p < children.end()) && !inserted; ++p) {
         if (*p > i) {
-          right_children_.at(j).insert(p, i);
+          children.insert(p, i);
           inserted = true;
         }
       }
-      if (!inserted) right_children_.at(j).push_back(i);
+      if (!inserted) children.push_back(i);
     }
   }
 
@@ -187,8 +187,8 @@ class Parser : public ParsedSentence {
   }
 
  private:
-  IndicesList left_children_;
-  IndicesList right_children_;
+  CowVector<Indices> left_children_;
+  CowVector<Indices> right_children_;
   Real weight_;
 };
 
@@ -1,5 +1,8 @@
 #include "gdp/pyp_dp_model.h"
 
+#include <fstream>
+#include <sstream>
+
 namespace oxlm {
 
 template <class ParseModel, class ParsedWeights>
@@ -16,6 +19,27 @@ PypDpModel<ParseModel, ParsedWeights>::PypDpModel(
   parse_model_ = boost::make_shared<ParseModel>(config);
 }
 
+template <class ParseModel, class ParsedWeights>
+template <class Extract>
+void PypDpModel<ParseModel, ParsedWeights>::extractMinibatch(
+    const std::vector<int>& minibatch, MT19937& eng,
+    const Extract& extract) const {
+  if (config_->threads <= 1) {
+    for (auto j : minibatch) {
+      extract(j, eng);
+    }
+    return;
+  }
+
+  uint32_t seed = eng();
+  // Parsing times vary a lot, so sentences are handed out one at a time.
+  #pragma omp parallel for num_threads(config_->threads) schedule(dynamic)
+  for (size_t i = 0; i < minibatch.size(); ++i) {
+    MT19937 sentence_eng(seed + minibatch[i]);
+    extract(minibatch[i], sentence_eng);
+  }
+}
+
 template <class ParseModel, class ParsedWeights>
 void PypDpModel<ParseModel, ParsedWeights>::learn_semisup() {
   MT19937 eng;
@@ -128,11 +152,7 @@ void PypDpModel<ParseModel, ParsedWeights>::learn_semisup() {
       }
 
       // THEN add new examples.
-      for (auto j : minibatch) {
-        if (!sup_training_corpus->sentence_at(j).projective_dependency()) {
-          ++non_projective_count;
-        }
-
+      extractMinibatch(minibatch, eng, [&](int j, MT19937& sentence_eng) {
         sup_examples_list.at(j)->clear();
         if ((!config_->bootstrap && (config_->bootstrap_iter == 0)) ||
             (iter < config_->bootstrap_iter)) {
@@ -140,13 +160,19 @@ void PypDpModel<ParseModel, ParsedWeights>::learn_semisup() {
                                         sup_examples_list.at(j));
         } else if (config_->bootstrap) {
           parse_model_->extractSentence(sup_training_corpus->sentence_at(j),
-                                        weights_, eng, sup_examples_list.at(j));
+                                        weights_, sentence_eng,
+                                        sup_examples_list.at(j));
         } else {
           parse_model_->extractSentenceUnsupervised(
               sup_training_corpus->sentence_at(j), weights_,
               sup_examples_list.at(j));
         }
+      });
 
+      for (auto j : minibatch) {
+        if (!sup_training_corpus->sentence_at(j).projective_dependency()) {
+          ++non_projective_count;
+        }
         minibatch_examples->extend(sup_examples_list.at(j));
       }
 
@@ -183,14 +209,18 @@ void PypDpModel<ParseModel, ParsedWeights>::learn_semisup() {
 
   if (config_->restricted_semi_supervised) {
     std::cerr << "Parsing unlabelled data" << std::endl;
-    boost::shared_ptr<AccuracyCounts> temp_acc_counts =
-        boost::make_shared<AccuracyCounts>(dict_);
-    for (unsigned j = 0; j < unsup_training_corpus->size(); ++j) {
-      Parser parse = parse_model_->evaluateSentence(
-          unsup_training_corpus->sentence_at(j), weights_, temp_acc_counts,
-          false, config_->num_particles);
-      unsup_training_corpus->set_arcs_at(j, parse);
-      unsup_training_corpus->set_labels_at(j, parse);
+    #pragma omp parallel num_threads(config_->threads)
+    {
+      boost::shared_ptr<AccuracyCounts> temp_acc_counts =
+          boost::make_shared<AccuracyCounts>(dict_);
+      #pragma omp for schedule(dynamic)
+      for (size_t j = 0; j < unsup_training_corpus->size(); ++j) {
+        Parser parse = parse_model_->evaluateSentence(
+            unsup_training_corpus->sentence_at(j), weights_, temp_acc_counts,
+            false, config_->num_particles);
+        unsup_training_corpus->set_arcs_at(j, parse);
+        unsup_training_corpus->set_labels_at(j, parse);
+      }
     }
   }
 
@@ -228,7 +258,7 @@ void PypDpModel<ParseModel, ParsedWeights>::learn_semisup() {
       }
 
       // THEN add new examples.
-      for (auto j : minibatch) {
+      extractMinibatch(minibatch, eng, [&](int j, MT19937& sentence_eng) {
         unsup_examples_list.at(j)->clear();
         if (config_->restricted_semi_supervised) {
           // Don't re-parse, only extract word prediction examples.
@@ -243,10 +273,12 @@ void PypDpModel<ParseModel, ParsedWeights>::learn_semisup() {
               unsup_examples_list.at(j));
         } else {
           parse_model_->extractSentenceUnsupervised(
-              unsup_training_corpus->sentence_at(j), weights_, eng,
+              unsup_training_corpus->sentence_at(j), weights_, sentence_eng,
               unsup_examples_list.at(j));
         }
+      });
 
+      for (auto j : minibatch) {
         minibatch_examples->extend(unsup_examples_list.at(j));
       }
 
@@ -371,11 +403,7 @@ void PypDpModel<ParseModel, ParsedWeights>::learn() {
       }
 
       // THEN add new examples.
-      for (auto j : minibatch) {
-        if (!sup_training_corpus->sentence_at(j).projective_dependency()) {
-          ++non_projective_count;
-        }
-
+      extractMinibatch(minibatch, eng, [&](int j, MT19937& sentence_eng) {
         sup_examples_list.at(j)->clear();
         if ((!config_->bootstrap && (config_->bootstrap_iter == 0)) ||
             (iter < config_->bootstrap_iter)) {
@@ -383,13 +411,19 @@ void PypDpModel<ParseModel, ParsedWeights>::learn() {
                                         sup_examples_list.at(j));
         } else if (config_->bootstrap) {
           parse_model_->extractSentence(sup_training_corpus->sentence_at(j),
-                                        weights_, eng, sup_examples_list.at(j));
+                                        weights_, sentence_eng,
+                                        sup_examples_list.at(j));
         } else {
           parse_model_->extractSentenceUnsupervised(
               sup_training_corpus->sentence_at(j), weights_,
               sup_examples_list.at(j));
         }
+      });
 
+      for (auto j : minibatch) {
+        if (!sup_training_corpus->sentence_at(j).projective_dependency()) {
+          ++non_projective_count;
+        }
         minibatch_examples->extend(sup_examples_list.at(j));
       }
 
@@ -474,6 +508,11 @@ template <class ParseModel, class ParsedWeights>
 void PypDpModel<ParseModel, ParsedWeights>::evaluate(
     const boost::shared_ptr<ParsedCorpus>& test_corpus,
     Real& accumulator) const {
+  if (test_corpus != nullptr && config_->parallel_decoding) {
+    parallelEvaluate(test_corpus, accumulator);
+    return;
+  }
+
   MT19937 eng;
   if (test_corpus != nullptr) {
     std::vector<int> indices(test_corpus->size());
@@ -505,13 +544,7 @@ void PypDpModel<ParseModel, ParsedWeights>::evaluate(
           objective += parse.weight();
 
           // Write output to CoNLL-formatted file.
-          for (unsigned i = 1; i < parse.size(); ++i) {
-            outs << i << "\t" << dict_->lookup(parse.word_at(i)) << "\t_\t_\t"
-                 << dict_->lookupTag(parse.tag_at(i)) << "\t_\t"
-                 << parse.arc_at(i) << "\t"
-                 << dict_->lookupLabel(parse.label_at(i)) << "\t_\t_\n";
-          }
-          outs << "\n";
+          writeConll(parse, outs);
         }
 
         accumulator += objective;
@@ -531,6 +564,76 @@ void PypDpModel<ParseModel, ParsedWeights>::evaluate(
   }
 }
 
+template <class ParseModel, class ParsedWeights>
+void PypDpModel<ParseModel, ParsedWeights>::parallelEvaluate(
+    const boost::shared_ptr<ParsedCorpus>& test_corpus,
+    Real& accumulator) const {
+  for (unsigned beam_size : config_->beam_sizes) {
+    std::cerr << "parsing with beam size " << beam_size << " on "
+              << config_->threads << " threads:\n";
+    accumulator = 0;
+    auto beam_start = get_time();
+    boost::shared_ptr<AccuracyCounts> acc_counts =
+        boost::make_shared<AccuracyCounts>(dict_);
+    std::vector<std::string> decoded_sentences(test_corpus->size());
+
+    #pragma omp parallel num_threads(config_->threads)
+    {
+      Real objective = 0;
+      boost::shared_ptr<AccuracyCounts> thread_acc_counts =
+          boost::make_shared<AccuracyCounts>(dict_);
+
+      // Sentence lengths vary a lot, so sentences are handed out one at a
+      // time.
+      #pragma omp for schedule(dynamic)
+      for (size_t j = 0; j < test_corpus->size(); ++j) {
+        Parser parse = parse_model_->evaluateSentence(
+            test_corpus->sentence_at(j), weights_, thread_acc_counts, true,
+            beam_size);
+        objective += parse.weight();
+
+        std::ostringstream out;
+        writeConll(parse, out);
+        decoded_sentences[j] = out.str();
+      }
+
+      #pragma omp critical
+      {
+        accumulator += objective;
+        acc_counts->merge(*thread_acc_counts);
+      }
+    }
+
+    // The sentences are written in the order of the test corpus.
+    std::ofstream outs;
+    outs.open(config_->test_output_file);
+    for (const std::string& sentence : decoded_sentences) {
+      outs << sentence;
+    }
+    outs.close();
+
+    Real beam_time = get_duration(beam_start, get_time());
+    Real sents_per_sec = static_cast<int>(test_corpus->size()) / beam_time;
+    Real tokens_per_sec =
+        static_cast<int>(test_corpus->numTokens()) / beam_time;
+    std::cerr << "(" << beam_time << "s, " << static_cast<int>(sents_per_sec)
+              << " sentences per second, " << static_cast<int>(tokens_per_sec)
+              << " tokens per second)\n";
+    acc_counts->printAccuracy();
+  }
+}
+
+template <class ParseModel, class ParsedWeights>
+void PypDpModel<ParseModel, ParsedWeights>::writeConll(
+    const Parser& parse, std::ostream& out) const {
+  for (unsigned i = 1; i < parse.size(); ++i) {
+    out << i << "\t" << dict_->lookup(parse.word_at(i)) << "\t_\t_\t"
+        << dict_->lookupTag(parse.tag_at(i)) << "\t_\t" << parse.arc_at(i)
+        << "\t" << dict_->lookupLabel(parse.label_at(i)) << "\t_\t_\n";
+  }
+  out << "\n";
+}
+
 template class PypDpModel<
     ArcStandardLabelledParseModel<
         ParsedLexPypWeights<wordLMOrderAS, tagLMOrderAS, actionLMOrderAS>>,
@@ -44,6 +44,24 @@ class PypDpModel {
                 Real& accumulator) const;
 
  private:
+  // Calls extract(j, eng) for the sentences j of a minibatch. With more than
+  // one thread the sentences are sampled in parallel against the weights as
+  // they are after the old examples of the minibatch were removed, which are
+  // only read until the new examples are inserted (as in approximate
+  // distributed LDA). Every sentence then gets its own engine, seeded from
+  // eng and the sentence index, so the samples do not depend on the thread
+  // schedule.
+  template <class Extract>
+  void extractMinibatch(const std::vector<int>& minibatch, MT19937& eng,
+                        const Extract& extract) const;
+
+  // Decodes the sentences on config->threads threads. Scoring the PYP models
+  // is read-only, so the threads share the weights.
+  void parallelEvaluate(const boost::shared_ptr<ParsedCorpus>& test_corpus,
+                        Real& accumulator) const;
+
+  void writeConll(const Parser& parse, std::ostream& out) const;
+
   boost::shared_ptr<ModelConfig> config_;
   boost::shared_ptr<Dict> dict_;
   boost::shared_ptr<ParsedWeights> weights_;
@@ -100,7 +100,9 @@ int main(int argc, char** argv) {
      ("model-out,m", value<std::string>(),
         "base filename of model output files")
      ("threads", value<int>()->default_value(1),
-        "number of worker threads.");
+        "number of worker threads.")
+     ("parallel-decoding", value<bool>()->default_value(false),
+        "Decode test sentences in parallel over all worker threads.");
   options_description config_options, cmdline_options;
   config_options.add(generic);
   cmdline_options.add(generic).add(cmdline_specific);
@@ -180,6 +182,8 @@ int main(int argc, char** argv) {
   config->max_beam_increment = vm["max-beam-increment"].as<int>();
   config->generate_samples = vm["generate-samples"].as<int>();
   config->complete_parse = vm["complete-parse"].as<bool>();
+  config->threads = vm["threads"].as<int>();
+  config->parallel_decoding = vm["parallel-decoding"].as<bool>();
 
   config->beam_sizes = {static_cast<unsigned>(vm["max-beam-size"].as<int>())};
 
@@ -214,6 +218,9 @@ int main(int argc, char** argv) {
   std::cerr << "# iterations = " << config->iterations << std::endl;
   std::cerr << "# iterations unsup = " << config->iterations_unsup << std::endl;
   std::cerr << "# randomise = " << config->randomise << std::endl;
+  std::cerr << "# threads = " << config->threads << std::endl;
+  std::cerr << "# parallel decoding = " << config->parallel_decoding
+            << std::endl;
 
   std::cerr << "################################" << std::endl;
 
@@ -39,6 +39,12 @@ void train_dp(const boost::shared_ptr<ModelConfig>& config) {
     boost::shared_ptr<ModelConfig> model_config = model.getConfig();
     model_config->model_input_file = config->model_input_file;
     model_config->context_type = config->context_type;
+    model_config->parallel_decoding = config->parallel_decoding;
+    model_config->cache_size = config->cache_size;
+    model_config->cache_examples = config->cache_examples;
+    model_config->shared_noise = config->shared_noise;
+    model_config->extraction_threads = config->extraction_threads;
+    model_config->asynchronous = config->asynchronous;
     assert(*config == *model_config);
     model.learn();
   }
@@ -83,6 +89,10 @@ int main(int argc, char** argv) {
      ("representation-size", value<int>()->default_value(256),
                                            "Width of representation vectors.")
      ("threads", value<int>()->default_value(1), "number of worker threads.")
+     ("asynchronous", value<bool>()->default_value(false),
+        "Apply the updates of every thread to the shared weights without "
+        "synchronizing after each minibatch (Hogwild). The normalizer cache "
+        "is cleared after every update.")
      ("step-size", value<float>()->default_value(0.05),
         "SGD batch stepsize, it is normalised by the number of minibatches.")
      ("randomise", value<bool>()->default_value(true),
@@ -97,6 +107,11 @@ int main(int argc, char** argv) {
                              "Predict POS in model.")
      ("sample-decoding", value<bool>()->default_value(false),
                              "Particle filter sampling during decoding.")
+     ("parallel-decoding", value<bool>()->default_value(false),
+        "Decode test sentences in parallel over all worker threads.")
+     ("cache-size", value<int>()->default_value(0),
+        "Maximum number of cached normalizers and distributions per thread "
+        "during decoding. If zero, predictions are not cached.")
      ("tag-pos", value<bool>()->default_value(false),
         "Tag POS during decoding.")
      ("lexicalised", value<bool>()->default_value(true),
@@ -127,6 +142,15 @@ int main(int argc, char** argv) {
         "Enforce complete tree-structured parse.")
      ("bootstrap", value<bool>()->default_value(false),
         "Extract training data with beam search.")
+     ("cache-examples", value<bool>()->default_value(true),
+        "Keep the static oracle training examples in memory across "
+        "iterations.")
+     ("extraction-threads", value<int>()->default_value(0),
+        "Number of background threads extracting the training examples of "
+        "the next minibatch while the current one is trained on. If zero, "
+        "the training threads extract their own examples. Only used for the "
+        "static oracle; iterations which decode extract on the training "
+        "threads.")
      ("bootstrap-iter", value<int>()->default_value(0),
         "Number of supervised iterations before unsupervised training.")
      ("num-particles", value<int>()->default_value(1000),
@@ -148,6 +172,10 @@ int main(int argc, char** argv) {
      ("noise-samples", value<int>()->default_value(0),
         "Number of noise samples for noise contrastive estimation. "
         "If zero, minibatch gradient descent is used instead.")
+     ("shared-noise", value<bool>()->default_value(false),
+        "Sample the noise once for all the examples of a task (with the same "
+        "word class, for word noise), so that it is scored with one matrix "
+        "product.")
      ("classes", value<int>()->default_value(100),
         "Number of classes for factored output using frequency binning.")
      ("class-file", value<string>()->default_value(""),
@@ -258,6 +286,8 @@ int main(int argc, char** argv) {
   config->tag_pos = vm["tag-pos"].as<bool>();
   config->predict_pos = vm["predict-pos"].as<bool>();
   config->sample_decoding = vm["sample-decoding"].as<bool>();
+  config->parallel_decoding = vm["parallel-decoding"].as<bool>();
+  config->cache_size = vm["cache-size"].as<int>();
 
   std::string activation_str = vm["activation"].as<std::string>();
   if (activation_str == "linear") {
@@ -285,6 +315,8 @@ int main(int argc, char** argv) {
   config->complete_parse = vm["complete-parse"].as<bool>();
   config->bootstrap = vm["bootstrap"].as<bool>();
   config->bootstrap_iter = vm["bootstrap-iter"].as<int>();
+  config->cache_examples = vm["cache-examples"].as<bool>();
+  config->extraction_threads = vm["extraction-threads"].as<int>();
   config->num_particles = vm["num-particles"].as<int>();
   config->max_beam_increment = vm["max-beam-increment"].as<int>();
   config->generate_samples = vm["generate-samples"].as<int>();
@@ -296,12 +328,14 @@ int main(int argc, char** argv) {
   config->l2_lbl = vm["lambda-lbl"].as<float>();
   config->representation_size = vm["representation-size"].as<int>();
   config->threads = vm["threads"].as<int>();
+  config->asynchronous = vm["asynchronous"].as<bool>();
   config->step_size = vm["step-size"].as<float>();
   config->randomise = vm["randomise"].as<bool>();
   config->diagonal_contexts = vm["diagonal-contexts"].as<bool>();
   config->factored = vm["class-factored"].as<bool>();
 
   config->noise_samples = vm["noise-samples"].as<int>();
+  config->shared_noise = vm["shared-noise"].as<bool>();
 
   config->classes = vm["classes"].as<int>();
   if (vm.count("class-file")) {
@@ -333,6 +367,9 @@ int main(int argc, char** argv) {
   std::cerr << "# root first = " << config->root_first << std::endl;
   std::cerr << "# bootstrap = " << config->bootstrap << std::endl;
   std::cerr << "# bootstrap iter = " << config->bootstrap_iter << std::endl;
+  std::cerr << "# cache examples = " << config->cache_examples << std::endl;
+  std::cerr << "# extraction threads = " << config->extraction_threads
+            << std::endl;
   std::cerr << "# complete parse = " << config->complete_parse << std::endl;
   std::cerr << "# direction deterministic = " << config->direction_deterministic
             << std::endl;
@@ -353,10 +390,15 @@ int main(int argc, char** argv) {
   std::cerr << "# step size = " << config->step_size << std::endl;
   std::cerr << "# iterations = " << config->iterations << std::endl;
   std::cerr << "# threads = " << config->threads << std::endl;
+  std::cerr << "# asynchronous = " << config->asynchronous << std::endl;
+  std::cerr << "# parallel decoding = " << config->parallel_decoding
+            << std::endl;
+  std::cerr << "# cache size = " << config->cache_size << std::endl;
   std::cerr << "# randomise = " << config->randomise << std::endl;
   std::cerr << "# diagonal contexts = " << config->diagonal_contexts
             << std::endl;
   std::cerr << "# noise samples = " << config->noise_samples << std::endl;
+  std::cerr << "# shared noise = " << config->shared_noise << std::endl;
   std::cerr << "################################" << std::endl;
 
   if (config->parser_type == ParserType::ngram) {
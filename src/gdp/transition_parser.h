@@ -1,6 +1,8 @@
 #ifndef _GDP_TR_PARSER_H_
 #define _GDP_TR_PARSER_H_
 
+#include <algorithm>
+#include <array>
 #include <string>
 
 #include <boost/shared_ptr.hpp>
@@ -8,6 +10,7 @@
 
 #include "utils/random.h"
 #include "corpus/dict.h"
+#include "corpus/flat_context.h"
 #include "corpus/model_config.h"
 #include "corpus/parse_data_set.h"
 #include "gdp/utils.h"
@@ -87,9 +90,9 @@ class TransitionParser : public Parser {
 
   WordIndex stack_top() const { return stack_.back(); }
 
-  WordIndex stack_top_second() const { return stack_.rbegin()[1]; }
+  WordIndex stack_top_second() const { return stack_[stack_.size() - 2]; }
 
-  WordIndex stack_top_third() const { return stack_.rbegin()[2]; }
+  WordIndex stack_top_third() const { return stack_[stack_.size() - 3]; }
 
   WordIndex buffer_next() const {
     if (!root_first() && (buffer_next_ == static_cast<int>(size()))) {
@@ -112,7 +115,10 @@ class TransitionParser : public Parser {
 
   WordId next_tag() const { return tag_at(buffer_next()); }
 
-  ActList actions() const { return actions_; }
+  // Tag feature of the next word, added to the context when predicting it.
+  WordId next_tag_feature() const { return features_at(buffer_next())[0]; }
+
+  ActList actions() const { return actions_.to_vector(); }
 
   kAction last_action() const { return actions_.back(); }
 
@@ -177,7 +183,7 @@ class TransitionParser : public Parser {
     return config_->getWordFeatures(w)[0];
   }
 
-  std::string context_type() const { return config_->context_type; }
+  const std::string& context_type() const { return config_->context_type; }
 
   WordId convert_action(kAction a, WordId l) const {
     if (a == kAction::sh)
@@ -198,56 +204,84 @@ class TransitionParser : public Parser {
 
   // Maps a list of indices to word and feature values.
   Context map_context(Indices ind) const {
-    Words words;
-    WordsList features;
-    for (auto i : ind) {
+    FlatContext context;
+    map_context(ind, context);
+    return context.toContext();
+  }
+
+  // Maps a list of indices to word and feature values, writing them into a
+  // reused flat context.
+  void map_context(const Indices& ind, FlatContext& context) const {
+    map_context(ind.data(), ind.size(), context);
+  }
+
+  // Maps the N positions filled in by a context template, held in a stack
+  // buffer, to word and feature values. Every template declares its size
+  // beside it, so the buffer type always matches the template.
+  template <size_t N,
+            void (TransitionParser::*Positions)(std::array<WordIndex, N>&)
+                const>
+  void map_context(FlatContext& context) const {
+    std::array<WordIndex, N> ind;
+    ind.fill(-1);
+    (this->*Positions)(ind);
+    map_context(ind.data(), N, context);
+  }
+
+  void map_context(const WordIndex* ind, size_t size,
+                   FlatContext& context) const {
+    context.clear();
+    for (size_t k = 0; k < size; ++k) {
+      WordIndex i = ind[k];
       if (i >= 0) {
         if (config_->lexicalised) {
-          words.push_back(word_at(i));
+          context.addWord(word_at(i));
         } else {
-          words.push_back(tag_at(i));
+          context.addWord(tag_at(i));
+        }
+        for (WordId feat : features_at(i)) {
+          context.addFeature(feat);
         }
-        Words feats(features_at(i));
 
         if (config_->label_features) {
-          feats.push_back(config_->label_feature_index + label_at(i));
+          context.addFeature(config_->label_feature_index + label_at(i));
         }
 
         if (config_->distance_features) {
           size_t range = config_->distance_range;
           // Left, right valency.
-          feats.push_back(config_->distance_feature_index +
-                          std::min(range - 1, left_child_count_at(i)));
-          feats.push_back(config_->distance_feature_index + range +
-                          std::min(range - 1, right_child_count_at(i)));
+          context.addFeature(config_->distance_feature_index +
+                             std::min(range - 1, left_child_count_at(i)));
+          context.addFeature(config_->distance_feature_index + range +
+                             std::min(range - 1, right_child_count_at(i)));
           // Distance to buffer_next.
-          feats.push_back(config_->distance_feature_index + 2 * range - 1 +
-                          std::min((int)(range), buffer_next_ - i));
+          context.addFeature(config_->distance_feature_index + 2 * range - 1 +
+                             std::min((int)(range), buffer_next_ - i));
           // Distance to head.
           if (arc_at(i) >= 0) {
-            feats.push_back(config_->distance_feature_index + 3 * range - 1 +
-                            std::min((int)(range), std::abs(arc_at(i) - i)));
+            context.addFeature(
+                config_->distance_feature_index + 3 * range - 1 +
+                std::min((int)(range), std::abs(arc_at(i) - i)));
           }
         }
-
-        features.push_back(feats);
       } else {
         // Ensure that the number of context elements stays consistent.
-        words.push_back(0);
+        context.addWord(0);
+        context.addFeature(0);
         if (config_->lexicalised && config_->predict_pos) {
-          features.push_back(Words(2, 0));
-        } else {
-          features.push_back(Words(1, 0));
+          context.addFeature(0);
         }
       }
+      context.endPosition();
     }
 
-    if (config_->predict_pos) features.push_back(Words());
-    return Context(words, features);
+    if (config_->predict_pos) context.endPosition();
   }
 
   //TODO Remove some unnecessary functions here.
-  /* Functions for extracting context vectors.  */
+  /* Functions for extracting context vectors. The functions filling in
+   * positions expect a buffer of -1 entries, of the size given in the
+   * context templates.  */
 
   Context stack_action_context() const {
     WordsList features;
@@ -403,8 +437,9 @@ class TransitionParser : public Parser {
     return ctx;
   }
 
-  Indices children_lookahead_context() const {
-    Indices ctx(9, -1);
+  static const size_t kChildrenLookaheadContextSize = 9;
+  void children_lookahead_context(
+      std::array<WordIndex, kChildrenLookaheadContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -419,12 +454,11 @@ class TransitionParser : public Parser {
     if (buffer_next() < size()) ctx[6] = buffer_next();
     if (buffer_next() + 1 < size()) ctx[7] = buffer_next() + 1;
     if (buffer_next() + 2 < size()) ctx[8] = buffer_next() + 2;
-
-    return ctx;
   }
 
-  Indices children_context() const {
-    Indices ctx(6, -1);
+  static const size_t kChildrenContextSize = 6;
+  void children_context(
+      std::array<WordIndex, kChildrenContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -435,12 +469,11 @@ class TransitionParser : public Parser {
       ctx[4] = rightmost_child_at(stack_.at(stack_.size() - 2));
       ctx[5] = leftmost_child_at(stack_.at(stack_.size() - 2));
     }
-
-    return ctx;
   }
 
-  Indices third_children_context() const {
-    Indices ctx(9, -1);
+  static const size_t kThirdChildrenContextSize = 9;
+  void third_children_context(
+      std::array<WordIndex, kThirdChildrenContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -456,12 +489,11 @@ class TransitionParser : public Parser {
       ctx[4] = rightmost_child_at(stack_.at(stack_.size() - 3));
       ctx[5] = leftmost_child_at(stack_.at(stack_.size() - 3));
     }
-
-    return ctx;
   }
 
-  Indices children_ngram_context() const {
-    Indices ctx(9, -1);
+  static const size_t kChildrenNgramContextSize = 9;
+  void children_ngram_context(
+      std::array<WordIndex, kChildrenNgramContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -478,12 +510,11 @@ class TransitionParser : public Parser {
       ctx[6] = buffer_next_ - 1;
     if (buffer_next_ >= 2) ctx[7] = buffer_next_ - 2;
     if (buffer_next_ >= 3) ctx[8] = buffer_next_ - 3;
-
-    return ctx;
   }
 
-  Indices extended_children_context() const {
-    Indices ctx(12, -1);
+  static const size_t kExtendedChildrenContextSize = 12;
+  void extended_children_context(
+      std::array<WordIndex, kExtendedChildrenContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -505,12 +536,11 @@ class TransitionParser : public Parser {
     if (stack_.size() >= 4) {
       ctx[11] = stack_.at(stack_.size() - 4);
     }
-
-    return ctx;
   }
 
-  Indices third_extended_children_context() const {
-    Indices ctx(17, -1);
+  static const size_t kThirdExtendedChildrenContextSize = 17;
+  void third_extended_children_context(
+      std::array<WordIndex, kThirdExtendedChildrenContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -539,12 +569,11 @@ class TransitionParser : public Parser {
     if (stack_.size() >= 5) {
       ctx[16] = stack_.at(stack_.size() - 5);
     }
-
-    return ctx;
   }
 
-  Indices extended_children_ngram_context() const {
-    Indices ctx(15, -1);
+  static const size_t kExtendedChildrenNgramContextSize = 15;
+  void extended_children_ngram_context(
+      std::array<WordIndex, kExtendedChildrenNgramContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -573,12 +602,11 @@ class TransitionParser : public Parser {
       ctx[12] = buffer_next_ - 1;
     if (buffer_next_ >= 2) ctx[13] = buffer_next_ - 2;
     if (buffer_next_ >= 3) ctx[14] = buffer_next_ - 3;
-
-    return ctx;
   }
 
-  Indices extended_children_lookahead_context() const {
-    Indices ctx(15, -1);
+  static const size_t kExtendedChildrenLookaheadContextSize = 15;
+  void extended_children_lookahead_context(
+      std::array<WordIndex, kExtendedChildrenLookaheadContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -604,12 +632,11 @@ class TransitionParser : public Parser {
     if (buffer_next() < size()) ctx[12] = buffer_next();
     if (buffer_next() + 1 < size()) ctx[13] = buffer_next() + 1;
     if (buffer_next() + 2 < size()) ctx[14] = buffer_next() + 2;
-
-    return ctx;
   }
 
-  Indices more_extended_children_ngram_context() const {
-    Indices ctx(20, -1);
+  static const size_t kMoreExtendedChildrenNgramContextSize = 20;
+  void more_extended_children_ngram_context(
+      std::array<WordIndex, kMoreExtendedChildrenNgramContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -642,12 +669,11 @@ class TransitionParser : public Parser {
       ctx[17] = buffer_next_ - 1;
     if (buffer_next_ >= 2) ctx[18] = buffer_next_ - 2;
     if (buffer_next_ >= 3) ctx[19] = buffer_next_ - 3;
-
-    return ctx;
   }
 
-  Indices more_extended_children_context() const {
-    Indices ctx(16, -1);
+  static const size_t kMoreExtendedChildrenContextSize = 16;
+  void more_extended_children_context(
+      std::array<WordIndex, kMoreExtendedChildrenContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -673,12 +699,11 @@ class TransitionParser : public Parser {
     if (stack_.size() >= 4) {
       ctx[15] = stack_.at(stack_.size() - 4);
     }
-
-    return ctx;
   }
 
-  Indices third_more_extended_children_context() const {
-    Indices ctx(23, -1);
+  static const size_t kThirdMoreExtendedChildrenContextSize = 23;
+  void third_more_extended_children_context(
+      std::array<WordIndex, kThirdMoreExtendedChildrenContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       ctx[1] = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -713,8 +738,6 @@ class TransitionParser : public Parser {
     if (stack_.size() >= 5) {
       ctx[22] = stack_.at(stack_.size() - 5);
     }
-
-    return ctx;
   }
 
   Words tag_children_third_context() const {
@@ -835,9 +858,9 @@ class TransitionParser : public Parser {
     return ctx;
   }
 
-  Indices next_children_context() const {
-    Indices ctx(8, -1);
-
+  static const size_t kNextChildrenContextSize = 8;
+  void next_children_context(
+      std::array<WordIndex, kNextChildrenContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       WordIndex r1 = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -854,13 +877,11 @@ class TransitionParser : public Parser {
       ctx[6] = leftmost_child_at(buffer_next());
       ctx[7] = second_leftmost_child_at(buffer_next());
     }
-
-    return ctx;
   }
 
-  Indices next_children_lookahead_context() const {
-    Indices ctx(11, -1);
-
+  static const size_t kNextChildrenLookaheadContextSize = 11;
+  void next_children_lookahead_context(
+      std::array<WordIndex, kNextChildrenLookaheadContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       WordIndex r1 = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -881,13 +902,11 @@ class TransitionParser : public Parser {
     if (buffer_next() < size()) ctx[8] = buffer_next();
     if (buffer_next() + 1 < size()) ctx[9] = buffer_next() + 1;
     if (buffer_next() + 2 < size()) ctx[10] = buffer_next() + 2;
-
-    return ctx;
   }
 
-  Indices extended_next_children_context() const {
-    Indices ctx(13, -1);
-
+  static const size_t kExtendedNextChildrenContextSize = 13;
+  void extended_next_children_context(
+      std::array<WordIndex, kExtendedNextChildrenContextSize>& ctx) const {
     if (stack_.size() >= 1) {
       ctx[0] = stack_.at(stack_.size() - 1);
       WordIndex r1 = rightmost_child_at(stack_.at(stack_.size() - 1));
@@ -912,8 +931,6 @@ class TransitionParser : public Parser {
     if (stack_.size() >= 3) {
       ctx[12] = stack_.at(stack_.size() - 3);
     }
-
-    return ctx;
   }
 
   Words tag_next_children_context() const {
@@ -994,10 +1011,10 @@ class TransitionParser : public Parser {
   }
 
  private:
-  Indices stack_;
+  CowVector<WordIndex> stack_;
   WordIndex buffer_next_;
-  ActList actions_;
-  Words action_labels_;
+  CowVector<kAction> actions_;
+  CowVector<WordId> action_labels_;
   Real importance_weight_;
   Real beam_weight_;
   Real marginal_weight_;
@@ -0,0 +1,55 @@
+#include "lbl/alias_sampler.h"
+
+#include <numeric>
+
+namespace oxlm {
+
+AliasSampler::AliasSampler() {}
+
+AliasSampler::AliasSampler(const Real* begin, const Real* end)
+    : thresholds(begin, end), aliases(end - begin) {
+  int size = thresholds.size();
+  double total = accumulate(thresholds.begin(), thresholds.end(), 0.0);
+
+  // Vose's algorithm: pair every bucket holding less than the average mass
+  // with a bucket holding more.
+  vector<int> small, large;
+  for (int i = 0; i < size; ++i) {
+    thresholds[i] *= size / total;
+    aliases[i] = i;
+    if (thresholds[i] < 1) {
+      small.push_back(i);
+    } else {
+      large.push_back(i);
+    }
+  }
+
+  while (!small.empty() && !large.empty()) {
+    int less = small.back(), more = large.back();
+    small.pop_back();
+
+    aliases[less] = more;
+    thresholds[more] -= 1 - thresholds[less];
+    if (thresholds[more] < 1) {
+      large.pop_back();
+      small.push_back(more);
+    }
+  }
+
+  // The remaining buckets are full, up to rounding errors.
+  for (int i : small) {
+    thresholds[i] = 1;
+  }
+  for (int i : large) {
+    thresholds[i] = 1;
+  }
+}
+
+int AliasSampler::sample(mt19937& gen) const {
+  uniform_int_distribution<int> bucket(0, thresholds.size() - 1);
+  uniform_real_distribution<double> coin(0, 1);
+  int i = bucket(gen);
+  return coin(gen) < thresholds[i] ? i : aliases[i];
+}
+
+}  // namespace oxlm
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <random>
+#include <vector>
+
+#include "lbl/utils.h"
+
+using namespace std;
+
+namespace oxlm {
+
+/**
+ * Samples from a discrete distribution in constant time using Walker's alias
+ * method. Every outcome owns a bucket with a threshold, and the rest of the
+ * bucket's probability mass is redirected to a single alias outcome.
+ */
+class AliasSampler {
+ public:
+  AliasSampler();
+
+  // The weights need not be normalized.
+  AliasSampler(const Real* begin, const Real* end);
+
+  int sample(mt19937& gen) const;
+
+ private:
+  vector<double> thresholds;
+  vector<int> aliases;
+};
+
+}  // namespace oxlm
@@ -6,6 +6,6 @@ ClassDistribution::ClassDistribution(const VectorReal& class_unigram)
     : gen(0),
       dist(class_unigram.data(), class_unigram.data() + class_unigram.size()) {}
 
-int ClassDistribution::sample() { return dist(gen); }
+int ClassDistribution::sample() { return dist.sample(gen); }
 
 }  // namespace oxlm
@@ -2,6 +2,7 @@
 
 #include <random>
 
+#include "lbl/alias_sampler.h"
 #include "lbl/utils.h"
 
 using namespace std;
@@ -16,7 +17,7 @@ class ClassDistribution {
 
  private:
   mt19937 gen;
-  discrete_distribution<int> dist;
+  AliasSampler dist;
 };
 
 }  // namespace oxlm
@@ -2,30 +2,34 @@
 
 namespace oxlm {
 
-pair<Real, bool> ContextCache::get(const vector<int>& context) {
-  if (!cache.get()) {
-    cache.reset(new ContextMap());
+vector<int> contextKey(const Context& context) {
+  vector<int> key;
+  for (const auto& features : context.features) {
+    key.push_back(features.size());
+    key.insert(key.end(), features.begin(), features.end());
   }
 
-  auto it = cache->find(context);
-  if (it == cache->end()) {
-    return make_pair(0, false);
-  } else {
-    return make_pair(it->second, true);
-  }
+  return key;
 }
 
-void ContextCache::set(const vector<int>& context, Real value) {
-  assert(cache.get());
-  cache->insert(make_pair(context, value));
+vector<int> contextKey(const FlatContext& context) {
+  vector<int> key;
+  for (size_t i = 0; i < context.size(); ++i) {
+    key.push_back(context.size(i));
+    key.insert(key.end(), context.begin(i), context.end(i));
+  }
+
+  return key;
 }
 
-void ContextCache::clear() {
-  if (!cache.get()) {
-    cache.reset(new ContextMap());
+void extendContextKey(vector<int>& key, int feature) {
+  size_t last = 0;
+  for (size_t i = 0; i < key.size(); i += key[i] + 1) {
+    last = i;
   }
 
-  cache->clear();
+  ++key[last];
+  key.push_back(feature);
 }
 
 } // namespace oxlm
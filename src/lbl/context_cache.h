@@ -1,34 +1,106 @@
 #pragma once
 
+#include <atomic>
 #include <unordered_map>
 #include <vector>
 
 #include <boost/functional/hash.hpp>
 #include <boost/thread/tss.hpp>
 
+#include "corpus/context.h"
+#include "corpus/flat_context.h"
 #include "lbl/utils.h"
 
 using namespace std;
 
 namespace oxlm {
 
-typedef unordered_map<vector<int>, Real, boost::hash<vector<int>>> ContextMap;
+// Flattens the feature vectors of a context into a cache key.
+vector<int> contextKey(const Context& context);
+
+vector<int> contextKey(const FlatContext& context);
+
+// Appends a feature to the last position of a context key.
+void extendContextKey(vector<int>& key, int feature);
 
 /**
- * Thread safe cache mapping contexts to normalizers.
+ * Thread safe cache mapping contexts to normalizers or to full distributions.
  *
+ * Every thread fills its own map, so lookups need no locking. A thread's map
+ * is flushed when it holds capacity entries. Clearing the cache invalidates
+ * the maps of all threads, which is needed whenever the weights change.
  * Thread safety is required by moses.
  */
+template <class Value>
 class ContextCache {
+  typedef unordered_map<vector<int>, Value, boost::hash<vector<int>>> ContextMap;
+
+  struct ThreadCache {
+    ThreadCache() : generation(0) {}
+
+    size_t generation;
+    ContextMap values;
+  };
+
  public:
-  pair<Real, bool> get(const vector<int>& context);
+  ContextCache() : generation(0), hits(0), misses(0) {}
+
+  bool get(const vector<int>& context, Value& value) {
+    ContextMap& values = getMap();
+    auto it = values.find(context);
+    if (it == values.end()) {
+      misses.fetch_add(1, memory_order_relaxed);
+      return false;
+    }
+
+    hits.fetch_add(1, memory_order_relaxed);
+    value = it->second;
+    return true;
+  }
 
-  void set(const vector<int>& context, Real value);
+  void set(const vector<int>& context, const Value& value, size_t capacity) {
+    ContextMap& values = getMap();
+    if (values.size() >= capacity) {
+      values.clear();
+    }
+    values.insert(make_pair(context, value));
+  }
 
-  void clear();
+  void clear() {
+    generation.fetch_add(1, memory_order_relaxed);
+  }
+
+  size_t numHits() const { return hits.load(memory_order_relaxed); }
+
+  size_t numMisses() const { return misses.load(memory_order_relaxed); }
+
+  Real hitRate() const {
+    size_t total = numHits() + numMisses();
+    return total > 0 ? static_cast<Real>(numHits()) / total : 0;
+  }
 
  private:
-  boost::thread_specific_ptr<ContextMap> cache;
+  ContextMap& getMap() {
+    if (!cache.get()) {
+      cache.reset(new ThreadCache());
+    }
+
+    size_t current = generation.load(memory_order_relaxed);
+    if (cache->generation != current) {
+      cache->values.clear();
+      cache->generation = current;
+    }
+
+    return cache->values;
+  }
+
+  boost::thread_specific_ptr<ThreadCache> cache;
+  atomic<size_t> generation;
+  atomic<size_t> hits;
+  atomic<size_t> misses;
 };
 
+typedef ContextCache<Real> NormalizerCache;
+typedef ContextCache<VectorReal> DistributionCache;
+
 }  // namespace oxlm
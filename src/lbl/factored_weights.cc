@@ -1,6 +1,10 @@
 #include "lbl/factored_weights.h"
 
+#include <algorithm>
 #include <iomanip>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/make_shared.hpp>
 
@@ -13,8 +17,9 @@ FactoredWeights::FactoredWeights()
 
 FactoredWeights::FactoredWeights(
     const boost::shared_ptr<ModelConfig>& config,
-    const boost::shared_ptr<FactoredMetadata>& metadata, bool init)
-    : Weights(config, metadata, init),
+    const boost::shared_ptr<FactoredMetadata>& metadata, bool init,
+    bool sparse)
+    : Weights(config, metadata, init, sparse),
       metadata(metadata),
       index(metadata->getIndex()),
       data(NULL),
@@ -144,16 +149,37 @@ void FactoredWeights::getGradient(
                   words);
 }
 
-MatrixReal FactoredWeights::classR(int class_id) const {
+Eigen::Block<const WordVectorsType> FactoredWeights::classR(
+    int class_id) const {
   int class_start = index->getClassMarker(class_id);
   int class_size = index->getClassSize(class_id);
-  return R.block(0, class_start, R.rows(), class_size);
+  const WordVectorsType& weights = R;
+  return weights.block(0, class_start, R.rows(), class_size);
 }
 
-VectorReal FactoredWeights::classB(int class_id) const {
+Eigen::VectorBlock<const WeightsType> FactoredWeights::classB(
+    int class_id) const {
   int class_start = index->getClassMarker(class_id);
   int class_size = index->getClassSize(class_id);
-  return B.segment(class_start, class_size);
+  const WeightsType& weights = B;
+  return weights.segment(class_start, class_size);
+}
+
+VectorReal FactoredWeights::getClassWordScores(
+    int class_id, const VectorReal& prediction_vector) const {
+  return getOutputScores(index->getClassMarker(class_id),
+                         index->getClassSize(class_id), prediction_vector) +
+         classB(class_id);
+}
+
+vector<vector<int>> FactoredWeights::getClassExamples(
+    const boost::shared_ptr<DataSet>& examples) const {
+  vector<vector<int>> class_examples(index->getNumClasses());
+  for (size_t i = 0; i < examples->size(); ++i) {
+    class_examples[index->getClass(examples->wordAt(i))].push_back(i);
+  }
+
+  return class_examples;
 }
 
 void FactoredWeights::getProbabilities(
@@ -162,18 +188,29 @@ void FactoredWeights::getProbabilities(
     MatrixReal& class_probs, vector<VectorReal>& word_probs) const {
   class_probs = S.transpose() * prediction_vectors +
                 T * MatrixReal::Ones(1, examples->size());
-  for (size_t i = 0; i < examples->size(); ++i) {
-    class_probs.col(i) = logSoftMax(class_probs.col(i));
-  }
-
-  for (size_t i = 0; i < examples->size(); ++i) {
-    int word_id = examples->wordAt(i);
-    int class_id = index->getClass(word_id);
+  logSoftMaxColumns(class_probs);
+
+  size_t offset = word_probs.size();
+  word_probs.resize(offset + examples->size());
+  vector<vector<int>> class_examples = getClassExamples(examples);
+  for (size_t class_id = 0; class_id < class_examples.size(); ++class_id) {
+    const vector<int>& class_indices = class_examples[class_id];
+    if (class_indices.empty()) continue;
+
+    MatrixReal class_prediction_vectors(prediction_vectors.rows(),
+                                        class_indices.size());
+    for (size_t k = 0; k < class_indices.size(); ++k) {
+      int i = class_indices[k];
+      class_prediction_vectors.col(k) = prediction_vectors.col(i);
+    }
 
-    VectorReal prediction_vector = prediction_vectors.col(i);
-    VectorReal word_scores =
-        classR(class_id).transpose() * prediction_vector + classB(class_id);
-    word_probs.push_back(logSoftMax(word_scores));
+    MatrixReal word_scores =
+        classR(class_id).transpose() * class_prediction_vectors;
+    word_scores.colwise() += classB(class_id);
+    logSoftMaxColumns(word_scores);
+    for (size_t k = 0; k < class_indices.size(); ++k) {
+      word_probs[offset + class_indices[k]] = word_scores.col(k);
+    }
   }
 }
 
@@ -183,16 +220,33 @@ MatrixReal FactoredWeights::getWeightedRepresentations(
     const vector<VectorReal>& word_probs) const {
   MatrixReal weighted_representations = S * class_probs;
 
+  vector<vector<int>> class_examples = getClassExamples(examples);
+  for (size_t class_id = 0; class_id < class_examples.size(); ++class_id) {
+    const vector<int>& class_indices = class_examples[class_id];
+    if (class_indices.empty()) continue;
+
+    MatrixReal class_word_probs(index->getClassSize(class_id),
+                                class_indices.size());
+    for (size_t k = 0; k < class_indices.size(); ++k) {
+      class_word_probs.col(k) = word_probs[class_indices[k]];
+    }
+
+    MatrixReal class_representations = classR(class_id) * class_word_probs;
+    for (size_t k = 0; k < class_indices.size(); ++k) {
+      weighted_representations.col(class_indices[k]) +=
+          class_representations.col(k);
+    }
+  }
+
   for (size_t i = 0; i < examples->size(); ++i) {
     int word_id = examples->wordAt(i);
     int class_id = index->getClass(word_id);
 
-    weighted_representations.col(i) += classR(class_id) * word_probs[i];
     weighted_representations.col(i) -= S.col(class_id) + R.col(word_id);
   }
 
-  weighted_representations.array() *=
-      activationDerivative(config->activation, prediction_vectors);
+  multiplyActivationDerivative(config->activation, prediction_vectors,
+                               weighted_representations);
 
   return weighted_representations;
 }
@@ -216,23 +270,45 @@ void FactoredWeights::getFullGradient(
 
   gradient->S += prediction_vectors * class_probs.transpose();
   gradient->T += class_probs.rowwise().sum();
-  for (size_t i = 0; i < examples->size(); ++i) {
-    int word_id = examples->wordAt(i);
-    int class_id = index->getClass(word_id);
+  getWordGradient(examples, prediction_vectors, word_probs, gradient, words);
+
+  getContextGradient(examples->size(), contexts, context_vectors,
+                     weighted_representations, gradient);
+}
+
+void FactoredWeights::getWordGradient(
+    const boost::shared_ptr<DataSet>& examples,
+    const MatrixReal& prediction_vectors, const vector<VectorReal>& word_probs,
+    const boost::shared_ptr<FactoredWeights>& gradient,
+    MinibatchWords& words) const {
+  vector<vector<int>> class_examples = getClassExamples(examples);
+  for (size_t class_id = 0; class_id < class_examples.size(); ++class_id) {
+    const vector<int>& class_indices = class_examples[class_id];
+    if (class_indices.empty()) continue;
+
     int class_start = index->getClassMarker(class_id);
     int class_size = index->getClassSize(class_id);
-
     for (int j = 0; j < class_size; ++j) {
       words.addOutputWord(class_start + j);
     }
 
-    gradient->B.segment(class_start, class_size) += word_probs[i];
-    gradient->R.block(0, class_start, gradient->R.rows(), class_size) +=
-        prediction_vectors.col(i) * word_probs[i].transpose();
-  }
+    MatrixReal class_prediction_vectors(prediction_vectors.rows(),
+                                        class_indices.size());
+    MatrixReal class_word_probs(class_size, class_indices.size());
+    for (size_t k = 0; k < class_indices.size(); ++k) {
+      int i = class_indices[k];
+      class_prediction_vectors.col(k) = prediction_vectors.col(i);
+      class_word_probs.col(k) = word_probs[i];
+    }
 
-  getContextGradient(examples->size(), contexts, context_vectors,
-                     weighted_representations, gradient);
+    gradient->B.segment(class_start, class_size) +=
+        class_word_probs.rowwise().sum();
+    MatrixReal class_gradients =
+        class_prediction_vectors * class_word_probs.transpose();
+    for (int j = 0; j < class_size; ++j) {
+      gradient->outputGradient(class_start + j) += class_gradients.col(j);
+    }
+  }
 }
 
 bool FactoredWeights::checkGradient(
@@ -260,40 +336,54 @@ bool FactoredWeights::checkGradient(
   return true;
 }
 
-vector<vector<int>> FactoredWeights::getNoiseWords(
+vector<NoiseSet> FactoredWeights::getNoiseWords(
     const boost::shared_ptr<DataSet>& examples) const {
   if (!wordDists.get()) {
     wordDists.reset(new WordDistributions(metadata->getUnigram(), index));
   }
 
-  VectorReal unigram = metadata->getUnigram();
-  vector<vector<int>> noise_words(examples->size());
+  vector<NoiseSet> noise_words;
+  vector<int> noise_classes;
+  unordered_map<int, size_t> class_noise;
   for (size_t i = 0; i < examples->size(); ++i) {
-    int word_id = examples->wordAt(i);
-    int class_id = index->getClass(word_id);
-    int class_start = index->getClassMarker(class_id);
+    int class_id = index->getClass(examples->wordAt(i));
+    size_t noise_id = noise_words.size();
+    if (config->shared_noise) {
+      noise_id =
+          class_noise.insert(make_pair(class_id, noise_id)).first->second;
+    }
 
-    auto start_sampling = get_time();
+    if (noise_id == noise_words.size()) {
+      noise_words.push_back(NoiseSet());
+      noise_classes.push_back(class_id);
+    }
+    noise_words[noise_id].examples.push_back(i);
+  }
+
+  for (size_t i = 0; i < noise_words.size(); ++i) {
     for (int j = 0; j < config->noise_samples; ++j) {
-      noise_words[i].push_back(wordDists->sample(class_id));
+      noise_words[i].samples.push_back(wordDists->sample(noise_classes[i]));
     }
   }
 
   return noise_words;
 }
 
-vector<vector<int>> FactoredWeights::getNoiseClasses(
+vector<NoiseSet> FactoredWeights::getNoiseClasses(
     size_t prediction_size) const {
   if (!classDist.get()) {
     VectorReal class_unigram = metadata->getClassBias().array().exp();
     classDist.reset(new ClassDistribution(class_unigram));
   }
 
-  vector<vector<int>> noise_classes(prediction_size);
-  auto start_sampling = get_time();
+  vector<NoiseSet> noise_classes(config->shared_noise ? 1 : prediction_size);
   for (size_t i = 0; i < prediction_size; ++i) {
+    noise_classes[config->shared_noise ? 0 : i].examples.push_back(i);
+  }
+
+  for (auto& noise : noise_classes) {
     for (int j = 0; j < config->noise_samples; ++j) {
-      noise_classes[i].push_back(classDist->sample());
+      noise.samples.push_back(classDist->sample());
     }
   }
 
@@ -312,7 +402,7 @@ void FactoredWeights::estimateProjectionGradient(
 
   int noise_samples = config->noise_samples;
   VectorReal class_unigram = metadata->getClassBias().array().exp();
-  vector<vector<int>> noise_classes = getNoiseClasses(examples->size());
+  vector<NoiseSet> noise_classes = getNoiseClasses(examples->size());
   for (size_t i = 0; i < examples->size(); ++i) {
     int word_id = examples->wordAt(i);
     int class_id = index->getClass(word_id);
@@ -329,22 +419,30 @@ void FactoredWeights::estimateProjectionGradient(
 
     gradient->S.col(class_id) -= pos_weight * prediction_vectors.col(i);
     gradient->T(class_id) -= pos_weight;
+  }
 
-    for (int j = 0; j < noise_samples; ++j) {
-      int noise_class_id = noise_classes[i][j];
-      Real log_neg_prob = S.col(noise_class_id).dot(prediction_vectors.col(i)) +
-                          T(noise_class_id);
-      Real neg_prob = exp(log_neg_prob);
-      assert(neg_prob <= numeric_limits<Real>::max());
-
-      Real neg_weight =
-          neg_prob / (neg_prob + noise_samples * class_unigram(noise_class_id));
-      weighted_representations.col(i) += neg_weight * S.col(noise_class_id);
-
-      objective -= log(1 - neg_weight);
+  for (const auto& noise : noise_classes) {
+    int num_samples = noise.samples.size();
+    MatrixReal noise_vectors(S.rows(), num_samples);
+    VectorReal noise_biases(num_samples), noise_probs(num_samples);
+    for (int j = 0; j < num_samples; ++j) {
+      int class_id = noise.samples[j];
+      noise_vectors.col(j) = S.col(class_id);
+      noise_biases(j) = T(class_id);
+      noise_probs(j) = noise_samples * class_unigram(class_id);
+    }
 
-      gradient->S.col(noise_class_id) += neg_weight * prediction_vectors.col(i);
-      gradient->T(noise_class_id) += neg_weight;
+    MatrixReal vector_gradient;
+    VectorReal bias_gradient;
+    objective += getNoiseGradient(noise, prediction_vectors, noise_vectors,
+                                  noise_biases, noise_probs,
+                                  weighted_representations, vector_gradient,
+                                  bias_gradient);
+
+    for (int j = 0; j < num_samples; ++j) {
+      int class_id = noise.samples[j];
+      gradient->S.col(class_id) += vector_gradient.col(j);
+      gradient->T(class_id) += bias_gradient(j);
     }
   }
 }
@@ -366,8 +464,8 @@ void FactoredWeights::estimateGradient(
   estimateProjectionGradient(examples, prediction_vectors, gradient,
                              weighted_representations, objective, words);
 
-  weighted_representations.array() *=
-      activationDerivative(config->activation, prediction_vectors);
+  multiplyActivationDerivative(config->activation, prediction_vectors,
+                               weighted_representations);
 
   getContextGradient(examples->size(), contexts, context_vectors,
                      weighted_representations, gradient);
@@ -438,6 +536,38 @@ Real FactoredWeights::regularizerUpdate(
   return ret;
 }
 
+void FactoredWeights::applyPendingDecay(
+    const boost::shared_ptr<DataSet>& examples) {
+  decayContextVectors(examples);
+
+  // Only the output word vectors in the classes of the examples are read,
+  // including by the noise samples.
+  unordered_set<int> classes;
+  for (size_t i = 0; i < examples->size(); ++i) {
+    classes.insert(index->getClass(examples->wordAt(i)));
+  }
+
+  for (int class_id : classes) {
+    int class_start = index->getClassMarker(class_id);
+    int class_size = index->getClassSize(class_id);
+    for (int word_id = class_start; word_id < class_start + class_size;
+         ++word_id) {
+      decayOutputVector(word_id);
+    }
+  }
+}
+
+void FactoredWeights::asyncUpdate(
+    const MinibatchWords& words,
+    const boost::shared_ptr<FactoredWeights>& gradient,
+    const boost::shared_ptr<FactoredWeights>& adagrad) {
+  Weights::asyncUpdate(words, gradient, adagrad);
+
+  adagrad->FW.array() += gradient->FW.array().square();
+  FW -= gradient->FW.binaryExpr(
+      adagrad->FW, CwiseAdagradUpdateOp<Real>(config->step_size));
+}
+
 void FactoredWeights::clear(const MinibatchWords& words, bool parallel_update) {
   Weights::clear(words, parallel_update);
 
@@ -449,74 +579,96 @@ void FactoredWeights::clear(const MinibatchWords& words, bool parallel_update) {
   }
 }
 
-Reals FactoredWeights::predictViterbi(
-    Context context) const {
-  Reals probs(vocabSize(), std::numeric_limits<Real>::max());
-  Real normalizer = 0;
-  int num_classes = config->max_beam_increment;
-  int num_words = config->max_beam_increment;
+vector<pair<int, Real>> FactoredWeights::predictTopK(
+    Context context, int k) const {
+  vector<pair<int, Real>> best;
+  if (k <= 0) {
+    return best;
+  }
+  size_t max_words = k;
 
   VectorReal prediction_vector = getPredictionVector(context);
-  VectorReal class_probs =
-      logSoftMax(S.transpose() * prediction_vector + T, normalizer);
-
-  for (int c = 0; c < num_classes; ++c) {
-    int class_ind;
-    class_probs.maxCoeff(&class_ind);
-    Real class_prob = class_probs(class_ind);
-    class_probs(class_ind) = std::numeric_limits<Real>::min();
-
-    VectorReal word_probs = logSoftMax(
-        classR(class_ind).transpose() * prediction_vector + classB(class_ind),
-        normalizer);
-    for (int cw = 0; cw < num_words; ++cw) {
-      int word_class_ind;
-      word_probs.maxCoeff(&word_class_ind);
-      Real word_prob = word_probs(word_class_ind);
-      word_probs(word_class_ind) = std::numeric_limits<Real>::min();
-
-      probs[index->getWordIndex(class_ind, word_class_ind)] =
-          -(class_prob + word_prob);
+  VectorReal class_probs = logSoftMax(S.transpose() * prediction_vector + T);
+
+  // Classes are expanded in decreasing order of probability. A heap is used
+  // so that only the classes which are actually expanded get sorted.
+  vector<int> classes(class_probs.size());
+  iota(classes.begin(), classes.end(), 0);
+  auto class_cmp = [&class_probs](int a, int b) {
+    return class_probs(a) < class_probs(b);
+  };
+  make_heap(classes.begin(), classes.end(), class_cmp);
+
+  // Min-heap holding the k most likely words found so far (log probs).
+  auto word_cmp = [](const pair<int, Real>& a, const pair<int, Real>& b) {
+    return a.second > b.second;
+  };
+
+  auto end = classes.end();
+  while (end != classes.begin()) {
+    int class_id = classes.front();
+    Real class_prob = class_probs(class_id);
+    // p(w | h) <= p(c | h) for every word w in class c, so once the best
+    // remaining class is less likely than the k-th best word, none of the
+    // remaining classes can contribute and the result is exact.
+    if (best.size() == max_words && class_prob <= best.front().second) {
+      break;
     }
+    pop_heap(classes.begin(), end, class_cmp);
+    --end;
+
+    VectorReal word_probs =
+        logSoftMax(getClassWordScores(class_id, prediction_vector));
+    for (int i = 0; i < word_probs.size(); ++i) {
+      Real prob = class_prob + word_probs(i);
+      if (best.size() < max_words) {
+        best.push_back(make_pair(index->getWordIndex(class_id, i), prob));
+        push_heap(best.begin(), best.end(), word_cmp);
+      } else if (prob > best.front().second) {
+        pop_heap(best.begin(), best.end(), word_cmp);
+        best.back() = make_pair(index->getWordIndex(class_id, i), prob);
+        push_heap(best.begin(), best.end(), word_cmp);
+      }
+    }
+  }
+
+  sort_heap(best.begin(), best.end(), word_cmp);
+  for (auto& word : best) {
+    word.second = -word.second;
+  }
+
+  return best;
+}
+
+Reals FactoredWeights::predictViterbi(Context context) const {
+  Reals probs(vocabSize(), numeric_limits<Real>::max());
+  for (const auto& word: predictTopK(context, config->max_beam_increment)) {
+    probs[word.first] = word.second;
   }
 
   return probs;
 }
 
 Real FactoredWeights::predict(int word, Context context) const {
-  Words context_words = context.words;
+  return predict(word, FlatContext(context));
+}
+
+Real FactoredWeights::predict(int word, const FlatContext& context) const {
   int class_id = index->getClass(word);
   int word_class_id = index->getWordIndexInClass(word);
   VectorReal prediction_vector = getPredictionVector(context);
 
-  Real class_prob;
-  // auto ret = normalizerCache.get(context_words);
-  // if (ret.second) {
-  //  class_prob = (S.col(class_id).dot(prediction_vector) + T(class_id) -
-  //  ret.first);
-  //} else {
-  Real normalizer = 0;
-  VectorReal class_probs =
-      logSoftMax(S.transpose() * prediction_vector + T, normalizer);
-  // normalizerCache.set(context_words, normalizer);
-  class_prob = class_probs(class_id);
-  //}
-
-  context_words.insert(context_words.begin(), class_id);
-  Real word_prob;
-  // ret = classNormalizerCache.get(context_words);
-  // if (ret.second) {
-  //  word_prob = (R.col(word).dot(prediction_vector) + B(word) - ret.first);
-  //} else {
-  // Real normalizer = 0;
-  VectorReal word_probs = logSoftMax(
-      classR(class_id).transpose() * prediction_vector + classB(class_id),
-      normalizer);
-  // classNormalizerCache.set(context_words, normalizer);
-  word_prob = word_probs(word_class_id);
-  //}
-
-  return -(class_prob + word_prob);
+  if (config->cache_size > 0) {
+    vector<int> key = contextKey(context);
+    return -(getClassLogProb(class_id, key, prediction_vector) +
+             getWordLogProb(word, key, prediction_vector));
+  }
+
+  VectorReal class_probs = logSoftMax(S.transpose() * prediction_vector + T);
+  VectorReal word_probs =
+      logSoftMax(getClassWordScores(class_id, prediction_vector));
+
+  return -(class_probs(class_id) + word_probs(word_class_id));
 }
 
 Reals FactoredWeights::predict(Context context) const {
@@ -528,11 +680,96 @@ Reals FactoredWeights::predict(Context context) const {
   return probs;
 }
 
+Reals FactoredWeights::predictBatch(const Words& words,
+                                    const FlatContextBatch& contexts) const {
+  if (words.empty()) return Reals();
+
+  HiddenLayer hidden;
+  getHiddenLayer(contexts, hidden);
+  return predictBatch(words, hidden);
+}
+
+Reals FactoredWeights::predictBatch(const Words& words,
+                                    const HiddenLayer& hidden) const {
+  Reals probs(words.size(), 0);
+  if (words.empty()) return probs;
+
+  const MatrixReal& prediction_vectors = hidden.prediction_vectors;
+
+  // Cached normalizers replace the softmax products for repeated contexts.
+  if (config->cache_size > 0) {
+    for (size_t i = 0; i < words.size(); ++i) {
+      VectorReal prediction_vector = prediction_vectors.col(i);
+      probs[i] = -(getClassLogProb(index->getClass(words[i]), hidden.keys[i],
+                                   prediction_vector) +
+                   getWordLogProb(words[i], hidden.keys[i],
+                                  prediction_vector));
+    }
+
+    return probs;
+  }
+
+  MatrixReal class_probs = S.transpose() * prediction_vectors +
+                           T * MatrixReal::Ones(1, words.size());
+  logSoftMaxColumns(class_probs);
+
+  for (size_t i = 0; i < words.size(); ++i) {
+    int class_id = index->getClass(words[i]);
+    int word_class_id = index->getWordIndexInClass(words[i]);
+
+    VectorReal prediction_vector = prediction_vectors.col(i);
+    VectorReal word_probs =
+        logSoftMax(getClassWordScores(class_id, prediction_vector));
+    probs[i] = -(class_probs(class_id, i) + word_probs(word_class_id));
+  }
+
+  return probs;
+}
+
+Real FactoredWeights::getClassLogProb(
+    int class_id, const vector<int>& key,
+    const VectorReal& prediction_vector) const {
+  Real normalizer = 0;
+  if (!classNormalizerCache.get(key, normalizer)) {
+    logSoftMax(S.transpose() * prediction_vector + T, normalizer);
+    classNormalizerCache.set(key, normalizer, config->cache_size);
+  }
+
+  return S.col(class_id).dot(prediction_vector) + T(class_id) - normalizer;
+}
+
+Real FactoredWeights::getWordLogProb(
+    int word, const vector<int>& key,
+    const VectorReal& prediction_vector) const {
+  int class_id = index->getClass(word);
+  int word_class_id = index->getWordIndexInClass(word);
+
+  // The in-class normalizer is keyed on the context and the class.
+  vector<int> class_key = key;
+  class_key.push_back(class_id);
+
+  Real normalizer = 0;
+  if (!normalizerCache.get(class_key, normalizer)) {
+    logSoftMax(getClassWordScores(class_id, prediction_vector), normalizer);
+    normalizerCache.set(class_key, normalizer, config->cache_size);
+  }
+
+  return getOutputScore(word, prediction_vector) +
+         classB(class_id)(word_class_id) - normalizer;
+}
+
 void FactoredWeights::clearCache() {
   Weights::clearCache();
   classNormalizerCache.clear();
 }
 
+void FactoredWeights::printCacheStats() const {
+  Weights::printCacheStats();
+  cerr << "Class normalizer cache: " << classNormalizerCache.numHits()
+       << " hits, " << classNormalizerCache.numMisses() << " misses, hit rate "
+       << classNormalizerCache.hitRate() << endl;
+}
+
 bool FactoredWeights::operator==(const FactoredWeights& other) const {
   return Weights::operator==(other) && *metadata == *other.metadata &&
          *index == *other.index && size == other.size && FW == other.FW;
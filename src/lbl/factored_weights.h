@@ -18,7 +18,7 @@ class FactoredWeights : public Weights {
 
   FactoredWeights(const boost::shared_ptr<ModelConfig>& config,
                   const boost::shared_ptr<FactoredMetadata>& metadata,
-                  bool init);
+                  bool init, bool sparse = false);
 
   FactoredWeights(const FactoredWeights& other);
 
@@ -53,25 +53,75 @@ class FactoredWeights : public Weights {
       const boost::shared_ptr<FactoredWeights>& global_gradient,
       Real minibatch_factor);
 
+  void applyPendingDecay(const boost::shared_ptr<DataSet>& examples);
+
+  void asyncUpdate(const MinibatchWords& words,
+                   const boost::shared_ptr<FactoredWeights>& gradient,
+                   const boost::shared_ptr<FactoredWeights>& adagrad);
+
   void clear(const MinibatchWords& words, bool parallel_update);
 
   // Computes the probabilities of only the most likely words.
   Reals predictViterbi(Context context) const;
 
+  // Returns the k most likely words with their negative log probabilities,
+  // most likely first. Classes are expanded in order of probability and the
+  // search stops once no unexpanded class can hold a word better than the
+  // current k-th best, so the result is exact while only a few within-class
+  // products are computed.
+  vector<pair<int, Real>> predictTopK(Context context, int k) const;
+
   Real predict(int word, Context context) const;
 
+  Real predict(int word, const FlatContext& context) const;
+
   Reals predict(Context context) const;
 
+  // Scores a batch of words, computing the class softmax as a single matrix
+  // product.
+  Reals predictBatch(const Words& words,
+                     const FlatContextBatch& contexts) const;
+
+  Reals predictBatch(const Words& words, const HiddenLayer& hidden) const;
+
   void clearCache();
 
+  void printCacheStats() const;
+
   bool operator==(const FactoredWeights& other) const;
 
   virtual ~FactoredWeights();
 
  protected:
-  MatrixReal classR(int class_id) const;
+  // Views of the output weights of the words in a class, without copies.
+  Eigen::Block<const WordVectorsType> classR(int class_id) const;
+
+  Eigen::VectorBlock<const WeightsType> classB(int class_id) const;
+
+  // Scores of the words in a class at test time, before the softmax.
+  VectorReal getClassWordScores(int class_id,
+                                const VectorReal& prediction_vector) const;
+
+  // Groups the indices of the examples by the class of their output word, so
+  // that the words of a class are scored with one matrix product.
+  vector<vector<int>> getClassExamples(
+      const boost::shared_ptr<DataSet>& examples) const;
+
+  // Adds the gradient of the within class softmax to R and B, with one
+  // matrix product per class.
+  void getWordGradient(const boost::shared_ptr<DataSet>& examples,
+                       const MatrixReal& prediction_vectors,
+                       const vector<VectorReal>& word_probs,
+                       const boost::shared_ptr<FactoredWeights>& gradient,
+                       MinibatchWords& words) const;
+
+  // Log probabilities of a class and of a word within its class, using the
+  // normalizers cached under the context key when available.
+  Real getClassLogProb(int class_id, const vector<int>& key,
+                       const VectorReal& prediction_vector) const;
 
-  VectorReal classB(int class_id) const;
+  Real getWordLogProb(int word, const vector<int>& key,
+                      const VectorReal& prediction_vector) const;
 
   Real getObjective(const boost::shared_ptr<DataSet>& examples,
                     vector<WordsList>& contexts,
@@ -99,10 +149,12 @@ class FactoredWeights : public Weights {
                        const boost::shared_ptr<FactoredWeights>& gradient,
                        MinibatchWords& words) const;
 
-  virtual vector<vector<int>> getNoiseWords(
+  // Noise words are sampled from the class of each example, so shared noise
+  // words are shared by the examples of the same class.
+  virtual vector<NoiseSet> getNoiseWords(
       const boost::shared_ptr<DataSet>& examples) const;
 
-  vector<vector<int>> getNoiseClasses(size_t prediction_size) const;
+  vector<NoiseSet> getNoiseClasses(size_t prediction_size) const;
 
   void estimateProjectionGradient(
       const boost::shared_ptr<DataSet>& examples,
@@ -157,7 +209,7 @@ class FactoredWeights : public Weights {
   WeightsType T;
   WeightsType FW;
 
-  mutable ContextCache classNormalizerCache;
+  mutable NormalizerCache classNormalizerCache;
 
  private:
   int size;
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include "lbl/utils.h"
+
+using namespace std;
+
+namespace oxlm {
+
+// Hidden layer computed for a batch of contexts, shared by the output layers
+// which condition on the same contexts.
+struct HiddenLayer {
+  // Sums of the transformed context representations, before the activation.
+  MatrixReal inputs;
+
+  // Activations of the hidden layer, one column per context.
+  MatrixReal prediction_vectors;
+
+  // Cache keys of the contexts, only computed if caching is enabled.
+  vector<vector<int>> keys;
+};
+
+}  // namespace oxlm
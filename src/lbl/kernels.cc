@@ -0,0 +1,492 @@
+#include "lbl/kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OXLM_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace oxlm {
+
+namespace {
+
+// Portable versions of the kernels. The vectorised versions fall back to them
+// for the elements left over after the last full register.
+
+Real scalarLogSoftMax(Real* values, size_t size) {
+  Real max = -numeric_limits<Real>::infinity();
+  for (size_t i = 0; i < size; ++i) {
+    max = std::max(max, values[i]);
+  }
+
+  Real sum = 0;
+  for (size_t i = 0; i < size; ++i) {
+    sum += exp(values[i] - max);
+  }
+
+  Real log_z = log(sum) + max;
+  for (size_t i = 0; i < size; ++i) {
+    values[i] -= log_z;
+  }
+  return log_z;
+}
+
+void scalarSigmoid(Real* values, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    values[i] = 1 / (1 + exp(-values[i]));
+  }
+}
+
+// Unlike (1 - exp(-2x)) / (1 + exp(-2x)), this form does not overflow to
+// inf / inf for large negative inputs.
+void scalarTanh(Real* values, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    values[i] = 1 - 2 / (1 + exp(2 * values[i]));
+  }
+}
+
+// The derivative loops have no reductions or transcendental functions, so the
+// compiler vectorises them for whatever instruction set they are inlined into.
+
+inline void sigmoidDerivativeLoop(const Real* activations, Real* gradient,
+                                  size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    gradient[i] *= activations[i] * (1 - activations[i]);
+  }
+}
+
+inline void tanhDerivativeLoop(const Real* activations, Real* gradient,
+                               size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    gradient[i] *= 1 - activations[i] * activations[i];
+  }
+}
+
+inline void int8Loop(const int8_t* values, Real scale, Real* out,
+                     size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    out[i] = scale * values[i];
+  }
+}
+
+Real halfToFloat(uint16_t value) {
+  uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  int exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+
+  float result;
+  if (exponent == 0) {
+    // Zero or subnormal: mantissa * 2^-24.
+    result = ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -result : result;
+  }
+
+  uint32_t bits;
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    bits = sign | static_cast<uint32_t>(exponent + 112) << 23 |
+           (mantissa << 13);
+  }
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+void scalarHalf(const uint16_t* values, Real* out, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    out[i] = halfToFloat(values[i]);
+  }
+}
+
+enum class SimdLevel { scalar, avx2, avx512 };
+
+#ifdef OXLM_X86_KERNELS
+
+static_assert(is_same<Real, float>::value,
+              "The vectorised kernels assume single precision.");
+
+// Cephes style approximation of exp: exp(x) = 2^n exp(r), where
+// n = round(x / log 2) and exp(r) is a polynomial for |r| <= log 2 / 2. The
+// relative error is below 2e-7 and the inputs are clamped to the range of the
+// normalized floats.
+const float kExpMin = -87.3365f;
+const float kExpMax = 88.3762f;
+const float kLog2E = 1.44269504f;
+const float kLn2Hi = 0.693359375f;
+const float kLn2Lo = -2.12194440e-4f;
+const float kExpPoly[] = {1.9875691500e-4f, 1.3981999507e-3f,
+                          8.3334519073e-3f, 4.1665795894e-2f,
+                          1.6666665459e-1f, 5.0000001201e-1f};
+
+__attribute__((target("avx2,fma")))
+inline __m256 exp8(__m256 x) {
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(kExpMin)),
+                    _mm256_set1_ps(kExpMax));
+  __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(kLog2E),
+                                             _mm256_set1_ps(0.5f)));
+  __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Hi), x);
+  r = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Lo), r);
+
+  __m256 y = _mm256_set1_ps(kExpPoly[0]);
+  for (int i = 1; i < 6; ++i) {
+    y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(kExpPoly[i]));
+  }
+  __m256 one = _mm256_set1_ps(1.0f);
+  y = _mm256_fmadd_ps(y, _mm256_mul_ps(r, r), _mm256_add_ps(r, one));
+
+  __m256i exponent = _mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(y, _mm256_castsi256_ps(exponent));
+}
+
+__attribute__((target("avx2,fma")))
+inline float horizontalMax8(__m256 v) {
+  alignas(32) float lanes[8];
+  _mm256_store_ps(lanes, v);
+  return *max_element(lanes, lanes + 8);
+}
+
+__attribute__((target("avx2,fma")))
+inline float horizontalSum8(__m256 v) {
+  alignas(32) float lanes[8];
+  _mm256_store_ps(lanes, v);
+  float sum = 0;
+  for (float lane : lanes) {
+    sum += lane;
+  }
+  return sum;
+}
+
+__attribute__((target("avx2,fma")))
+Real avx2LogSoftMax(Real* values, size_t size) {
+  size_t end = size - size % 8;
+  __m256 max8 = _mm256_set1_ps(-numeric_limits<Real>::infinity());
+  for (size_t i = 0; i < end; i += 8) {
+    max8 = _mm256_max_ps(max8, _mm256_loadu_ps(values + i));
+  }
+  Real max = horizontalMax8(max8);
+  for (size_t i = end; i < size; ++i) {
+    max = std::max(max, values[i]);
+  }
+
+  __m256 shift = _mm256_set1_ps(max);
+  __m256 sum8 = _mm256_setzero_ps();
+  for (size_t i = 0; i < end; i += 8) {
+    sum8 = _mm256_add_ps(
+        sum8, exp8(_mm256_sub_ps(_mm256_loadu_ps(values + i), shift)));
+  }
+  Real sum = horizontalSum8(sum8);
+  for (size_t i = end; i < size; ++i) {
+    sum += exp(values[i] - max);
+  }
+
+  Real log_z = log(sum) + max;
+  __m256 log_z8 = _mm256_set1_ps(log_z);
+  for (size_t i = 0; i < end; i += 8) {
+    _mm256_storeu_ps(values + i,
+                     _mm256_sub_ps(_mm256_loadu_ps(values + i), log_z8));
+  }
+  for (size_t i = end; i < size; ++i) {
+    values[i] -= log_z;
+  }
+  return log_z;
+}
+
+__attribute__((target("avx2,fma")))
+void avx2Sigmoid(Real* values, size_t size) {
+  size_t end = size - size % 8;
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256 zero = _mm256_setzero_ps();
+  for (size_t i = 0; i < end; i += 8) {
+    __m256 x = _mm256_loadu_ps(values + i);
+    __m256 y = _mm256_div_ps(
+        one, _mm256_add_ps(one, exp8(_mm256_sub_ps(zero, x))));
+    _mm256_storeu_ps(values + i, y);
+  }
+  scalarSigmoid(values + end, size - end);
+}
+
+__attribute__((target("avx2,fma")))
+void avx2Tanh(Real* values, size_t size) {
+  size_t end = size - size % 8;
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256 two = _mm256_set1_ps(2.0f);
+  for (size_t i = 0; i < end; i += 8) {
+    __m256 x = _mm256_loadu_ps(values + i);
+    __m256 y = _mm256_sub_ps(
+        one, _mm256_div_ps(
+                 two, _mm256_add_ps(one, exp8(_mm256_mul_ps(two, x)))));
+    _mm256_storeu_ps(values + i, y);
+  }
+  scalarTanh(values + end, size - end);
+}
+
+__attribute__((target("avx2,fma")))
+void avx2SigmoidDerivative(const Real* activations, Real* gradient,
+                           size_t size) {
+  sigmoidDerivativeLoop(activations, gradient, size);
+}
+
+__attribute__((target("avx2,fma")))
+void avx2TanhDerivative(const Real* activations, Real* gradient, size_t size) {
+  tanhDerivativeLoop(activations, gradient, size);
+}
+
+__attribute__((target("avx2,fma")))
+void avx2Int8(const int8_t* values, Real scale, Real* out, size_t size) {
+  int8Loop(values, scale, out, size);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+void avx2Half(const uint16_t* values, Real* out, size_t size) {
+  size_t end = size - size % 8;
+  for (size_t i = 0; i < end; i += 8) {
+    __m128i half8 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(half8));
+  }
+  scalarHalf(values + end, out + end, size - end);
+}
+
+__attribute__((target("avx512f")))
+inline __m512 exp16(__m512 x) {
+  x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(kExpMin)),
+                    _mm512_set1_ps(kExpMax));
+  __m512 n = _mm512_roundscale_ps(
+      _mm512_fmadd_ps(x, _mm512_set1_ps(kLog2E), _mm512_set1_ps(0.5f)),
+      _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+  __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(kLn2Hi), x);
+  r = _mm512_fnmadd_ps(n, _mm512_set1_ps(kLn2Lo), r);
+
+  __m512 y = _mm512_set1_ps(kExpPoly[0]);
+  for (int i = 1; i < 6; ++i) {
+    y = _mm512_fmadd_ps(y, r, _mm512_set1_ps(kExpPoly[i]));
+  }
+  __m512 one = _mm512_set1_ps(1.0f);
+  y = _mm512_fmadd_ps(y, _mm512_mul_ps(r, r), _mm512_add_ps(r, one));
+
+  __m512i exponent = _mm512_slli_epi32(
+      _mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23);
+  return _mm512_mul_ps(y, _mm512_castsi512_ps(exponent));
+}
+
+__attribute__((target("avx512f")))
+Real avx512LogSoftMax(Real* values, size_t size) {
+  size_t end = size - size % 16;
+  __m512 max16 = _mm512_set1_ps(-numeric_limits<Real>::infinity());
+  for (size_t i = 0; i < end; i += 16) {
+    max16 = _mm512_max_ps(max16, _mm512_loadu_ps(values + i));
+  }
+  Real max = _mm512_reduce_max_ps(max16);
+  for (size_t i = end; i < size; ++i) {
+    max = std::max(max, values[i]);
+  }
+
+  __m512 shift = _mm512_set1_ps(max);
+  __m512 sum16 = _mm512_setzero_ps();
+  for (size_t i = 0; i < end; i += 16) {
+    sum16 = _mm512_add_ps(
+        sum16, exp16(_mm512_sub_ps(_mm512_loadu_ps(values + i), shift)));
+  }
+  Real sum = _mm512_reduce_add_ps(sum16);
+  for (size_t i = end; i < size; ++i) {
+    sum += exp(values[i] - max);
+  }
+
+  Real log_z = log(sum) + max;
+  __m512 log_z16 = _mm512_set1_ps(log_z);
+  for (size_t i = 0; i < end; i += 16) {
+    _mm512_storeu_ps(values + i,
+                     _mm512_sub_ps(_mm512_loadu_ps(values + i), log_z16));
+  }
+  for (size_t i = end; i < size; ++i) {
+    values[i] -= log_z;
+  }
+  return log_z;
+}
+
+__attribute__((target("avx512f")))
+void avx512Sigmoid(Real* values, size_t size) {
+  size_t end = size - size % 16;
+  __m512 one = _mm512_set1_ps(1.0f);
+  __m512 zero = _mm512_setzero_ps();
+  for (size_t i = 0; i < end; i += 16) {
+    __m512 x = _mm512_loadu_ps(values + i);
+    __m512 y = _mm512_div_ps(
+        one, _mm512_add_ps(one, exp16(_mm512_sub_ps(zero, x))));
+    _mm512_storeu_ps(values + i, y);
+  }
+  scalarSigmoid(values + end, size - end);
+}
+
+__attribute__((target("avx512f")))
+void avx512Tanh(Real* values, size_t size) {
+  size_t end = size - size % 16;
+  __m512 one = _mm512_set1_ps(1.0f);
+  __m512 two = _mm512_set1_ps(2.0f);
+  for (size_t i = 0; i < end; i += 16) {
+    __m512 x = _mm512_loadu_ps(values + i);
+    __m512 y = _mm512_sub_ps(
+        one, _mm512_div_ps(
+                 two, _mm512_add_ps(one, exp16(_mm512_mul_ps(two, x)))));
+    _mm512_storeu_ps(values + i, y);
+  }
+  scalarTanh(values + end, size - end);
+}
+
+__attribute__((target("avx512f")))
+void avx512SigmoidDerivative(const Real* activations, Real* gradient,
+                             size_t size) {
+  sigmoidDerivativeLoop(activations, gradient, size);
+}
+
+__attribute__((target("avx512f")))
+void avx512TanhDerivative(const Real* activations, Real* gradient,
+                          size_t size) {
+  tanhDerivativeLoop(activations, gradient, size);
+}
+
+__attribute__((target("avx512f")))
+void avx512Int8(const int8_t* values, Real scale, Real* out, size_t size) {
+  int8Loop(values, scale, out, size);
+}
+
+__attribute__((target("avx512f")))
+void avx512Half(const uint16_t* values, Real* out, size_t size) {
+  size_t end = size - size % 16;
+  for (size_t i = 0; i < end; i += 16) {
+    __m256i half16 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+    _mm512_storeu_ps(out + i, _mm512_cvtph_ps(half16));
+  }
+  scalarHalf(values + end, out + end, size - end);
+}
+
+SimdLevel detectSimdLevel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return SimdLevel::avx512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+      __builtin_cpu_supports("f16c")) {
+    return SimdLevel::avx2;
+  }
+  return SimdLevel::scalar;
+}
+
+#else
+
+SimdLevel detectSimdLevel() {
+  return SimdLevel::scalar;
+}
+
+#endif
+
+SimdLevel simdLevel() {
+  static const SimdLevel level = detectSimdLevel();
+  return level;
+}
+
+} // namespace
+
+Real logSoftMaxInPlace(Real* values, size_t size) {
+  switch (simdLevel()) {
+#ifdef OXLM_X86_KERNELS
+    case SimdLevel::avx512:
+      return avx512LogSoftMax(values, size);
+    case SimdLevel::avx2:
+      return avx2LogSoftMax(values, size);
+#endif
+    default:
+      return scalarLogSoftMax(values, size);
+  }
+}
+
+void sigmoidInPlace(Real* values, size_t size) {
+  switch (simdLevel()) {
+#ifdef OXLM_X86_KERNELS
+    case SimdLevel::avx512:
+      return avx512Sigmoid(values, size);
+    case SimdLevel::avx2:
+      return avx2Sigmoid(values, size);
+#endif
+    default:
+      return scalarSigmoid(values, size);
+  }
+}
+
+void tanhInPlace(Real* values, size_t size) {
+  switch (simdLevel()) {
+#ifdef OXLM_X86_KERNELS
+    case SimdLevel::avx512:
+      return avx512Tanh(values, size);
+    case SimdLevel::avx2:
+      return avx2Tanh(values, size);
+#endif
+    default:
+      return scalarTanh(values, size);
+  }
+}
+
+void multiplySigmoidDerivative(const Real* activations, Real* gradient,
+                               size_t size) {
+  switch (simdLevel()) {
+#ifdef OXLM_X86_KERNELS
+    case SimdLevel::avx512:
+      return avx512SigmoidDerivative(activations, gradient, size);
+    case SimdLevel::avx2:
+      return avx2SigmoidDerivative(activations, gradient, size);
+#endif
+    default:
+      return sigmoidDerivativeLoop(activations, gradient, size);
+  }
+}
+
+void multiplyTanhDerivative(const Real* activations, Real* gradient,
+                            size_t size) {
+  switch (simdLevel()) {
+#ifdef OXLM_X86_KERNELS
+    case SimdLevel::avx512:
+      return avx512TanhDerivative(activations, gradient, size);
+    case SimdLevel::avx2:
+      return avx2TanhDerivative(activations, gradient, size);
+#endif
+    default:
+      return tanhDerivativeLoop(activations, gradient, size);
+  }
+}
+
+void dequantizeInt8(const int8_t* values, Real scale, Real* out, size_t size) {
+  switch (simdLevel()) {
+#ifdef OXLM_X86_KERNELS
+    case SimdLevel::avx512:
+      return avx512Int8(values, scale, out, size);
+    case SimdLevel::avx2:
+      return avx2Int8(values, scale, out, size);
+#endif
+    default:
+      return int8Loop(values, scale, out, size);
+  }
+}
+
+void dequantizeHalf(const uint16_t* values, Real* out, size_t size) {
+  switch (simdLevel()) {
+#ifdef OXLM_X86_KERNELS
+    case SimdLevel::avx512:
+      return avx512Half(values, out, size);
+    case SimdLevel::avx2:
+      return avx2Half(values, out, size);
+#endif
+    default:
+      return scalarHalf(values, out, size);
+  }
+}
+
+} // namespace oxlm
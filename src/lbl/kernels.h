@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "corpus/utils.h"
+
+namespace oxlm {
+
+/**
+ * Element-wise kernels for the activations and the softmax normalization,
+ * which dominate the time spent outside the matrix products, and for decoding
+ * quantized weights. On x86 the AVX-512 or AVX2 version is picked when the
+ * CPU supports it, with a scalar fallback everywhere else. All kernels work on
+ * contiguous memory.
+ */
+
+// Replaces the values with their log-softmax and returns the log normalizer.
+Real logSoftMaxInPlace(Real* values, size_t size);
+
+void sigmoidInPlace(Real* values, size_t size);
+
+void tanhInPlace(Real* values, size_t size);
+
+// Multiplies the gradient with the derivative of the activation, given the
+// values after the activation has been applied.
+void multiplySigmoidDerivative(const Real* activations, Real* gradient,
+                               size_t size);
+
+void multiplyTanhDerivative(const Real* activations, Real* gradient,
+                            size_t size);
+
+// Decodes quantized values into out: int8 values times their scale, or IEEE
+// half precision floats.
+void dequantizeInt8(const int8_t* values, Real scale, Real* out, size_t size);
+
+void dequantizeHalf(const uint16_t* values, Real* out, size_t size);
+
+} // namespace oxlm
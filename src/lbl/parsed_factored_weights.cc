@@ -13,8 +13,9 @@ ParsedFactoredWeights::ParsedFactoredWeights()
 
 ParsedFactoredWeights::ParsedFactoredWeights(
     const boost::shared_ptr<ModelConfig>& config,
-    const boost::shared_ptr<ParsedFactoredMetadata>& metadata, bool init)
-    : FactoredWeights(config, metadata, init),
+    const boost::shared_ptr<ParsedFactoredMetadata>& metadata, bool init,
+    bool sparse)
+    : FactoredWeights(config, metadata, init, sparse),
       metadata(metadata),
       data(NULL),
       K(0, 0, 0),
@@ -82,6 +83,11 @@ Real ParsedFactoredWeights::predictWord(int word, Context context) const {
   return FactoredWeights::predict(word, context);
 }
 
+Real ParsedFactoredWeights::predictWord(int word,
+                                        const FlatContext& context) const {
+  return FactoredWeights::predict(word, context);
+}
+
 Reals ParsedFactoredWeights::predictWord(Context context) const {
   return FactoredWeights::predictViterbi(context);
 }
@@ -96,38 +102,36 @@ Real ParsedFactoredWeights::predictTag(int tag, Context context) const {
   return 0.0;
 }
 
+Real ParsedFactoredWeights::predictTag(int tag,
+                                       const FlatContext& context) const {
+  return 0.0;
+}
+
 Reals ParsedFactoredWeights::predictTag(Context context) const {
   return Reals(numTags(), 0.0);
 }
 
+Reals ParsedFactoredWeights::predictTag(const FlatContext& context) const {
+  return Reals(numTags(), 0.0);
+}
+
 Real ParsedFactoredWeights::predictAction(WordId action,
                                           Context context) const {
-  VectorReal prediction_vector = getPredictionVector(context);
-  Real prob = 0;
-
-  // TODO bug in cache
-  // auto ret = actionNormalizerCache.get(context.words);
-  // if (ret.second) {
-  //  prob = (K.col(action).dot(prediction_vector) + L(action) - ret.first);
-  //} else {
-  Real normalizer = 0;
-  VectorReal action_probs =
-      logSoftMax(K.transpose() * prediction_vector + L, normalizer);
-  // actionNormalizerCache.set(context.words, normalizer);
-  prob = action_probs(action);
-  //}
+  return predictAction(action, FlatContext(context));
+}
 
-  return -prob;
+Real ParsedFactoredWeights::predictAction(WordId action,
+                                          const FlatContext& context) const {
+  return -getActionLogProbs(context)(action);
 }
 
 Reals ParsedFactoredWeights::predictAction(Context context) const {
-  VectorReal prediction_vector = getPredictionVector(context);
-  Reals probs(numActions(), 0);
+  return predictAction(FlatContext(context));
+}
 
-  Real normalizer = 0;
-  VectorReal action_probs =
-      logSoftMax(K.transpose() * prediction_vector + L, normalizer);
-  // actionNormalizerCache.set(context.words, normalizer);
+Reals ParsedFactoredWeights::predictAction(const FlatContext& context) const {
+  VectorReal action_probs = getActionLogProbs(context);
+  Reals probs(numActions(), 0);
   for (int i = 0; i < numActions(); ++i) {
     probs[i] = -action_probs(i);
   }
@@ -135,6 +139,119 @@ Reals ParsedFactoredWeights::predictAction(Context context) const {
   return probs;
 }
 
+VectorReal ParsedFactoredWeights::getActionLogProbs(
+    const FlatContext& context) const {
+  if (config->cache_size <= 0) {
+    return logSoftMax(K.transpose() * getPredictionVector(context) + L);
+  }
+
+  vector<int> key = contextKey(context);
+  VectorReal action_probs;
+  if (!actionDistributionCache.get(key, action_probs)) {
+    action_probs = logSoftMax(K.transpose() * getPredictionVector(context) + L);
+    actionDistributionCache.set(key, action_probs, config->cache_size);
+  }
+
+  return action_probs;
+}
+
+Reals ParsedFactoredWeights::predictWordBatch(
+    const Words& words, const FlatContextBatch& contexts) const {
+  return FactoredWeights::predictBatch(words, contexts);
+}
+
+Reals ParsedFactoredWeights::predictTagBatch(
+    const Words& tags, const FlatContextBatch& contexts) const {
+  return Reals(tags.size(), 0.0);
+}
+
+vector<Reals> ParsedFactoredWeights::predictActionBatch(
+    const FlatContextBatch& contexts) const {
+  vector<Reals> probs(contexts.size(), Reals(numActions(), 0));
+  if (contexts.empty()) return probs;
+
+  // Only the contexts without a cached distribution are scored.
+  bool use_cache = config->cache_size > 0;
+  vector<vector<int>> keys;
+  vector<size_t> missing;
+  FlatContextBatch missing_contexts;
+  for (size_t i = 0; i < contexts.size(); ++i) {
+    VectorReal action_log_probs;
+    if (use_cache) {
+      keys.push_back(contextKey(contexts[i]));
+      if (actionDistributionCache.get(keys.back(), action_log_probs)) {
+        for (int j = 0; j < numActions(); ++j) {
+          probs[i][j] = -action_log_probs(j);
+        }
+        continue;
+      }
+    }
+
+    missing.push_back(i);
+    if (use_cache) {
+      missing_contexts.add() = contexts[i];
+    }
+  }
+
+  if (missing.empty()) return probs;
+
+  MatrixReal prediction_vectors =
+      getPredictionVectors(use_cache ? missing_contexts : contexts);
+  MatrixReal action_probs = K.transpose() * prediction_vectors +
+                            L * MatrixReal::Ones(1, missing.size());
+  logSoftMaxColumns(action_probs);
+  for (size_t k = 0; k < missing.size(); ++k) {
+    size_t i = missing[k];
+    VectorReal action_log_probs = action_probs.col(k);
+    if (use_cache) {
+      actionDistributionCache.set(keys[i], action_log_probs,
+                                  config->cache_size);
+    }
+    for (int j = 0; j < numActions(); ++j) {
+      probs[i][j] = -action_log_probs(j);
+    }
+  }
+
+  return probs;
+}
+
+Reals ParsedFactoredWeights::predictWordBatch(
+    const Words& words, const HiddenLayer& hidden) const {
+  return FactoredWeights::predictBatch(words, hidden);
+}
+
+Reals ParsedFactoredWeights::predictTagBatch(
+    const Words& tags, const HiddenLayer& hidden) const {
+  return Reals(tags.size(), 0.0);
+}
+
+vector<Reals> ParsedFactoredWeights::predictActionBatch(
+    const HiddenLayer& hidden) const {
+  size_t batch_size = hidden.prediction_vectors.cols();
+  vector<Reals> probs(batch_size, Reals(numActions(), 0));
+  if (batch_size == 0) return probs;
+
+  MatrixReal action_probs = K.transpose() * hidden.prediction_vectors +
+                            L * MatrixReal::Ones(1, batch_size);
+  for (size_t i = 0; i < batch_size; ++i) {
+    VectorReal action_log_probs;
+    if (config->cache_size <= 0) {
+      action_log_probs = logSoftMax(action_probs.col(i));
+    } else if (!actionDistributionCache.get(hidden.keys[i],
+                                            action_log_probs)) {
+      action_log_probs = logSoftMax(action_probs.col(i));
+      actionDistributionCache.set(hidden.keys[i], action_log_probs,
+                                  config->cache_size);
+    }
+
+    for (int j = 0; j < numActions(); ++j) {
+      probs[i][j] = -action_log_probs(j);
+    }
+  }
+
+  return probs;
+}
+
 int ParsedFactoredWeights::numWords() const {
   return FactoredWeights::vocabSize();
 }
@@ -238,10 +355,10 @@ void ParsedFactoredWeights::estimateGradient(
                              word_weighted_representations,
                              action_weighted_representations, objective, words);
 
-  word_weighted_representations.array() *=
-      activationDerivative(config->activation, word_prediction_vectors);
-  action_weighted_representations.array() *=
-      activationDerivative(config->activation, action_prediction_vectors);
+  multiplyActivationDerivative(config->activation, word_prediction_vectors,
+                               word_weighted_representations);
+  multiplyActivationDerivative(config->activation, action_prediction_vectors,
+                               action_weighted_representations);
 
   getContextGradient(examples->word_example_size(), word_contexts,
                      word_context_vectors, word_weighted_representations,
@@ -329,9 +446,7 @@ void ParsedFactoredWeights::getProbabilities(
 
   action_probs = K.transpose() * action_prediction_vectors +
                  L * MatrixReal::Ones(1, examples->action_example_size());
-  for (size_t i = 0; i < examples->action_example_size(); ++i) {
-    action_probs.col(i) = logSoftMax(action_probs.col(i));
-  }
+  logSoftMaxColumns(action_probs);
 }
 
 MatrixReal ParsedFactoredWeights::getActionWeightedRepresentations(
@@ -345,8 +460,8 @@ MatrixReal ParsedFactoredWeights::getActionWeightedRepresentations(
     weighted_representations.col(i) -= K.col(action_id);
   }
 
-  weighted_representations.array() *=
-      activationDerivative(config->activation, action_prediction_vectors);
+  multiplyActivationDerivative(config->activation, action_prediction_vectors,
+                               weighted_representations);
 
   return weighted_representations;
 }
@@ -379,20 +494,8 @@ void ParsedFactoredWeights::getFullGradient(
 
   gradient->S += word_prediction_vectors * class_probs.transpose();
   gradient->T += class_probs.rowwise().sum();
-  for (size_t i = 0; i < examples->word_example_size(); ++i) {
-    int word_id = examples->word_at(i);
-    int class_id = index->getClass(word_id);
-    int class_start = index->getClassMarker(class_id);
-    int class_size = index->getClassSize(class_id);
-
-    for (int j = 0; j < class_size; ++j) {
-      words.addOutputWord(class_start + j);
-    }
-
-    gradient->B.segment(class_start, class_size) += word_probs[i];
-    gradient->R.block(0, class_start, gradient->R.rows(), class_size) +=
-        word_prediction_vectors.col(i) * word_probs[i].transpose();
-  }
+  getWordGradient(examples->word_examples(), word_prediction_vectors,
+                  word_probs, gradient, words);
 
   gradient->K += action_prediction_vectors * action_probs.transpose();
   gradient->L += action_probs.rowwise().sum();
@@ -405,9 +508,9 @@ void ParsedFactoredWeights::getFullGradient(
                      gradient);
 }
 
-std::vector<Words> ParsedFactoredWeights::getNoiseWords(
+vector<NoiseSet> ParsedFactoredWeights::getNoiseWords(
     const boost::shared_ptr<ParseDataSet>& examples) const {
-  FactoredWeights::getNoiseWords(examples->word_examples());
+  return FactoredWeights::getNoiseWords(examples->word_examples());
 }
 
 void ParsedFactoredWeights::estimateProjectionGradient(
@@ -426,8 +529,7 @@ void ParsedFactoredWeights::estimateProjectionGradient(
   MatrixReal action_probs =
       K.transpose() * action_prediction_vectors +
       L * MatrixReal::Ones(1, examples->action_example_size());
-  for (size_t i = 0; i < examples->action_example_size(); ++i)
-    action_probs.col(i) = logSoftMax(action_probs.col(i));
+  logSoftMaxColumns(action_probs);
 
   for (size_t i = 0; i < examples->action_example_size(); ++i)
     objective -= action_probs(examples->action_at(i), i);
@@ -504,6 +606,24 @@ Real ParsedFactoredWeights::regularizerUpdate(
   return ret;
 }
 
+void ParsedFactoredWeights::applyPendingDecay(
+    const boost::shared_ptr<ParseDataSet>& examples) {
+  FactoredWeights::applyPendingDecay(examples->word_examples());
+  decayContextVectors(examples->tag_examples());
+  decayContextVectors(examples->action_examples());
+}
+
+void ParsedFactoredWeights::asyncUpdate(
+    const MinibatchWords& words,
+    const boost::shared_ptr<ParsedFactoredWeights>& gradient,
+    const boost::shared_ptr<ParsedFactoredWeights>& adagrad) {
+  FactoredWeights::asyncUpdate(words, gradient, adagrad);
+
+  adagrad->PW.array() += gradient->PW.array().square();
+  PW -= gradient->PW.binaryExpr(
+      adagrad->PW, CwiseAdagradUpdateOp<Real>(config->step_size));
+}
+
 void ParsedFactoredWeights::clear(const MinibatchWords& words,
                                   bool parallel_update) {
   FactoredWeights::clear(words, parallel_update);
@@ -518,7 +638,14 @@ void ParsedFactoredWeights::clear(const MinibatchWords& words,
 
 void ParsedFactoredWeights::clearCache() {
   FactoredWeights::clearCache();
-  actionNormalizerCache.clear();
+  actionDistributionCache.clear();
+}
+
+void ParsedFactoredWeights::printCacheStats() const {
+  FactoredWeights::printCacheStats();
+  cerr << "Action distribution cache: " << actionDistributionCache.numHits()
+       << " hits, " << actionDistributionCache.numMisses()
+       << " misses, hit rate " << actionDistributionCache.hitRate() << endl;
 }
 
 bool ParsedFactoredWeights::operator==(
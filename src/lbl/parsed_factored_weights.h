@@ -21,7 +21,8 @@ class ParsedFactoredWeights : public FactoredWeights {
 
   ParsedFactoredWeights(
       const boost::shared_ptr<ModelConfig>& config,
-      const boost::shared_ptr<ParsedFactoredMetadata>& metadata, bool init);
+      const boost::shared_ptr<ParsedFactoredMetadata>& metadata, bool init,
+      bool sparse = false);
 
   ParsedFactoredWeights(const ParsedFactoredWeights& other);
 
@@ -45,18 +46,46 @@ class ParsedFactoredWeights : public FactoredWeights {
 
   Real predictWord(int word, Context context) const;
 
+  Real predictWord(int word, const FlatContext& context) const;
+
   Reals predictWord(Context context) const;
 
   Reals predictWordOverTags(int word, Context context) const;
 
   Real predictTag(int tag, Context context) const;
 
+  Real predictTag(int tag, const FlatContext& context) const;
+
   Reals predictTag(Context context) const;
 
+  Reals predictTag(const FlatContext& context) const;
+
   Real predictAction(int action, Context context) const;
 
+  Real predictAction(int action, const FlatContext& context) const;
+
   Reals predictAction(Context context) const;
 
+  Reals predictAction(const FlatContext& context) const;
+
+  // Batched versions of the predictions, used to score all the items of a
+  // beam with one matrix product per output layer.
+  Reals predictWordBatch(const Words& words,
+                         const FlatContextBatch& contexts) const;
+
+  Reals predictTagBatch(const Words& tags,
+                        const FlatContextBatch& contexts) const;
+
+  vector<Reals> predictActionBatch(const FlatContextBatch& contexts) const;
+
+  // Batched predictions from a hidden layer computed with getHiddenLayer(),
+  // so that the output layers conditioning on the same contexts share it.
+  Reals predictWordBatch(const Words& words, const HiddenLayer& hidden) const;
+
+  Reals predictTagBatch(const Words& tags, const HiddenLayer& hidden) const;
+
+  vector<Reals> predictActionBatch(const HiddenLayer& hidden) const;
+
   void syncUpdate(const MinibatchWords& words,
                   const boost::shared_ptr<ParsedFactoredWeights>& gradient);
 
@@ -74,6 +103,12 @@ class ParsedFactoredWeights : public FactoredWeights {
       const boost::shared_ptr<ParsedFactoredWeights>& global_gradient,
       Real minibatch_factor);
 
+  void applyPendingDecay(const boost::shared_ptr<ParseDataSet>& examples);
+
+  void asyncUpdate(const MinibatchWords& words,
+                   const boost::shared_ptr<ParsedFactoredWeights>& gradient,
+                   const boost::shared_ptr<ParsedFactoredWeights>& adagrad);
+
   void clear(const MinibatchWords& words, bool parallel_update);
 
   int numWords() const;
@@ -84,11 +119,16 @@ class ParsedFactoredWeights : public FactoredWeights {
 
   void clearCache();
 
+  void printCacheStats() const;
+
   bool operator==(const ParsedFactoredWeights& other) const;
 
   virtual ~ParsedFactoredWeights();
 
  protected:
+  // Action log probabilities, taken from the distribution cache if enabled.
+  VectorReal getActionLogProbs(const FlatContext& context) const;
+
   Real getObjective(const boost::shared_ptr<ParseDataSet>& examples,
                     vector<WordsList>& word_contexts,
                     vector<WordsList>& action_contexts,
@@ -126,7 +166,7 @@ class ParsedFactoredWeights : public FactoredWeights {
                        const boost::shared_ptr<ParsedFactoredWeights>& gradient,
                        MinibatchWords& words) const;
 
-  std::vector<Words> getNoiseWords(
+  vector<NoiseSet> getNoiseWords(
       const boost::shared_ptr<ParseDataSet>& examples) const;
 
   void estimateProjectionGradient(
@@ -179,7 +219,7 @@ class ParsedFactoredWeights : public FactoredWeights {
   WeightsType L;
   WeightsType PW;
 
-  mutable ContextCache actionNormalizerCache;
+  mutable DistributionCache actionDistributionCache;
 
  private:
   int size;
@@ -0,0 +1,130 @@
+#include "lbl/quantized_matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "lbl/kernels.h"
+
+namespace oxlm {
+
+namespace {
+
+// Number of columns decoded at a time by the products.
+const int kBlockColumns = 256;
+
+// Converts to IEEE half precision, rounding to the nearest even value.
+uint16_t floatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t magnitude = bits & 0x7fffffff;
+
+  if (magnitude >= 0x7f800000) {
+    // Infinity or NaN.
+    return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+  }
+  if (magnitude >= 0x477ff000) {
+    // Rounds to a value larger than the largest half precision float.
+    return sign | 0x7c00;
+  }
+  if (magnitude < 0x38800000) {
+    // Subnormal half precision floats are multiples of 2^-24.
+    float subnormal;
+    memcpy(&subnormal, &magnitude, sizeof(subnormal));
+    return sign | static_cast<uint16_t>(nearbyint(ldexp(subnormal, 24)));
+  }
+
+  uint32_t half = magnitude - 0x38000000;
+  half = (half + 0xfff + ((half >> 13) & 1)) >> 13;
+  return sign | static_cast<uint16_t>(half);
+}
+
+} // namespace
+
+QuantizedMatrix::QuantizedMatrix()
+    : quantization(Quantization::none), numRows(0), numCols(0) {}
+
+QuantizedMatrix::QuantizedMatrix(const Real* data, int rows, int cols,
+                                 Quantization quantization)
+    : quantization(quantization), numRows(rows), numCols(cols) {
+  size_t size = static_cast<size_t>(rows) * cols;
+  if (quantization == Quantization::int8) {
+    int8Values.resize(size);
+    scales.resize(cols);
+    for (int col = 0; col < cols; ++col) {
+      const Real* values = data + static_cast<size_t>(col) * rows;
+      Real max = 0;
+      for (int row = 0; row < rows; ++row) {
+        max = std::max(max, fabs(values[row]));
+      }
+
+      scales[col] = max / 127;
+      int8_t* quantized = int8Values.data() + static_cast<size_t>(col) * rows;
+      for (int row = 0; row < rows; ++row) {
+        quantized[row] =
+            max > 0 ? static_cast<int8_t>(lround(values[row] / scales[col]))
+                    : 0;
+      }
+    }
+  } else {
+    halfValues.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+      halfValues[i] = floatToHalf(data[i]);
+    }
+  }
+}
+
+int QuantizedMatrix::rows() const {
+  return numRows;
+}
+
+int QuantizedMatrix::cols() const {
+  return numCols;
+}
+
+size_t QuantizedMatrix::bytes() const {
+  return int8Values.size() * sizeof(int8_t) +
+         halfValues.size() * sizeof(uint16_t) + scales.size() * sizeof(Real);
+}
+
+void QuantizedMatrix::addColumn(int col, Real* out) const {
+  VectorReal column(numRows);
+  decode(col, 1, column.data());
+  VectorRealMap(out, numRows) += column;
+}
+
+Real QuantizedMatrix::dot(int col, const VectorReal& vector) const {
+  VectorReal column(numRows);
+  decode(col, 1, column.data());
+  return column.dot(vector);
+}
+
+MatrixReal QuantizedMatrix::transposeProduct(
+    int start, int size, const MatrixReal& vectors) const {
+  MatrixReal result(size, vectors.cols());
+  MatrixReal block(numRows, min(size, kBlockColumns));
+  for (int i = 0; i < size; i += kBlockColumns) {
+    int block_size = min(kBlockColumns, size - i);
+    decode(start + i, block_size, block.data());
+    result.middleRows(i, block_size).noalias() =
+        block.leftCols(block_size).transpose() * vectors;
+  }
+
+  return result;
+}
+
+void QuantizedMatrix::decode(int start, int size, Real* block) const {
+  size_t offset = static_cast<size_t>(start) * numRows;
+  if (quantization == Quantization::int8) {
+    for (int col = 0; col < size; ++col) {
+      dequantizeInt8(int8Values.data() + offset + col * numRows,
+                     scales[start + col], block + col * numRows, numRows);
+    }
+  } else {
+    dequantizeHalf(halfValues.data() + offset, block,
+                   static_cast<size_t>(size) * numRows);
+  }
+}
+
+} // namespace oxlm
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "corpus/model_config.h"
+#include "lbl/utils.h"
+
+using namespace std;
+
+namespace oxlm {
+
+/**
+ * Read-only copy of a matrix with reduced precision columns, used to shrink
+ * the word vectors of a trained model for decoding. Every column is stored
+ * either as IEEE half precision floats, or as int8 values with a scale per
+ * column. Products decode a block of columns at a time and multiply the
+ * decoded block with Eigen.
+ */
+class QuantizedMatrix {
+ public:
+  QuantizedMatrix();
+
+  // Quantizes the column-major rows x cols matrix at data.
+  QuantizedMatrix(const Real* data, int rows, int cols,
+                  Quantization quantization);
+
+  int rows() const;
+
+  int cols() const;
+
+  // Memory used by the quantized values and the scales, in bytes.
+  size_t bytes() const;
+
+  // Adds column col to out.
+  void addColumn(int col, Real* out) const;
+
+  Real dot(int col, const VectorReal& vector) const;
+
+  // Multiplies the transpose of the columns [start, start + size) with the
+  // vectors.
+  MatrixReal transposeProduct(int start, int size,
+                              const MatrixReal& vectors) const;
+
+ private:
+  // Decodes the columns [start, start + size) into a column-major block.
+  void decode(int start, int size, Real* block) const;
+
+  Quantization quantization;
+  int numRows;
+  int numCols;
+  vector<int8_t> int8Values;
+  vector<uint16_t> halfValues;
+  vector<Real> scales;
+};
+
+} // namespace oxlm
@@ -0,0 +1,32 @@
+#include "lbl/sparse_columns.h"
+
+#include <algorithm>
+
+namespace oxlm {
+
+SparseColumns::SparseColumns() : rows(0) {}
+
+SparseColumns::SparseColumns(int rows) : rows(rows) {}
+
+VectorRealMap SparseColumns::col(int id) {
+  auto ret = positions.insert(make_pair(id, positions.size()));
+  size_t start = ret.first->second * rows;
+  if (ret.second) {
+    if (values.size() < start + rows) {
+      values.resize(start + rows);
+    }
+    fill(values.begin() + start, values.begin() + start + rows, 0);
+  }
+
+  return VectorRealMap(values.data() + start, rows);
+}
+
+bool SparseColumns::contains(int id) const {
+  return positions.count(id) > 0;
+}
+
+size_t SparseColumns::size() const { return positions.size(); }
+
+void SparseColumns::clear() { positions.clear(); }
+
+}  // namespace oxlm
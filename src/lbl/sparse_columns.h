@@ -0,0 +1,40 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "lbl/utils.h"
+
+using namespace std;
+
+namespace oxlm {
+
+/**
+ * Columns of a matrix of which only a few are nonzero, e.g. the gradient of
+ * the word vectors over a minibatch. The columns are stored contiguously in
+ * the order in which they are first accessed, and their storage is reused
+ * after the columns are cleared.
+ */
+class SparseColumns {
+ public:
+  SparseColumns();
+
+  SparseColumns(int rows);
+
+  // Returns the column of the given id, adding a zero column if it is not
+  // stored yet. The view is invalidated when other columns are added.
+  VectorRealMap col(int id);
+
+  bool contains(int id) const;
+
+  size_t size() const;
+
+  void clear();
+
+ private:
+  int rows;
+  unordered_map<int, size_t> positions;
+  vector<Real> values;
+};
+
+}  // namespace oxlm
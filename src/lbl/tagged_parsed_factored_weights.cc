@@ -14,8 +14,8 @@ TaggedParsedFactoredWeights::TaggedParsedFactoredWeights()
 TaggedParsedFactoredWeights::TaggedParsedFactoredWeights(
     const boost::shared_ptr<ModelConfig>& config,
     const boost::shared_ptr<TaggedParsedFactoredMetadata>& metadata,
-    bool init)
-    : ParsedFactoredWeights(config, metadata, init), metadata(metadata),
+    bool init, bool sparse)
+    : ParsedFactoredWeights(config, metadata, init, sparse), metadata(metadata),
       data(NULL), U(0, 0, 0), V(0, 0), TW(0, 0) { 
   allocate();
 
@@ -87,38 +87,91 @@ Reals TaggedParsedFactoredWeights::predictWordOverTags(int word, Context context
 }
 
 Real TaggedParsedFactoredWeights::predictTag(int tag, Context context) const {
-  VectorReal prediction_vector = getPredictionVector(context);
-  Real prob = 0;
-
-  //TODO bug in cache
-  //auto ret = actionNormalizerCache.get(context.words);
-  //if (ret.second) {
-  //  prob = (K.col(action).dot(prediction_vector) + L(action) - ret.first);
-  //} else {  
-    Real normalizer = 0;
-    VectorReal tag_probs = logSoftMax(
-        U.transpose() * prediction_vector + V, normalizer);
-    //actionNormalizerCache.set(context.words, normalizer);
-    prob = tag_probs(tag);
-  //}
-
-  return -prob;
-}
- 
+  return predictTag(tag, FlatContext(context));
+}
+
+Real TaggedParsedFactoredWeights::predictTag(
+    int tag, const FlatContext& context) const {
+  return -getTagLogProbs(context)(tag);
+}
+
 Reals TaggedParsedFactoredWeights::predictTag(Context context) const {
-  VectorReal prediction_vector = getPredictionVector(context);
-  Reals probs(numTags(), 0);
+  return predictTag(FlatContext(context));
+}
 
-  Real normalizer = 0;
-  VectorReal tag_probs = logSoftMax(
-      U.transpose() * prediction_vector + V, normalizer);
-  //actionNormalizerCache.set(context.words, normalizer);
+Reals TaggedParsedFactoredWeights::predictTag(
+    const FlatContext& context) const {
+  VectorReal tag_probs = getTagLogProbs(context);
+  Reals probs(numTags(), 0);
   for (int i = 0; i < numTags(); ++i) 
     probs[i] = -tag_probs(i);  
   
   return probs;
 }
+
+VectorReal TaggedParsedFactoredWeights::getTagLogProbs(
+    const FlatContext& context) const {
+  if (config->cache_size <= 0) {
+    return logSoftMax(U.transpose() * getPredictionVector(context) + V);
+  }
+
+  vector<int> key = contextKey(context);
+  VectorReal tag_probs;
+  if (!tagDistributionCache.get(key, tag_probs)) {
+    tag_probs = logSoftMax(U.transpose() * getPredictionVector(context) + V);
+    tagDistributionCache.set(key, tag_probs, config->cache_size);
+  }
+
+  return tag_probs;
+}
   
+Reals TaggedParsedFactoredWeights::predictTagBatch(
+    const Words& tags, const FlatContextBatch& contexts) const {
+  Reals probs(tags.size(), 0);
+  if (tags.empty()) return probs;
+
+  if (config->cache_size > 0) {
+    for (size_t i = 0; i < tags.size(); ++i) {
+      probs[i] = predictTag(tags[i], contexts[i]);
+    }
+
+    return probs;
+  }
+
+  MatrixReal prediction_vectors = getPredictionVectors(contexts);
+  MatrixReal tag_probs = U.transpose() * prediction_vectors +
+                         V * MatrixReal::Ones(1, tags.size());
+  logSoftMaxColumns(tag_probs);
+  for (size_t i = 0; i < tags.size(); ++i) {
+    probs[i] = -tag_probs(tags[i], i);
+  }
+
+  return probs;
+}
+
+Reals TaggedParsedFactoredWeights::predictTagBatch(
+    const Words& tags, const HiddenLayer& hidden) const {
+  Reals probs(tags.size(), 0);
+  if (tags.empty()) return probs;
+
+  MatrixReal tag_probs = U.transpose() * hidden.prediction_vectors +
+                         V * MatrixReal::Ones(1, tags.size());
+  for (size_t i = 0; i < tags.size(); ++i) {
+    VectorReal tag_log_probs;
+    if (config->cache_size <= 0) {
+      tag_log_probs = logSoftMax(tag_probs.col(i));
+    } else if (!tagDistributionCache.get(hidden.keys[i], tag_log_probs)) {
+      tag_log_probs = logSoftMax(tag_probs.col(i));
+      tagDistributionCache.set(hidden.keys[i], tag_log_probs,
+                               config->cache_size);
+    }
+
+    probs[i] = -tag_log_probs(tags[i]);
+  }
+
+  return probs;
+}
+
 int TaggedParsedFactoredWeights::numWords() const {
   return ParsedFactoredWeights::vocabSize();
 }
@@ -313,9 +366,7 @@ void TaggedParsedFactoredWeights::getProbabilities(
   
   tag_probs = U.transpose() * tag_prediction_vectors 
                 + V * MatrixReal::Ones(1, examples->tag_example_size());
-  for (size_t i = 0; i < examples->tag_example_size(); ++i) {
-    tag_probs.col(i) = logSoftMax(tag_probs.col(i));
-  }
+  logSoftMaxColumns(tag_probs);
 }
 
 MatrixReal TaggedParsedFactoredWeights::getTagWeightedRepresentations(
@@ -329,7 +380,8 @@ MatrixReal TaggedParsedFactoredWeights::getTagWeightedRepresentations(
     weighted_representations.col(i) -= U.col(tag_id);
   }
 
-  weighted_representations.array() *= activationDerivative(config->activation, tag_prediction_vectors);
+  multiplyActivationDerivative(config->activation, tag_prediction_vectors,
+                               weighted_representations);
   return weighted_representations;
 }
 
@@ -373,20 +425,8 @@ void TaggedParsedFactoredWeights::getFullGradient(
 
   gradient->S += word_prediction_vectors * class_probs.transpose();
   gradient->T += class_probs.rowwise().sum();
-  for (size_t i = 0; i < examples->word_example_size(); ++i) {
-    int word_id = examples->word_at(i); 
-    int class_id = index->getClass(word_id);
-    int class_start = index->getClassMarker(class_id);
-    int class_size = index->getClassSize(class_id);
-
-    for (int j = 0; j < class_size; ++j) {
-      words.addOutputWord(class_start + j);
-    }
-
-    gradient->B.segment(class_start, class_size) += word_probs[i];
-    gradient->R.block(0, class_start, gradient->R.rows(), class_size) +=
-        word_prediction_vectors.col(i) * word_probs[i].transpose();
-  }
+  getWordGradient(examples->word_examples(), word_prediction_vectors,
+                  word_probs, gradient, words);
 
   gradient->K += action_prediction_vectors * action_probs.transpose();
   gradient->L += action_probs.rowwise().sum();
@@ -466,6 +506,17 @@ Real TaggedParsedFactoredWeights::regularizerUpdate(
   return ret;
 }
 
+void TaggedParsedFactoredWeights::asyncUpdate(
+    const MinibatchWords& words,
+    const boost::shared_ptr<TaggedParsedFactoredWeights>& gradient,
+    const boost::shared_ptr<TaggedParsedFactoredWeights>& adagrad) {
+  ParsedFactoredWeights::asyncUpdate(words, gradient, adagrad);
+
+  adagrad->TW.array() += gradient->TW.array().square();
+  TW -= gradient->TW.binaryExpr(
+      adagrad->TW, CwiseAdagradUpdateOp<Real>(config->step_size));
+}
+
 void TaggedParsedFactoredWeights::clear(const MinibatchWords& words, bool parallel_update) {
   ParsedFactoredWeights::clear(words, parallel_update);
 
@@ -479,7 +530,14 @@ void TaggedParsedFactoredWeights::clear(const MinibatchWords& words, bool parall
 
 void TaggedParsedFactoredWeights::clearCache() {
   ParsedFactoredWeights::clearCache();
-  tagNormalizerCache.clear();
+  tagDistributionCache.clear();
+}
+
+void TaggedParsedFactoredWeights::printCacheStats() const {
+  ParsedFactoredWeights::printCacheStats();
+  cerr << "Tag distribution cache: " << tagDistributionCache.numHits()
+       << " hits, " << tagDistributionCache.numMisses() << " misses, hit rate "
+       << tagDistributionCache.hitRate() << endl;
 }
 
 bool TaggedParsedFactoredWeights::operator==(const TaggedParsedFactoredWeights& other) const {
@@ -21,7 +21,7 @@ class TaggedParsedFactoredWeights : public ParsedFactoredWeights {
   TaggedParsedFactoredWeights(
       const boost::shared_ptr<ModelConfig>& config,
       const boost::shared_ptr<TaggedParsedFactoredMetadata>& metadata,
-      bool init);
+      bool init, bool sparse = false);
 
   TaggedParsedFactoredWeights(const TaggedParsedFactoredWeights& other);
 
@@ -54,9 +54,18 @@ class TaggedParsedFactoredWeights : public ParsedFactoredWeights {
   Reals predictWordOverTags(int word, Context context) const;
 
   Real predictTag(int tag, Context context) const;
+
+  Real predictTag(int tag, const FlatContext& context) const;
   
   Reals predictTag(Context context) const;
 
+  Reals predictTag(const FlatContext& context) const;
+
+  Reals predictTagBatch(const Words& tags,
+                        const FlatContextBatch& contexts) const;
+
+  Reals predictTagBatch(const Words& tags, const HiddenLayer& hidden) const;
+
   //Real predictAction(int action, Context context) const;
   
   //Reals predictAction(Context context) const;
@@ -79,6 +88,11 @@ class TaggedParsedFactoredWeights : public ParsedFactoredWeights {
       const boost::shared_ptr<TaggedParsedFactoredWeights>& global_gradient,
       Real minibatch_factor);
 
+  void asyncUpdate(
+      const MinibatchWords& words,
+      const boost::shared_ptr<TaggedParsedFactoredWeights>& gradient,
+      const boost::shared_ptr<TaggedParsedFactoredWeights>& adagrad);
+
   void clear(const MinibatchWords& words, bool parallel_update);
 
   int numWords() const;
@@ -89,11 +103,16 @@ class TaggedParsedFactoredWeights : public ParsedFactoredWeights {
  
   void clearCache();
 
+  void printCacheStats() const;
+
   bool operator==(const TaggedParsedFactoredWeights& other) const;
 
   virtual ~TaggedParsedFactoredWeights();
 
  protected:
+  // Tag log probabilities, taken from the distribution cache if enabled.
+  VectorReal getTagLogProbs(const FlatContext& context) const;
+
    Real getObjective(
       const boost::shared_ptr<ParseDataSet>& examples,
       vector<WordsList>& word_contexts,
@@ -190,7 +209,7 @@ class TaggedParsedFactoredWeights : public ParsedFactoredWeights {
   WeightsType     V;
   WeightsType     TW;
  
-  mutable ContextCache tagNormalizerCache;
+  mutable DistributionCache tagDistributionCache;
 
  private:
   int size;
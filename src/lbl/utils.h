@@ -12,6 +12,7 @@
 #include "corpus/utils.h"
 #include "corpus/model_config.h"
 #include "corpus/corpus.h"
+#include "lbl/kernels.h"
 #include "lbl/operators.h"
 
 using namespace std;
@@ -34,25 +35,35 @@ typedef Eigen::SparseVector<Real>                           SparseVectorReal;
 // Helper operations on vectors.
 
 inline VectorReal softMax(const VectorReal& v) {
-  Real max = v.maxCoeff();
-  return (v.array() - (log((v.array() - max).exp().sum()) + max)).exp();
+  VectorReal w = v;
+  logSoftMaxInPlace(w.data(), w.size());
+  return w.array().exp();
 }
 
 inline VectorReal logSoftMax(const VectorReal& v) {
-  Real max = v.maxCoeff();
-  Real log_z = log((v.array() - max).exp().sum()) + max;
-  return v.array() - log_z;
+  VectorReal w = v;
+  logSoftMaxInPlace(w.data(), w.size());
+  return w;
 }
 
 inline VectorReal logSoftMax(const VectorReal& v, Real& log_z) {
-  Real max = v.maxCoeff();
-  log_z = log((v.array() - max).exp().sum()) + max;
-  return v.array() - log_z;
+  VectorReal w = v;
+  log_z = logSoftMaxInPlace(w.data(), w.size());
+  return w;
+}
+
+// Replaces every column of the scores with its log-softmax.
+inline void logSoftMaxColumns(MatrixReal& scores) {
+  for (int i = 0; i < scores.cols(); ++i) {
+    logSoftMaxInPlace(scores.col(i).data(), scores.rows());
+  }
 }
 
 template <class Matrix>
 inline Matrix sigmoid(const Matrix& v) {
-  return (1.0 + (-v).array().exp()).inverse();
+  Matrix w = v;
+  sigmoidInPlace(w.data(), w.size());
+  return w;
 }
 
 inline Array2DReal sigmoidDerivative(const MatrixReal& v) {
@@ -70,8 +81,9 @@ inline Array2DReal rectifierDerivative(const MatrixReal& v) {
 
 template <class Matrix>
 inline Matrix tanh(const Matrix& v) {
-  Matrix w = (-2.0 * v).array().exp();
-  return (1.0 - w.array()) * (1.0 + w.array()).inverse();
+  Matrix w = v;
+  tanhInPlace(w.data(), w.size());
+  return w;
 }
 
 inline Array2DReal tanhDerivative(const MatrixReal& v) {
@@ -79,21 +91,29 @@ inline Array2DReal tanhDerivative(const MatrixReal& v) {
 }
 
 template <class Matrix>
-inline Matrix applyActivation(Activation activation, const Matrix& v) {
+inline void applyActivationInPlace(Activation activation, Matrix& v) {
   switch (activation) {
-    case Activation::linear:
-      return v;
     case Activation::sigmoid:
-      return sigmoid(v);
+      sigmoidInPlace(v.data(), v.size());
+      break;
     case Activation::rectifier:
-      return rectifier(v);
+      v = v.unaryExpr(CwiseRectifierOp<Real>());
+      break;
     case Activation::tanh:
-      return tanh(v);
+      tanhInPlace(v.data(), v.size());
+      break;
     default:
-      return v;
+      break;
   }
 }
 
+template <class Matrix>
+inline Matrix applyActivation(Activation activation, const Matrix& v) {
+  Matrix w = v;
+  applyActivationInPlace(activation, w);
+  return w;
+}
+
 // Note: The input (v) here is the hidden layer after the activation has been 
 // applied. Be careful how you define future activations.
 inline Array2DReal activationDerivative(Activation activation,
@@ -112,6 +132,27 @@ inline Array2DReal activationDerivative(Activation activation,
   }
 }
 
+// Multiplies the gradient with activationDerivative(activation, v) without
+// allocating the derivative.
+inline void multiplyActivationDerivative(Activation activation,
+                                         const MatrixReal& v,
+                                         MatrixReal& gradient) {
+  switch (activation) {
+    case Activation::sigmoid:
+      multiplySigmoidDerivative(v.data(), gradient.data(), gradient.size());
+      break;
+    case Activation::rectifier:
+      gradient.array() *=
+          v.array().unaryExpr(CwiseRectifierDerivativeOp<Real>());
+      break;
+    case Activation::tanh:
+      multiplyTanhDerivative(v.data(), gradient.data(), gradient.size());
+      break;
+    default:
+      break;
+  }
+}
+
 class NotImplementedException : public exception {
   virtual const char* what() const throw() {
     return "This method was not implemented";
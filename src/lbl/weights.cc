@@ -1,6 +1,8 @@
 #include "lbl/weights.h"
 
+#include <algorithm>
 #include <iomanip>
+#include <numeric>
 #include <random>
 
 #include <boost/make_shared.hpp>
@@ -10,13 +12,24 @@
 
 namespace oxlm {
 
-Weights::Weights() : data(NULL), Q(0, 0, 0), R(0, 0, 0), B(0, 0), W(0, 0) {}
+Weights::Weights()
+    : data(NULL),
+      sparse(false),
+      decayedNorm(0),
+      Q(0, 0, 0),
+      R(0, 0, 0),
+      B(0, 0),
+      W(0, 0) {}
 
 Weights::Weights(const boost::shared_ptr<ModelConfig>& config,
-                 const boost::shared_ptr<Metadata>& metadata, bool init)
+                 const boost::shared_ptr<Metadata>& metadata, bool init,
+                 bool sparse)
     : config(config),
       metadata(metadata),
       data(NULL),
+      sparse(sparse),
+      sparseQ(config->representation_size),
+      sparseR(config->representation_size),
       Q(0, 0, 0),
       R(0, 0, 0),
       B(0, 0),
@@ -43,34 +56,55 @@ Weights::Weights(const boost::shared_ptr<ModelConfig>& config,
   } else {
     W.setZero();
   }
+
+  resetDecay();
 }
 
 Weights::Weights(const Weights& other)
     : config(other.config),
       metadata(other.metadata),
       data(NULL),
+      sparse(other.sparse),
+      sparseQ(other.sparseQ),
+      sparseR(other.sparseR),
+      quantizedQ(other.quantizedQ),
+      quantizedR(other.quantizedR),
+      decay(other.decay),
+      decayStepsQ(other.decayStepsQ.size()),
+      decayStepsR(other.decayStepsR.size()),
+      decayedNorm(other.decayedNorm),
       Q(0, 0, 0),
       R(0, 0, 0),
       B(0, 0),
       W(0, 0) {
   allocate();
   memcpy(data, other.data, size * sizeof(Real));
+
+  for (size_t i = 0; i < decayStepsQ.size(); ++i) {
+    decayStepsQ[i].store(other.decayStepsQ[i].load());
+  }
+  for (size_t i = 0; i < decayStepsR.size(); ++i) {
+    decayStepsR[i].store(other.decayStepsR[i].load());
+  }
 }
 
 void Weights::allocate() {
-  int num_context_words = config->num_features;
-  int num_output_words = config->vocab_size;
+  // Sparse and quantized weights keep their word vectors outside of the dense
+  // block.
+  int num_context_words = hasDenseWordVectors() ? config->num_features : 0;
+  int num_output_words = hasDenseWordVectors() ? config->vocab_size : 0;
   int word_width = config->representation_size;
   int context_width = config->ngram_order - 1;
 
   int Q_size = word_width * num_context_words;
   int R_size = word_width * num_output_words;
   int C_size = config->diagonal_contexts ? word_width : word_width * word_width;
-  int B_size = num_output_words;
+  int B_size = config->vocab_size;
 
   size = Q_size + R_size + context_width * C_size + B_size;
   data = new Real[size];
 
+  // Only dense weights are updated from several threads.
   for (int i = 0; i < num_context_words; ++i) {
     mutexesQ.push_back(boost::make_shared<mutex>());
   }
@@ -85,19 +119,24 @@ void Weights::allocate() {
   setModelParameters();
 }
 
+bool Weights::hasDenseWordVectors() const {
+  return !sparse && !quantizedQ;
+}
+
 void Weights::setModelParameters() {
-  int num_context_words = config->num_features;
-  int num_output_words = config->vocab_size;
+  int num_context_words = hasDenseWordVectors() ? config->num_features : 0;
+  int num_output_words = hasDenseWordVectors() ? config->vocab_size : 0;
   int word_width = config->representation_size;
   int context_width = config->ngram_order - 1;
 
   int Q_size = word_width * num_context_words;
   int R_size = word_width * num_output_words;
   int C_size = config->diagonal_contexts ? word_width : word_width * word_width;
-  int B_size = num_output_words;
+  int B_size = config->vocab_size;
 
   new (&W) WeightsType(data, size);
 
+  C.clear();
   new (&Q) WordVectorsType(data, word_width, num_context_words);
   new (&R) WordVectorsType(data + Q_size, word_width, num_output_words);
 
@@ -114,6 +153,14 @@ void Weights::setModelParameters() {
   new (&B) WeightsType(start, B_size);
 }
 
+void Weights::resetDecay() {
+  decay.assign(1, 0);
+  // Atomics cannot be copied, so the steps are replaced by new zeroed arrays.
+  decayStepsQ = vector<atomic<int>>(Q.cols());
+  decayStepsR = vector<atomic<int>>(R.cols());
+  decayedNorm = Q.squaredNorm() + R.squaredNorm();
+}
+
 size_t Weights::numParameters() const { return size; }
 
 void Weights::getGradient(const boost::shared_ptr<DataSet>& examples,
@@ -181,7 +228,72 @@ MatrixReal Weights::getPredictionVectors(
     prediction_vectors += getContextProduct(i, context_vectors[i]);
   }
 
-  return applyActivation<MatrixReal>(config->activation, prediction_vectors);
+  applyActivationInPlace(config->activation, prediction_vectors);
+  return prediction_vectors;
+}
+
+MatrixReal Weights::getPredictionVectors(
+    const FlatContextBatch& contexts) const {
+  MatrixReal prediction_vectors = getPredictionInputs(contexts);
+  applyActivationInPlace(config->activation, prediction_vectors);
+  return prediction_vectors;
+}
+
+MatrixReal Weights::getPredictionInputs(
+    const FlatContextBatch& contexts) const {
+  int context_width = config->ngram_order - 1;
+  int word_width = config->representation_size;
+
+  MatrixReal inputs = MatrixReal::Zero(word_width, contexts.size());
+  MatrixReal context_vectors(word_width, contexts.size());
+  for (int j = 0; j < context_width; ++j) {
+    context_vectors.setZero();
+    for (size_t i = 0; i < contexts.size(); ++i) {
+      for (const int* feat = contexts[i].begin(j);
+           feat != contexts[i].end(j); ++feat) {
+        addContextVector(*feat, context_vectors.col(i).data());
+      }
+    }
+
+    inputs += getContextProduct(j, context_vectors);
+  }
+
+  return inputs;
+}
+
+void Weights::getHiddenLayer(const FlatContextBatch& contexts,
+                             HiddenLayer& hidden) const {
+  hidden.inputs = getPredictionInputs(contexts);
+  hidden.prediction_vectors = hidden.inputs;
+  applyActivationInPlace(config->activation, hidden.prediction_vectors);
+
+  hidden.keys.clear();
+  if (config->cache_size > 0) {
+    for (size_t i = 0; i < contexts.size(); ++i) {
+      hidden.keys.push_back(contextKey(contexts[i]));
+    }
+  }
+}
+
+void Weights::extendHiddenLayer(const HiddenLayer& hidden,
+                                const Words& features,
+                                HiddenLayer& extended) const {
+  int last = config->ngram_order - 2;
+  int word_width = config->representation_size;
+
+  MatrixReal feature_vectors = MatrixReal::Zero(word_width, features.size());
+  for (size_t i = 0; i < features.size(); ++i) {
+    addContextVector(features[i], feature_vectors.col(i).data());
+  }
+
+  extended.inputs = hidden.inputs + getContextProduct(last, feature_vectors);
+  extended.prediction_vectors = extended.inputs;
+  applyActivationInPlace(config->activation, extended.prediction_vectors);
+
+  extended.keys = hidden.keys;
+  for (size_t i = 0; i < extended.keys.size(); ++i) {
+    extendContextKey(extended.keys[i], features[i]);
+  }
 }
 
 MatrixReal Weights::getContextProduct(int index,
@@ -203,9 +315,7 @@ MatrixReal Weights::getProbabilities(
     const MatrixReal& prediction_vectors) const {
   MatrixReal word_probs = R.transpose() * prediction_vectors +
                           B * MatrixReal::Ones(1, examples->size());
-  for (size_t i = 0; i < examples->size(); ++i) {
-    word_probs.col(i) = logSoftMax(word_probs.col(i));
-  }
+  logSoftMaxColumns(word_probs);
 
   return word_probs;
 }
@@ -219,8 +329,8 @@ MatrixReal Weights::getWeightedRepresentations(
     weighted_representations.col(i) -= R.col(examples->wordAt(i));
   }
 
-  weighted_representations.array() *=
-      activationDerivative(config->activation, prediction_vectors);
+  multiplyActivationDerivative(config->activation, prediction_vectors,
+                               weighted_representations);
   return weighted_representations;
 }
 
@@ -240,7 +350,10 @@ void Weights::getFullGradient(const boost::shared_ptr<DataSet>& examples,
     words.addOutputWord(word_id);
   }
 
-  gradient->R += prediction_vectors * word_probs.transpose();
+  MatrixReal output_gradients = prediction_vectors * word_probs.transpose();
+  for (size_t word_id = 0; word_id < config->vocab_size; ++word_id) {
+    gradient->outputGradient(word_id) += output_gradients.col(word_id);
+  }
   gradient->B += word_probs.rowwise().sum();
 
   getContextGradient(examples->size(), contexts, context_vectors,
@@ -260,7 +373,7 @@ void Weights::getContextGradient(
     context_gradients = getContextProduct(j, weighted_representations, true);
     for (size_t i = 0; i < prediction_size; ++i) {
       for (auto feat : contexts[i][j]) {
-        gradient->Q.col(feat) += context_gradients.col(i);
+        gradient->contextGradient(feat) += context_gradients.col(i);
       }
     }
 
@@ -335,22 +448,60 @@ Real Weights::getObjective(const boost::shared_ptr<DataSet>& examples,
   return objective;
 }
 
-vector<vector<int>> Weights::getNoiseWords(
+vector<NoiseSet> Weights::getNoiseWords(
     const boost::shared_ptr<DataSet>& examples) const {
   if (!wordDists.get()) {
     wordDists.reset(new WordDistributions(metadata->getUnigram()));
   }
 
-  vector<vector<int>> noise_words(examples->size());
+  vector<NoiseSet> noise_words(config->shared_noise ? 1 : examples->size());
   for (size_t i = 0; i < examples->size(); ++i) {
+    noise_words[config->shared_noise ? 0 : i].examples.push_back(i);
+  }
+
+  for (auto& noise : noise_words) {
     for (int j = 0; j < config->noise_samples; ++j) {
-      noise_words[i].push_back(wordDists->sample());
+      noise.samples.push_back(wordDists->sample());
     }
   }
 
   return noise_words;
 }
 
+Real Weights::getNoiseGradient(const NoiseSet& noise,
+                               const MatrixReal& prediction_vectors,
+                               const MatrixReal& noise_vectors,
+                               const VectorReal& noise_biases,
+                               const VectorReal& noise_probs,
+                               MatrixReal& weighted_representations,
+                               MatrixReal& vector_gradient,
+                               VectorReal& bias_gradient) const {
+  MatrixReal group_vectors(prediction_vectors.rows(), noise.examples.size());
+  for (size_t i = 0; i < noise.examples.size(); ++i) {
+    group_vectors.col(i) = prediction_vectors.col(noise.examples[i]);
+  }
+
+  Array2DReal neg_probs =
+      ((noise_vectors.transpose() * group_vectors).colwise() + noise_biases)
+          .array()
+          .exp();
+  assert(neg_probs.maxCoeff() <= numeric_limits<Real>::max());
+
+  MatrixReal neg_weights =
+      (neg_probs / (neg_probs.colwise() + noise_probs.array())).matrix();
+
+  MatrixReal group_representations = noise_vectors * neg_weights;
+  for (size_t i = 0; i < noise.examples.size(); ++i) {
+    weighted_representations.col(noise.examples[i]) +=
+        group_representations.col(i);
+  }
+
+  vector_gradient = group_vectors * neg_weights.transpose();
+  bias_gradient = neg_weights.rowwise().sum();
+
+  return -(1 - neg_weights.array()).log().sum();
+}
+
 void Weights::estimateProjectionGradient(
     const boost::shared_ptr<DataSet>& examples,
     const MatrixReal& prediction_vectors,
@@ -360,11 +511,13 @@ void Weights::estimateProjectionGradient(
   int noise_samples = config->noise_samples;
   int word_width = config->representation_size;
   VectorReal unigram = metadata->getUnigram();
-  vector<vector<int>> noise_words = getNoiseWords(examples);
+  vector<NoiseSet> noise_words = getNoiseWords(examples);
 
   for (size_t i = 0; i < examples->size(); ++i) {
     words.addOutputWord(examples->wordAt(i));
-    for (int word_id : noise_words[i]) {
+  }
+  for (const auto& noise : noise_words) {
+    for (int word_id : noise.samples) {
       words.addOutputWord(word_id);
     }
   }
@@ -383,24 +536,32 @@ void Weights::estimateProjectionGradient(
 
     objective -= log(1 - pos_weight);
 
-    gradient->R.col(word_id) -= pos_weight * prediction_vectors.col(i);
+    gradient->outputGradient(word_id) -= pos_weight * prediction_vectors.col(i);
     gradient->B(word_id) -= pos_weight;
+  }
 
-    for (int j = 0; j < noise_samples; ++j) {
-      int noise_word_id = noise_words[i][j];
-      Real log_neg_prob = R.col(noise_word_id).dot(prediction_vectors.col(i)) +
-                          B(noise_word_id);
-      Real neg_prob = exp(log_neg_prob);
-      assert(neg_prob <= numeric_limits<Real>::max());
-
-      Real neg_weight =
-          neg_prob / (neg_prob + noise_samples * unigram(noise_word_id));
-      weighted_representations.col(i) += neg_weight * R.col(noise_word_id);
-
-      objective -= log(1 - neg_weight);
+  for (const auto& noise : noise_words) {
+    int num_samples = noise.samples.size();
+    MatrixReal noise_vectors(word_width, num_samples);
+    VectorReal noise_biases(num_samples), noise_probs(num_samples);
+    for (int j = 0; j < num_samples; ++j) {
+      int word_id = noise.samples[j];
+      noise_vectors.col(j) = R.col(word_id);
+      noise_biases(j) = B(word_id);
+      noise_probs(j) = noise_samples * unigram(word_id);
+    }
 
-      gradient->R.col(noise_word_id) += neg_weight * prediction_vectors.col(i);
-      gradient->B(noise_word_id) += neg_weight;
+    MatrixReal vector_gradient;
+    VectorReal bias_gradient;
+    objective += getNoiseGradient(noise, prediction_vectors, noise_vectors,
+                                  noise_biases, noise_probs,
+                                  weighted_representations, vector_gradient,
+                                  bias_gradient);
+
+    for (int j = 0; j < num_samples; ++j) {
+      int word_id = noise.samples[j];
+      gradient->outputGradient(word_id) += vector_gradient.col(j);
+      gradient->B(word_id) += bias_gradient(j);
     }
   }
 }
@@ -421,8 +582,8 @@ void Weights::estimateGradient(const boost::shared_ptr<DataSet>& examples,
   estimateProjectionGradient(examples, prediction_vectors, gradient,
                              weighted_representations, objective, words);
 
-  weighted_representations.array() *=
-      activationDerivative(config->activation, prediction_vectors);
+  multiplyActivationDerivative(config->activation, prediction_vectors,
+                               weighted_representations);
 
   getContextGradient(examples->size(), contexts, context_vectors,
                      weighted_representations, gradient);
@@ -432,7 +593,7 @@ void Weights::syncUpdate(const MinibatchWords& words,
                          const boost::shared_ptr<Weights>& gradient) {
   for (int word_id : words.getContextWordsSet()) {
     lock_guard<mutex> lock(*mutexesQ[word_id]);
-    Q.col(word_id) += gradient->Q.col(word_id);
+    Q.col(word_id) += gradient->contextGradient(word_id);
   }
 
   for (int i = 0; i < C.size(); ++i) {
@@ -442,7 +603,7 @@ void Weights::syncUpdate(const MinibatchWords& words,
 
   for (int word_id : words.getOutputWordsSet()) {
     lock_guard<mutex> lock(*mutexesR[word_id]);
-    R.col(word_id) += gradient->R.col(word_id);
+    R.col(word_id) += gradient->outputGradient(word_id);
   }
 
   lock_guard<mutex> lock(*mutexB);
@@ -476,15 +637,23 @@ void Weights::updateSquared(const MinibatchWords& global_words,
 void Weights::updateAdaGrad(const MinibatchWords& global_words,
                             const boost::shared_ptr<Weights>& global_gradient,
                             const boost::shared_ptr<Weights>& adagrad) {
+  double norm_change = 0;
   for (int word_id : global_words.getContextWords()) {
+    decayVector(Q, decayStepsQ, mutexesQ, word_id);
+    norm_change -= Q.col(word_id).squaredNorm();
     Q.col(word_id) -= global_gradient->Q.col(word_id).binaryExpr(
         adagrad->Q.col(word_id), CwiseAdagradUpdateOp<Real>(config->step_size));
+    norm_change += Q.col(word_id).squaredNorm();
   }
 
   for (int word_id : global_words.getOutputWords()) {
+    decayVector(R, decayStepsR, mutexesR, word_id);
+    norm_change -= R.col(word_id).squaredNorm();
     R.col(word_id) -= global_gradient->R.col(word_id).binaryExpr(
         adagrad->R.col(word_id), CwiseAdagradUpdateOp<Real>(config->step_size));
+    norm_change += R.col(word_id).squaredNorm();
   }
+  updateDecayedNorm(norm_change);
 
   Block block = getBlock(Q.size() + R.size(), W.size() - (Q.size() + R.size()));
   W.segment(block.first, block.second) -=
@@ -497,16 +666,137 @@ Real Weights::regularizerUpdate(
     const MinibatchWords& global_words,
     const boost::shared_ptr<Weights>& global_gradient, Real minibatch_factor) {
   Real sigma = minibatch_factor * config->step_size * config->l2_lbl;
-  Block block = getBlock(0, W.size());
+  Block block = getBlock(Q.size() + R.size(), W.size() - (Q.size() + R.size()));
   W.segment(block.first, block.second) -=
       W.segment(block.first, block.second) * sigma;
 
   Real sum = W.segment(block.first, block.second).array().square().sum();
+
+  // The word vectors are only decayed when they are next accessed. No other
+  // thread accesses them while the regularizer is updated, and the caller
+  // waits for the master thread before the next minibatch.
+  #pragma omp master
+  {
+    decay.push_back(decay.back() + log(1 - sigma));
+    if (decay.back() < -50) {
+      // Decay all the word vectors to keep the scaled norm representable.
+      for (int word_id = 0; word_id < Q.cols(); ++word_id) {
+        decayVector(Q, decayStepsQ, mutexesQ, word_id);
+      }
+      for (int word_id = 0; word_id < R.cols(); ++word_id) {
+        decayVector(R, decayStepsR, mutexesR, word_id);
+      }
+      resetDecay();
+    }
+
+    sum += exp(2 * decay.back()) * decayedNorm;
+  }
+
   return 0.5 * minibatch_factor * config->l2_lbl * sum;
 }
 
+void Weights::applyPendingDecay(const boost::shared_ptr<DataSet>& examples) {
+  decayContextVectors(examples);
+  // The full softmax and the noise samples may read any output word vector.
+  for (int word_id = 0; word_id < R.cols(); ++word_id) {
+    decayVector(R, decayStepsR, mutexesR, word_id);
+  }
+}
+
+void Weights::applyAllPendingDecay() {
+  Block block = getBlock(0, Q.cols());
+  for (size_t i = 0; i < block.second; ++i) {
+    decayVector(Q, decayStepsQ, mutexesQ, block.first + i);
+  }
+
+  block = getBlock(0, R.cols());
+  for (size_t i = 0; i < block.second; ++i) {
+    decayVector(R, decayStepsR, mutexesR, block.first + i);
+  }
+}
+
+void Weights::decayContextVectors(const boost::shared_ptr<DataSet>& examples) {
+  for (size_t i = 0; i < examples->size(); ++i) {
+    for (const auto& features : examples->contextAt(i).features) {
+      for (int word_id : features) {
+        decayVector(Q, decayStepsQ, mutexesQ, word_id);
+      }
+    }
+  }
+}
+
+void Weights::decayOutputVector(int word_id) {
+  decayVector(R, decayStepsR, mutexesR, word_id);
+}
+
+void Weights::decayVector(WordVectorsType& vectors,
+                          vector<atomic<int>>& steps,
+                          const vector<Mutex>& mutexes, int word_id) {
+  int last_step = decay.size() - 1;
+  // Most word vectors are already up to date, so the lock is only taken when
+  // the vector may need to be decayed. The step is released only after the
+  // vector is scaled, so a vector seen as up to date here is fully decayed.
+  if (steps[word_id].load(memory_order_acquire) == last_step) {
+    return;
+  }
+
+  lock_guard<mutex> lock(*mutexes[word_id]);
+  int step = steps[word_id].load(memory_order_relaxed);
+  if (step != last_step) {
+    vectors.col(word_id) *= exp(decay[last_step] - decay[step]);
+    steps[word_id].store(last_step, memory_order_release);
+  }
+}
+
+void Weights::updateDecayedNorm(double norm_change) {
+  norm_change *= exp(-2 * decay.back());
+  #pragma omp atomic
+  decayedNorm += norm_change;
+}
+
+void Weights::asyncUpdate(const MinibatchWords& words,
+                          const boost::shared_ptr<Weights>& gradient,
+                          const boost::shared_ptr<Weights>& adagrad) {
+  double norm_change = 0;
+  for (int word_id : words.getContextWordsSet()) {
+    VectorRealMap word_gradient = gradient->contextGradient(word_id);
+    adagrad->Q.col(word_id).array() += word_gradient.array().square();
+    decayVector(Q, decayStepsQ, mutexesQ, word_id);
+    norm_change -= Q.col(word_id).squaredNorm();
+    Q.col(word_id) -= word_gradient.binaryExpr(
+        adagrad->Q.col(word_id), CwiseAdagradUpdateOp<Real>(config->step_size));
+    norm_change += Q.col(word_id).squaredNorm();
+  }
+
+  for (int word_id : words.getOutputWordsSet()) {
+    VectorRealMap word_gradient = gradient->outputGradient(word_id);
+    adagrad->R.col(word_id).array() += word_gradient.array().square();
+    decayVector(R, decayStepsR, mutexesR, word_id);
+    norm_change -= R.col(word_id).squaredNorm();
+    R.col(word_id) -= word_gradient.binaryExpr(
+        adagrad->R.col(word_id), CwiseAdagradUpdateOp<Real>(config->step_size));
+    norm_change += R.col(word_id).squaredNorm();
+  }
+  updateDecayedNorm(norm_change);
+
+  // The word vectors of a sparse gradient are not part of its dense block.
+  size_t start = Q.size() + R.size();
+  size_t dense_size = W.size() - start;
+  size_t gradient_start = gradient->Q.size() + gradient->R.size();
+  adagrad->W.segment(start, dense_size).array() +=
+      gradient->W.segment(gradient_start, dense_size).array().square();
+  W.segment(start, dense_size) -=
+      gradient->W.segment(gradient_start, dense_size)
+          .binaryExpr(adagrad->W.segment(start, dense_size),
+                      CwiseAdagradUpdateOp<Real>(config->step_size));
+}
+
 void Weights::clear(const MinibatchWords& words, bool parallel_update) {
-  if (parallel_update) {
+  if (sparse) {
+    sparseQ.clear();
+    sparseR.clear();
+    W.setZero();
+  } else if (parallel_update) {
     for (int word_id : words.getContextWords()) {
       Q.col(word_id).setZero();
     }
@@ -531,6 +821,53 @@ void Weights::clear(const MinibatchWords& words, bool parallel_update) {
   }
 }
 
+void Weights::quantize(Quantization quantization) {
+  if (quantization == Quantization::none || !hasDenseWordVectors()) {
+    return;
+  }
+
+  size_t float_bytes = (Q.size() + R.size()) * sizeof(Real);
+  quantizedQ = boost::make_shared<QuantizedMatrix>(
+      Q.data(), Q.rows(), Q.cols(), quantization);
+  quantizedR = boost::make_shared<QuantizedMatrix>(
+      R.data(), R.rows(), R.cols(), quantization);
+
+  // Keep only the context transforms and the biases in the dense block.
+  int word_vectors_size = Q.size() + R.size();
+  Real* old_data = data;
+  size -= word_vectors_size;
+  data = new Real[size];
+  memcpy(data, old_data + word_vectors_size, size * sizeof(Real));
+  delete[] old_data;
+
+  mutexesQ.clear();
+  mutexesR.clear();
+  setModelParameters();
+  resetDecay();
+
+  cerr << "Quantized word vectors: "
+       << static_cast<double>(quantizedQ->bytes() + quantizedR->bytes()) /
+              (1 << 20)
+       << " MB instead of " << static_cast<double>(float_bytes) / (1 << 20)
+       << " MB" << endl;
+}
+
+VectorRealMap Weights::contextGradient(int word_id) {
+  if (sparse) {
+    return sparseQ.col(word_id);
+  }
+
+  return VectorRealMap(Q.col(word_id).data(), Q.rows());
+}
+
+VectorRealMap Weights::outputGradient(int word_id) {
+  if (sparse) {
+    return sparseR.col(word_id);
+  }
+
+  return VectorRealMap(R.col(word_id).data(), R.rows());
+}
+
 VectorReal Weights::getPredictionVector(const Context& context) const {
   int context_width = config->ngram_order - 1;
   int word_width = config->representation_size;
@@ -540,7 +877,7 @@ VectorReal Weights::getPredictionVector(const Context& context) const {
   for (int i = 0; i < context_width; ++i) {
     VectorReal in_vector = VectorReal::Zero(word_width);
     for (auto feat : context.features[i]) {
-      in_vector += Q.col(feat);
+      addContextVector(feat, in_vector.data());
     }
 
     if (config->diagonal_contexts) {
@@ -550,26 +887,84 @@ VectorReal Weights::getPredictionVector(const Context& context) const {
     }
   }
 
-  return applyActivation<VectorReal>(config->activation, prediction_vector);
+  applyActivationInPlace(config->activation, prediction_vector);
+  return prediction_vector;
+}
+
+VectorReal Weights::getPredictionVector(const FlatContext& context) const {
+  int context_width = config->ngram_order - 1;
+  int word_width = config->representation_size;
+
+  VectorReal prediction_vector = VectorReal::Zero(word_width);
+  VectorReal in_vector(word_width);
+  for (int i = 0; i < context_width; ++i) {
+    in_vector.setZero();
+    for (const int* feat = context.begin(i); feat != context.end(i); ++feat) {
+      addContextVector(*feat, in_vector.data());
+    }
+
+    if (config->diagonal_contexts) {
+      prediction_vector += C[i].asDiagonal() * in_vector;
+    } else {
+      prediction_vector += C[i] * in_vector;
+    }
+  }
+
+  applyActivationInPlace(config->activation, prediction_vector);
+  return prediction_vector;
+}
+
+void Weights::addContextVector(int feature_id, Real* out) const {
+  if (quantizedQ) {
+    quantizedQ->addColumn(feature_id, out);
+  } else {
+    VectorRealMap(out, Q.rows()) += Q.col(feature_id);
+  }
+}
+
+MatrixReal Weights::getOutputScores(
+    int start, int size, const MatrixReal& prediction_vectors) const {
+  if (quantizedR) {
+    return quantizedR->transposeProduct(start, size, prediction_vectors);
+  }
+
+  return R.middleCols(start, size).transpose() * prediction_vectors;
+}
+
+VectorReal Weights::getOutputScores(
+    int start, int size, const VectorReal& prediction_vector) const {
+  if (quantizedR) {
+    return quantizedR->transposeProduct(start, size, prediction_vector);
+  }
+
+  return R.middleCols(start, size).transpose() * prediction_vector;
+}
+
+Real Weights::getOutputScore(
+    int word_id, const VectorReal& prediction_vector) const {
+  if (quantizedR) {
+    return quantizedR->dot(word_id, prediction_vector);
+  }
+
+  return R.col(word_id).dot(prediction_vector);
 }
 
 Real Weights::predict(int word, Context context) const {
   VectorReal prediction_vector = getPredictionVector(context);
-  Real prob = 0;
+  if (config->cache_size <= 0) {
+    return -logSoftMax(getOutputScores(0, vocabSize(), prediction_vector) +
+                       B)(word);
+  }
 
-  //TODO Decide if it is worth using the normalizer cache.
-  // auto ret = normalizerCache.get(context.words);
-  // if (ret.second) {
-  //  prob = (R.col(word).dot(prediction_vector) + B(word) - ret.first);
-  //} else {
+  vector<int> key = contextKey(context);
   Real normalizer = 0;
-  VectorReal word_probs =
-      logSoftMax(R.transpose() * prediction_vector + B, normalizer);
-  // normalizerCache.set(context.words, normalizer);
-  prob = word_probs(word);
-  //}
+  if (!normalizerCache.get(key, normalizer)) {
+    logSoftMax(getOutputScores(0, vocabSize(), prediction_vector) + B,
+               normalizer);
+    normalizerCache.set(key, normalizer, config->cache_size);
+  }
 
-  return -prob;
+  return -(getOutputScore(word, prediction_vector) + B(word) - normalizer);
 }
 
 Reals Weights::predict(Context context) const {
@@ -577,9 +972,11 @@ Reals Weights::predict(Context context) const {
   Reals probs(vocabSize(), 0);
 
   Real normalizer = 0;
-  VectorReal word_probs =
-      logSoftMax(R.transpose() * prediction_vector + B, normalizer);
-  // normalizerCache.set(context.words, normalizer);
+  VectorReal word_probs = logSoftMax(
+      getOutputScores(0, vocabSize(), prediction_vector) + B, normalizer);
+  if (config->cache_size > 0) {
+    normalizerCache.set(contextKey(context), normalizer, config->cache_size);
+  }
   for (int i = 0; i < vocabSize(); ++i) {
     probs[i] = -word_probs(i);
   }
@@ -589,17 +986,21 @@ Reals Weights::predict(Context context) const {
 
 Reals Weights::predictViterbi(Context context) const {
   Reals probs(vocabSize(), std::numeric_limits<Real>::max());
-  int num_words = config->max_beam_increment;
+  int num_words = min(config->max_beam_increment, vocabSize());
 
-  // Here computing a softmax is too expensive.
   VectorReal prediction_vector = getPredictionVector(context);
-  VectorReal word_probs = R.transpose() * prediction_vector + B;
-  for (int cw = 0; cw < num_words; ++cw) {
-    int word_id = word_probs.maxCoeff();
-    Real word_prob = word_probs(word_id);
-    word_probs(word_id) = std::numeric_limits<Real>::min();
-
-    probs[word_id] = -log(word_prob);
+  VectorReal word_probs =
+      logSoftMax(getOutputScores(0, vocabSize(), prediction_vector) + B);
+
+  // Partial selection of the most likely words.
+  vector<int> words(word_probs.size());
+  iota(words.begin(), words.end(), 0);
+  partial_sort(words.begin(), words.begin() + num_words, words.end(),
+               [&word_probs](int a, int b) {
+                 return word_probs(a) > word_probs(b);
+               });
+  for (int i = 0; i < num_words; ++i) {
+    probs[words[i]] = -word_probs(words[i]);
   }
 
   return probs;
@@ -609,6 +1010,12 @@ int Weights::vocabSize() const { return config->vocab_size; }
 
 void Weights::clearCache() { normalizerCache.clear(); }
 
+void Weights::printCacheStats() const {
+  cerr << "Normalizer cache: " << normalizerCache.numHits() << " hits, "
+       << normalizerCache.numMisses() << " misses, hit rate "
+       << normalizerCache.hitRate() << endl;
+}
+
 MatrixReal Weights::getWordVectors() const { return R; }
 
 MatrixReal Weights::getFeatureVectors() const { return Q; }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <vector>
 
@@ -8,11 +9,15 @@
 #include <boost/thread/tss.hpp>
 
 #include "corpus/data_set.h"
+#include "corpus/flat_context.h"
 #include "utils/random.h"
 
 #include "lbl/context_cache.h"
+#include "lbl/hidden_layer.h"
 #include "lbl/metadata.h"
 #include "lbl/minibatch_words.h"
+#include "lbl/quantized_matrix.h"
+#include "lbl/sparse_columns.h"
 #include "lbl/utils.h"
 #include "lbl/word_distributions.h"
 
@@ -26,13 +31,23 @@ typedef Eigen::Map<VectorReal> WeightsType;
 typedef boost::shared_ptr<mutex> Mutex;
 typedef pair<size_t, size_t> Block;
 
+// Noise samples shared by a group of examples in noise contrastive
+// estimation.
+struct NoiseSet {
+  vector<int> examples;
+  vector<int> samples;
+};
+
 // Implements a neural language model.
 class Weights {
  public:
   Weights();
 
+  // Sparse weights store the word vectors only for the words they are
+  // accessed for, and are meant for per thread gradients.
   Weights(const boost::shared_ptr<ModelConfig>& config,
-          const boost::shared_ptr<Metadata>& metadata, bool init);
+          const boost::shared_ptr<Metadata>& metadata, bool init,
+          bool sparse = false);
 
   Weights(const Weights& other);
 
@@ -61,23 +76,58 @@ class Weights {
                      const boost::shared_ptr<Weights>& global_gradient,
                      const boost::shared_ptr<Weights>& adagrad);
 
+  // The L2 decay of the word vectors is applied lazily: a word vector is
+  // only decayed when it is next read or written, see applyPendingDecay.
   Real regularizerUpdate(const MinibatchWords& global_words,
                          const boost::shared_ptr<Weights>& global_gradient,
                          Real minibatch_factor);
 
+  // Applies the pending L2 decay to the word vectors read when computing the
+  // gradient of the examples. Safe to call from several threads.
+  void applyPendingDecay(const boost::shared_ptr<DataSet>& examples);
+
+  // Applies the pending L2 decay to all the word vectors. Every thread decays
+  // its own block of word vectors, so the caller must wait for all threads
+  // before the weights are saved or read outside of the training examples.
+  void applyAllPendingDecay();
+
+  // Applies the AdaGrad update of a thread's gradient directly to the shared
+  // weights, without locks. Used for asynchronous (Hogwild) training, where
+  // the occasional lost update is tolerated.
+  void asyncUpdate(const MinibatchWords& words,
+                   const boost::shared_ptr<Weights>& gradient,
+                   const boost::shared_ptr<Weights>& adagrad);
+
   void clear(const MinibatchWords& words, bool parallel_update);
 
+  // Replaces the word vectors with quantized copies to save memory when
+  // decoding. The float word vectors are released, so the weights can no
+  // longer be trained or saved afterwards.
+  void quantize(Quantization quantization);
+
   Real predict(int word, Context context) const;
 
   Reals predict(Context context) const;
 
-  // Computes the unnormalised weights of only the most likely words.
+  // Computes the probabilities of only the most likely words.
   Reals predictViterbi(Context context) const;
 
+  // Computes the hidden layer of a batch of contexts once, so that it can be
+  // shared by all the output layers conditioning on these contexts.
+  void getHiddenLayer(const FlatContextBatch& contexts,
+                      HiddenLayer& hidden) const;
+
+  // Computes the hidden layer of the same contexts with one more feature
+  // added to their last position, reusing the sums of the other positions.
+  void extendHiddenLayer(const HiddenLayer& hidden, const Words& features,
+                         HiddenLayer& extended) const;
+
   int vocabSize() const;
 
   void clearCache();
 
+  void printCacheStats() const;
+
   MatrixReal getWordVectors() const;
 
   MatrixReal getFeatureVectors() const;
@@ -103,6 +153,13 @@ class Weights {
   MatrixReal getPredictionVectors(
       size_t prediction_size, const vector<MatrixReal>& context_vectors) const;
 
+  // Computes the prediction vectors of a batch of contexts at test time.
+  MatrixReal getPredictionVectors(const FlatContextBatch& contexts) const;
+
+  // Sums of the transformed context representations of a batch of contexts,
+  // before the activation.
+  MatrixReal getPredictionInputs(const FlatContextBatch& contexts) const;
+
   MatrixReal getContextProduct(int index, const MatrixReal& representations,
                                bool transpose = false) const;
 
@@ -128,9 +185,23 @@ class Weights {
                           const MatrixReal& weighted_representations,
                           const boost::shared_ptr<Weights>& gradient) const;
 
-  virtual vector<vector<int>> getNoiseWords(
+  // Samples noise_samples noise words for every example, or once for all
+  // the examples if the noise is shared.
+  virtual vector<NoiseSet> getNoiseWords(
       const boost::shared_ptr<DataSet>& examples) const;
 
+  // Computes the noise contrastive estimation terms of the noise samples of a
+  // group of examples with one matrix product. Returns the objective, and the
+  // gradient of the noise vectors and biases with one column per sample.
+  Real getNoiseGradient(const NoiseSet& noise,
+                        const MatrixReal& prediction_vectors,
+                        const MatrixReal& noise_vectors,
+                        const VectorReal& noise_biases,
+                        const VectorReal& noise_probs,
+                        MatrixReal& weighted_representations,
+                        MatrixReal& vector_gradient,
+                        VectorReal& bias_gradient) const;
+
   void estimateProjectionGradient(const boost::shared_ptr<DataSet>& examples,
                                   const MatrixReal& prediction_vectors,
                                   const boost::shared_ptr<Weights>& gradient,
@@ -139,9 +210,47 @@ class Weights {
 
   VectorReal getPredictionVector(const Context& context) const;
 
+  VectorReal getPredictionVector(const FlatContext& context) const;
+
+  // Adds the context vector of a feature to out. The prediction methods read
+  // the word vectors only through these helpers, so that they also work on
+  // quantized weights.
+  void addContextVector(int feature_id, Real* out) const;
+
+  // Scores of the output words [start, start + size) without the biases.
+  MatrixReal getOutputScores(int start, int size,
+                             const MatrixReal& prediction_vectors) const;
+
+  VectorReal getOutputScores(int start, int size,
+                             const VectorReal& prediction_vector) const;
+
+  Real getOutputScore(int word_id, const VectorReal& prediction_vector) const;
+
+  // Gradient columns of the context and output word vectors.
+  VectorRealMap contextGradient(int word_id);
+
+  VectorRealMap outputGradient(int word_id);
+
+  void decayContextVectors(const boost::shared_ptr<DataSet>& examples);
+
+  void decayOutputVector(int word_id);
+
  private:
   void allocate();
 
+  // Whether the word vectors are stored in the dense parameter block, rather
+  // than as sparse columns or quantized copies.
+  bool hasDenseWordVectors() const;
+
+  void resetDecay();
+
+  void decayVector(WordVectorsType& vectors, vector<atomic<int>>& steps,
+                   const vector<Mutex>& mutexes, int word_id);
+
+  // Accounts for the change of a word vector's squared norm in the L2 term
+  // of the objective.
+  void updateDecayedNorm(double norm_change);
+
   void setModelParameters();
 
   Block getBlock(int start, int size) const;
@@ -150,6 +259,7 @@ class Weights {
 
   template <class Archive>
   void save(Archive& ar, const unsigned int version) const {
+    assert(!quantizedQ);
     ar << config;
     ar << metadata;
 
@@ -168,6 +278,7 @@ class Weights {
     ar >> boost::serialization::make_array(data, size);
 
     setModelParameters();
+    resetDecay();
   }
 
   BOOST_SERIALIZATION_SPLIT_MEMBER();
@@ -182,16 +293,30 @@ class Weights {
   WeightsType B;
   WeightsType W;
 
-  mutable ContextCache normalizerCache;
+  mutable NormalizerCache normalizerCache;
 
  private:
   int size;
   Real* data;
+  bool sparse;
+  SparseColumns sparseQ;
+  SparseColumns sparseR;
+  boost::shared_ptr<QuantizedMatrix> quantizedQ;
+  boost::shared_ptr<QuantizedMatrix> quantizedR;
   vector<Mutex> mutexesC;
   vector<Mutex> mutexesQ;
   vector<Mutex> mutexesR;
   Mutex mutexB;
 
+  // Cumulative log decay after every regularizer update, the update each
+  // word vector was last decayed at and the sum of the squared norms of the
+  // word vectors, scaled by exp(-2 * decay.back()). The steps are read
+  // without locking, so they are atomic.
+  vector<double> decay;
+  vector<atomic<int>> decayStepsQ;
+  vector<atomic<int>> decayStepsR;
+  double decayedNorm;
+
   mutable boost::thread_specific_ptr<WordDistributions> wordDists;
 };
 
@@ -8,9 +8,8 @@ WordDistributions::WordDistributions(
   for (size_t i = 0; i < index->getNumClasses(); ++i) {
     int class_start = index->getClassMarker(i);
     int class_size = index->getClassSize(i);
-    dists.push_back(
-        discrete_distribution<int>(unigram.data() + class_start,
-                                   unigram.data() + class_start + class_size));
+    dists.push_back(AliasSampler(unigram.data() + class_start,
+                                 unigram.data() + class_start + class_size));
   }
 }
 
@@ -18,9 +17,9 @@ WordDistributions::WordDistributions(const VectorReal& unigram)
     : gen(0), dist(unigram.data(), unigram.data() + unigram.size()) {}
 
 int WordDistributions::sample(int class_id) {
-  return index->getClassMarker(class_id) + dists[class_id](gen);
+  return index->getClassMarker(class_id) + dists[class_id].sample(gen);
 }
 
-int WordDistributions::sample() { return dist(gen); }
+int WordDistributions::sample() { return dist.sample(gen); }
 
 }  // namespace oxlm
@@ -3,6 +3,7 @@
 #include <random>
 #include <vector>
 
+#include "lbl/alias_sampler.h"
 #include "lbl/utils.h"
 #include "lbl/word_to_class_index.h"
 
@@ -23,8 +24,8 @@ class WordDistributions {
   boost::shared_ptr<WordToClassIndex> index;
 
   mt19937 gen;
-  vector<discrete_distribution<int>> dists;
-  discrete_distribution<int> dist;
+  vector<AliasSampler> dists;
+  AliasSampler dist;
 };
 
 }  // namespace oxlm
@@ -0,0 +1,152 @@
+#ifndef _PYP_CONTEXT_TABLE_H_
+#define _PYP_CONTEXT_TABLE_H_
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace oxlm {
+
+// Open-addressing hash table from fixed-size keys to int32 values, used by
+// PYPLM to find the restaurant of a context. Keys and values are stored in two
+// flat arrays of power-of-two size and collisions are resolved with linear
+// probing, so a lookup touches one or two cache lines instead of chasing the
+// node and key pointers of std::unordered_map. Erased entries are removed by
+// shifting the rest of their probe sequence back, so no tombstones are left.
+// The value kEmpty is reserved to mark unused slots.
+template <class Key, class Hash>
+class context_table {
+ public:
+  static const int32_t kEmpty = std::numeric_limits<int32_t>::min();
+
+  context_table() : size_(0), shift_(64 - kMinBits) {
+    keys_.resize(1 << kMinBits);
+    values_.assign(1 << kMinBits, kEmpty);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  // Returns a pointer to the value of the key, or nullptr if the key is not
+  // in the table. The pointer is invalidated by insertions and erasures.
+  int32_t* find(const Key& key) {
+    size_t slot = find_slot(key);
+    return values_[slot] == kEmpty ? nullptr : &values_[slot];
+  }
+
+  const int32_t* find(const Key& key) const {
+    size_t slot = find_slot(key);
+    return values_[slot] == kEmpty ? nullptr : &values_[slot];
+  }
+
+  // Inserts a key which is not in the table yet.
+  void insert(const Key& key, int32_t value) {
+    assert(value != kEmpty);
+    if ((size_ + 1) * 4 > values_.size() * 3) {
+      grow();
+    }
+
+    size_t slot = find_slot(key);
+    assert(values_[slot] == kEmpty);
+    keys_[slot] = key;
+    values_[slot] = value;
+    ++size_;
+  }
+
+  void erase(const Key& key) {
+    size_t mask = values_.size() - 1;
+    size_t slot = find_slot(key);
+    assert(values_[slot] != kEmpty);
+
+    // Moves back the entries of the probe sequence which would no longer be
+    // reachable from their home slot.
+    size_t next = slot;
+    while (true) {
+      next = (next + 1) & mask;
+      if (values_[next] == kEmpty) {
+        break;
+      }
+
+      size_t home = home_slot(keys_[next]);
+      if (((next - home) & mask) >= ((next - slot) & mask)) {
+        keys_[slot] = keys_[next];
+        values_[slot] = values_[next];
+        slot = next;
+      }
+    }
+
+    values_[slot] = kEmpty;
+    --size_;
+  }
+
+  // Calls f(key, value) for every entry, in no particular order.
+  template <class F>
+  void for_each(F f) const {
+    for (size_t i = 0; i < values_.size(); ++i) {
+      if (values_[i] != kEmpty) {
+        f(keys_[i], values_[i]);
+      }
+    }
+  }
+
+  template<class Archive> void serialize(Archive& ar, const unsigned int) {
+    ar & keys_;
+    ar & values_;
+    ar & size_;
+    ar & shift_;
+  }
+
+ private:
+  static const int kMinBits = 4;
+
+  // Fibonacci hashing spreads the low entropy hashes of the word ids over the
+  // high bits which index the slots.
+  size_t home_slot(const Key& key) const {
+    return (static_cast<uint64_t>(Hash()(key)) * 0x9e3779b97f4a7c15ull) >>
+           shift_;
+  }
+
+  // Returns the slot of the key, or the empty slot where it would be inserted.
+  size_t find_slot(const Key& key) const {
+    size_t mask = values_.size() - 1;
+    size_t slot = home_slot(key);
+    while (values_[slot] != kEmpty && !(keys_[slot] == key)) {
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  void grow() {
+    std::vector<Key> keys(keys_.size() * 2);
+    std::vector<int32_t> values(values_.size() * 2, kEmpty);
+    keys.swap(keys_);
+    values.swap(values_);
+    --shift_;
+
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (values[i] != kEmpty) {
+        size_t slot = find_slot(keys[i]);
+        keys_[slot] = keys[i];
+        values_[slot] = values[i];
+      }
+    }
+  }
+
+  std::vector<Key> keys_;
+  std::vector<int32_t> values_;
+  size_t size_;
+  int shift_;
+};
+
+template <class Key, class Hash>
+const int32_t context_table<Key, Hash>::kEmpty;
+
+}  // namespace oxlm
+
+#endif
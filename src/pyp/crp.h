@@ -7,6 +7,7 @@
 #include <cmath>
 #include <utility>
 #include <unordered_map>
+#include <vector>
 #include <functional>
 
 #include "utils/random.h"
@@ -16,6 +17,61 @@
 
 namespace oxlm {
 
+// Sufficient statistics of the seating arrangements of a set of restaurants
+// which share their hyperparameters. The log likelihood of the restaurants
+// only depends on how many restaurants have a given number of customers or
+// tables and on how many tables seat a given number of customers, so it can
+// be evaluated in time linear in the number of distinct counts.
+struct crp_statistics {
+  crp_statistics() : restaurants(), tables(), dish_tables_llh() {}
+
+  void add_restaurant(unsigned num_customers, unsigned num_tables) {
+    ++restaurants;
+    tables += num_tables;
+    ++customer_counts[num_customers];
+    ++table_counts[num_tables];
+  }
+
+  void add_tables(unsigned customers_per_table, unsigned num_tables) {
+    table_sizes[customers_per_table] += num_tables;
+  }
+
+  // Sum of the log likelihoods of the restaurants, excluding any priors.
+  double log_likelihood(const double& discount, const double& strength) const {
+    if (!restaurants) return 0.0;
+    double lp = 0.0;
+    if (discount > 0.0) {
+      const double r = lgamma(1.0 - discount);
+      if (strength)
+        lp += restaurants * (lgamma(strength) - lgamma(strength / discount));
+      lp += tables * log(discount);
+      for (auto& count : customer_counts)
+        lp -= lgamma(strength + count.first) * count.second;
+      for (auto& count : table_counts)
+        lp += lgamma(strength / discount + count.first) * count.second;
+      for (auto& count : table_sizes)
+        lp += (lgamma(count.first - discount) - r) * count.second;
+    } else if (!discount) {
+      lp += restaurants * lgamma(strength) + tables * log(strength) +
+            dish_tables_llh;
+      for (auto& count : table_counts)
+        lp -= lgamma(strength + count.first) * count.second;
+    } else { // should never happen
+      assert(!"discount less than 0 detected!");
+    }
+    return lp;
+  }
+
+  unsigned restaurants;
+  unsigned long tables;
+  // Only used by the Dirichlet process, for which it does not depend on the
+  // hyperparameters.
+  double dish_tables_llh;
+  std::unordered_map<unsigned, unsigned> customer_counts;
+  std::unordered_map<unsigned, unsigned> table_counts;
+  std::unordered_map<unsigned, unsigned> table_sizes;
+};
+
 // Chinese restaurant process (Pitman-Yor parameters) histogram-based table tracking
 // based on the implementation proposed by Blunsom et al. 2009
 //
@@ -228,6 +284,33 @@ class crp {
     }
   }
 
+  // Replaces the base probabilities p0 of the dishes [0, p0.size()) with their
+  // probabilities in this restaurant, visiting every seated dish only once.
+  template <typename F>
+  void probs(std::vector<F>& p0) const {
+    if (num_tables_ == 0) return;
+    const F r = F(num_tables_ * discount_ + strength_);
+    const F z = F(num_customers_ + strength_);
+
+    std::vector<std::pair<Dish, F>> seated;
+    seated.reserve(dish_locs_.size());
+    for (const auto& dish_loc : dish_locs_) {
+      if (dish_loc.first < p0.size()) {
+        const crp_table_manager<1>& loc = dish_loc.second;
+        seated.push_back(std::make_pair(dish_loc.first,
+            (F(loc.num_customers() - discount_ * loc.num_tables()) +
+             r * p0[dish_loc.first]) / z));
+      }
+    }
+
+    for (F& p : p0) {
+      p = r * p / z;
+    }
+    for (const auto& dish_prob : seated) {
+      p0[dish_prob.first] = dish_prob.second;
+    }
+  }
+
   double log_likelihood() const {
     return llh_;
 //    return log_likelihood(discount_, strength_);
@@ -303,6 +386,18 @@ class crp {
     return lp;
   }
 
+  // Adds the seating arrangement of the restaurant to the statistics of the
+  // restaurants it shares its hyperparameters with.
+  void add_statistics(crp_statistics& stats) const {
+    if (!num_customers_) return;
+    stats.add_restaurant(num_customers_, num_tables_);
+    for (auto& dish_loc : dish_locs_) {
+      for (auto& bin : dish_loc.second.h[0])
+        stats.add_tables(bin.first, bin.second);
+      stats.dish_tables_llh += lgamma(dish_loc.second.num_tables());
+    }
+  }
+
   template<typename Engine>
   void resample_hyperparameters(Engine& eng, const unsigned nloop = 5, const unsigned niterations = 10) {
     assert(has_discount_prior() || has_strength_prior());
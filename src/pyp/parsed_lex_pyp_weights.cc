@@ -24,9 +24,12 @@ Reals ParsedLexPypWeights<wOrder, tOrder, aOrder>::predict(
 template <unsigned wOrder, unsigned tOrder, unsigned aOrder>
 Reals ParsedLexPypWeights<wOrder, tOrder, aOrder>::predictWord(
     Context context) const {
+  std::vector<double> probs(numWords());
+  lex_lm_.probs(context.words, probs);
+
   Reals weights(numWords(), 0);
   for (int i = 0; i < numWords(); ++i) {
-    weights[i] = predictWord(i, context);
+    weights[i] = -std::log(probs[i]);
   }
   return weights;
 }
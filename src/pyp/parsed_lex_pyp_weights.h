@@ -12,6 +12,8 @@ class ParsedLexPypWeights : public ParsedPypWeights<tOrder, aOrder> {
  public:
   ParsedLexPypWeights(boost::shared_ptr<Dict> dict, size_t num_actions);
 
+  using ParsedPypWeights<tOrder, aOrder>::predictWord;
+
   Real predict(WordId word, Context context) const override;
 
   Reals predict(Context context) const override;
@@ -35,11 +35,7 @@ Real ParsedPypWeights<tOrder, aOrder>::predictTag(WordId tag,
 
 template <unsigned tOrder, unsigned aOrder>
 Reals ParsedPypWeights<tOrder, aOrder>::predictTag(Context context) const {
-  Reals weights(numTags(), 0);
-  for (int i = 0; i < numTags(); ++i) {
-    weights[i] = predictTag(i, context);
-  }
-  return weights;
+  return PypWeights<tOrder>::predict(context);
 }
 
 template <unsigned tOrder, unsigned aOrder>
@@ -56,9 +52,72 @@ Real ParsedPypWeights<tOrder, aOrder>::predictAction(WordId action,
 
 template <unsigned tOrder, unsigned aOrder>
 Reals ParsedPypWeights<tOrder, aOrder>::predictAction(Context context) const {
+  std::vector<double> probs(num_actions_);
+  action_lm_.probs(context.words, probs);
+
   Reals weights(num_actions_, 0);
   for (int i = 0; i < num_actions_; ++i) {
-    weights[i] = predictAction(i, context);
+    weights[i] = -std::log(probs[i]);
+  }
+  return weights;
+}
+
+template <unsigned tOrder, unsigned aOrder>
+Real ParsedPypWeights<tOrder, aOrder>::predictWord(
+    WordId word, const FlatContext& context) const {
+  return predictWord(word, Context(context.words()));
+}
+
+template <unsigned tOrder, unsigned aOrder>
+Real ParsedPypWeights<tOrder, aOrder>::predictTag(
+    WordId tag, const FlatContext& context) const {
+  return predictTag(tag, Context(context.words()));
+}
+
+template <unsigned tOrder, unsigned aOrder>
+Reals ParsedPypWeights<tOrder, aOrder>::predictTag(
+    const FlatContext& context) const {
+  return predictTag(Context(context.words()));
+}
+
+template <unsigned tOrder, unsigned aOrder>
+Real ParsedPypWeights<tOrder, aOrder>::predictAction(
+    WordId action, const FlatContext& context) const {
+  return predictAction(action, Context(context.words()));
+}
+
+template <unsigned tOrder, unsigned aOrder>
+Reals ParsedPypWeights<tOrder, aOrder>::predictAction(
+    const FlatContext& context) const {
+  return predictAction(Context(context.words()));
+}
+
+template <unsigned tOrder, unsigned aOrder>
+Reals ParsedPypWeights<tOrder, aOrder>::predictWordBatch(
+    const Words& words, const FlatContextBatch& contexts) const {
+  Reals weights(words.size(), 0);
+  for (unsigned i = 0; i < words.size(); ++i) {
+    weights[i] = predictWord(words[i], contexts[i]);
+  }
+  return weights;
+}
+
+template <unsigned tOrder, unsigned aOrder>
+Reals ParsedPypWeights<tOrder, aOrder>::predictTagBatch(
+    const Words& tags, const FlatContextBatch& contexts) const {
+  Reals weights(tags.size(), 0);
+  for (unsigned i = 0; i < tags.size(); ++i) {
+    weights[i] = predictTag(tags[i], contexts[i]);
+  }
+  return weights;
+}
+
+template <unsigned tOrder, unsigned aOrder>
+std::vector<Reals> ParsedPypWeights<tOrder, aOrder>::predictActionBatch(
+    const FlatContextBatch& contexts) const {
+  std::vector<Reals> weights;
+  for (size_t i = 0; i < contexts.size(); ++i) {
+    weights.push_back(predictAction(contexts[i]));
   }
   return weights;
 }
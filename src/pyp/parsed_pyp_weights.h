@@ -4,6 +4,7 @@
 #include "pyp/pyp_weights.h"
 #include "corpus/dict.h"
 #include "corpus/data_point.h"
+#include "corpus/flat_context.h"
 #include "corpus/parse_data_set.h"
 #include "pyp/pyplm.h"
 
@@ -32,6 +33,28 @@ class ParsedPypWeights : public PypWeights<tOrder> {
 
   Reals predictAction(Context context) const;
 
+  // Flat context versions of the predictions, used by the decoders. Only the
+  // context words are used.
+  Real predictWord(WordId word, const FlatContext& context) const;
+
+  Real predictTag(WordId tag, const FlatContext& context) const;
+
+  Reals predictTag(const FlatContext& context) const;
+
+  Real predictAction(WordId action, const FlatContext& context) const;
+
+  Reals predictAction(const FlatContext& context) const;
+
+  // Batched versions of the predictions, scoring each context in turn.
+  Reals predictWordBatch(const Words& words,
+                         const FlatContextBatch& contexts) const;
+
+  Reals predictTagBatch(const Words& tags,
+                        const FlatContextBatch& contexts) const;
+
+  std::vector<Reals> predictActionBatch(
+      const FlatContextBatch& contexts) const;
+
   virtual Real wordLikelihood() const;
 
   Real tagLikelihood() const;
@@ -14,9 +14,13 @@ Real PypWeights<kOrder>::predict(WordId word, Context context) const {
 
 template <unsigned kOrder>
 Reals PypWeights<kOrder>::predict(Context context) const {
+  std::vector<double> probs(vocab_size_);
+  lm_.probs(context.words, probs);
+
   Reals weights(vocab_size_, 0);
   for (int i = 0; i < vocab_size_; ++i) {
-    weights[i] = predict(i, context.words);
+    Real prob = probs[i];
+    weights[i] = -std::log(prob);
   }
   return weights;
 }
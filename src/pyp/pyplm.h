@@ -1,12 +1,14 @@
 #ifndef HPYPLM_H_
 #define HPYPLM_H_
 
+#include <array>
+#include <deque>
 #include <vector>
-#include <unordered_map>
 
 #include "utils/m.h"
 #include "utils/random.h"
 
+#include "pyp/context_table.h"
 #include "pyp/crp.h"
 #include "pyp/tied_parameter_resampler.h"
 #include "pyp/uvector.h"
@@ -30,16 +32,21 @@ template<> struct PYPLM<0> : public UniformVocabulary {
   { out << "Uniform base CRP\n"; return out; }
 };
 
-// represents an N-gram LM
+// represents an N-gram LM. Scoring is const and keeps no state between calls,
+// so any number of threads may call prob() as long as none of them updates
+// the model at the same time.
 template <unsigned N> struct PYPLM {
-  PYPLM() : backoff(0,1,1,1,1), tr(1,1,1,1,0.8,0.0), lookup(N-1) {
+  // The N-1 most recent context words, most recent first.
+  typedef std::array<WordId, N-1> ContextKey;
+
+  PYPLM() : backoff(0,1,1,1,1), tr(1,1,1,1,0.8,0.0) {
     oxlm::MT19937 eng;
     tr.insert(&singleton_crp);  // add to resampler
     singleton_crp.increment(0, 1.0, eng);
   }
 
   explicit PYPLM(unsigned vs, double da = 1.0, double db = 1.0, double ss = 1.0, double sr = 1.0) 
-    : backoff(vs, da, db, ss, sr), tr(da, db, ss, sr, 0.8, 0.0), lookup(N-1) {
+    : backoff(vs, da, db, ss, sr), tr(da, db, ss, sr, 0.8, 0.0) {
       oxlm::MT19937 eng;
       tr.insert(&singleton_crp);  // add to resampler
       singleton_crp.increment(0, 1.0, eng);
@@ -48,60 +55,20 @@ template <unsigned N> struct PYPLM {
   template<typename Engine>
   void increment_verbose(WordId w, const std::vector<WordId>& context, Engine& eng) {
     const double bo = backoff.prob(w, context);
-    copy_context_verbose(context, lookup);
+    const ContextKey lookup = copy_context_verbose(context);
 
     std::cout << " [";
     for (auto& l: lookup)
       std::cout << l << " ";
     std::cout << "]" << std::endl;
 
-    auto it = p.find(lookup);
-    if (it == p.end()) {
-      // note the first customer of a crp but don't create a crp object
-      auto s_result = singletons.insert(make_pair(lookup, w));
-      if (s_result.second) {
-        backoff.increment(w, context, eng);
-        return;
-      }
-
-      // second customer triggers crp creation
-      it = p.insert(make_pair(lookup, oxlm::crp<unsigned>(0.8,0))).first;
-      tr.insert(&it->second);  // add to resampler
-      
-      // insert the first customer, which by definition creates a table
-      assert (it->second.num_tables() == 0);
-      it->second.increment(s_result.first->second, 1.0, eng);
-      singletons.erase(s_result.first);
-    }
-    if (it->second.increment(w, bo, eng))
-      backoff.increment(w, context, eng);
+    increment(w, context, lookup, bo, eng);
   }
 
   template<typename Engine>
   void increment(WordId w, const std::vector<WordId>& context, Engine& eng) {
     const double bo = backoff.prob(w, context);
-    copy_context(context, lookup);
-    auto it = p.find(lookup);
-    if (it == p.end()) {
-      
-      // note the first customer of a crp but don't create a crp object
-      auto s_result = singletons.insert(make_pair(lookup, w));
-      if (s_result.second) {
-        backoff.increment(w, context, eng);
-        return;
-      }
-
-      // second customer triggers crp creation
-      it = p.insert(make_pair(lookup, oxlm::crp<unsigned>(0.8,0))).first;
-      tr.insert(&it->second);  // add to resampler
-      
-      // insert the first customer, which by definition creates a table
-      assert (it->second.num_tables() == 0);
-      it->second.increment(s_result.first->second, 1.0, eng);
-      singletons.erase(s_result.first);
-    }
-    if (it->second.increment(w, bo, eng))
-      backoff.increment(w, context, eng);
+    increment(w, context, copy_context(context), bo, eng);
   }
 
   template<typename Engine>
@@ -112,22 +79,21 @@ template <unsigned N> struct PYPLM {
 
   template<typename Engine>
   void decrement(WordId w, const std::vector<WordId>& context, Engine& eng) {
-    copy_context(context, lookup);
+    const ContextKey lookup = copy_context(context);
+    int32_t* entry = contexts.find(lookup);
+    assert(entry != nullptr);
 
     // check if this is a customer of a singleton context
-    auto s_it = singletons.find(lookup);
-    if (s_it != singletons.end()) {
-      assert (s_it->second == w);
+    if (is_singleton(*entry)) {
+      assert (singleton_word(*entry) == w);
       backoff.decrement(w, context, eng);
-      singletons.erase(s_it);
+      contexts.erase(lookup);
       return;
     }
 
     // don't delete restaurants that become singleton as they will probably 
     // cease to be so shortly
-    auto it = p.find(lookup);
-    assert(it != p.end());
-    if (it->second.decrement(w, eng))
+    if (restaurants[*entry].decrement(w, eng))
       backoff.decrement(w, context, eng);
   }
 
@@ -139,25 +105,49 @@ template <unsigned N> struct PYPLM {
   }
 
   double prob(WordId w, const std::vector<WordId>& context) const {
-    copy_context(context, lookup);
+    const ContextKey lookup = copy_context(context);
     const double bo = backoff.prob(w, context);
 
+    const int32_t* entry = contexts.find(lookup);
+    if (entry == nullptr) {
+      return bo;
+    }
+
     // singletons can be scored with a default crp
-    auto s_it = singletons.find(lookup);
-    if (s_it != singletons.end()) {
+    if (is_singleton(*entry)) {
       // All singleton customers eat the dish 0, so if w matches the singleton 
       // for this context score 0, otherwise score 1 which is not in the crp.
-      return singleton_crp.prob(s_it->second == w ? 0 : 1, bo);
+      return singleton_crp.prob(singleton_word(*entry) == w ? 0 : 1, bo);
     }
 
-    auto it = p.find(lookup);
-    if (it == p.end()) {
-      return bo;
-    }
-    return it->second.prob(w, bo);
+    return restaurants[*entry].prob(w, bo);
   }
 
 
+  // Probabilities of all the words [0, out.size()) in the context, computed
+  // with one lookup per level of the backoff chain. Equal to calling prob()
+  // for every word.
+  void probs(const std::vector<WordId>& context, std::vector<double>& out) const {
+    backoff.probs(context, out);
+
+    const int32_t* entry = contexts.find(copy_context(context));
+    if (entry == nullptr) {
+      return;
+    }
+
+    if (is_singleton(*entry)) {
+      // The singleton crp only seats dish 0, which stands for the word of the
+      // singleton, so that word is swapped into place 0 while scoring.
+      WordId word = singleton_word(*entry);
+      std::swap(out[0], out[word]);
+      singleton_crp.probs(out);
+      std::swap(out[0], out[word]);
+      return;
+    }
+
+    restaurants[*entry].probs(out);
+  }
+
   double prob(WordId w, const std::vector<WordId>& in_context,
                           const std::vector<WordId>& out_context) const {
       return prob(w, out_context);
@@ -175,53 +165,103 @@ template <unsigned N> struct PYPLM {
 
   template<class Archive> void serialize(Archive& ar, const unsigned int version) {
     backoff.serialize(ar, version);
-    ar & p;
-    ar & singletons;
+    ar & contexts;
+    ar & restaurants;
     ar & singleton_crp;
   }
 
   PYPLM<N-1> backoff;
   oxlm::tied_parameter_resampler<oxlm::crp<unsigned>> tr;
-  mutable std::vector<WordId> lookup;  // thread-local
-  std::unordered_map<std::vector<WordId>, oxlm::crp<unsigned>, vector_hash> p;  // .first = context .second = CRP
-  std::unordered_map<std::vector<WordId>, WordId, vector_hash> singletons; // contexts seen exactly once
+  // Maps every context seen so far to the index of its restaurant, or to
+  // -(w + 1) for the contexts seen exactly once, with w their only word.
+  context_table<ContextKey, array_hash<N-1>> contexts;
+  // Restaurants are never deleted, and a deque keeps their addresses stable
+  // for the resampler.
+  std::deque<oxlm::crp<unsigned>> restaurants;
 
   std::ostream& print(std::ostream& out) const {
     out << '\n' << N << "-gram PYLM:\n";
-    if (!singletons.empty()) {
+    if (num_singletons() > 0) {
       out << "Singleton CRP: " << singleton_crp;
-      for (auto r : singletons) {
-        for(auto w : r.first) 
-          out << w << ' ';
-        out << r.second << '\n';
-      }
+      contexts.for_each([&out](const ContextKey& key, int32_t entry) {
+        if (is_singleton(entry)) {
+          for(auto w : key) 
+            out << w << ' ';
+          out << singleton_word(entry) << '\n';
+        }
+      });
     }
     out << "Non-singleton CRPs: \n";
-    for (auto r : p) {
-      for(auto w : r.first) out << w << ' ';
-      r.second.print(&out);
-    }
+    contexts.for_each([this, &out](const ContextKey& key, int32_t entry) {
+      if (!is_singleton(entry)) {
+        for(auto w : key) out << w << ' ';
+        restaurants[entry].print(&out);
+      }
+    });
     backoff.print(out);
     return out;
   }
 
 private:
-  void copy_context(const std::vector<WordId>& context, std::vector<WordId>& result) const {
+  template<typename Engine>
+  void increment(WordId w, const std::vector<WordId>& context,
+                 const ContextKey& lookup, double bo, Engine& eng) {
+    int32_t* entry = contexts.find(lookup);
+    if (entry == nullptr) {
+      // note the first customer of a crp but don't create a crp object
+      contexts.insert(lookup, -(w + 1));
+      backoff.increment(w, context, eng);
+      return;
+    }
+
+    if (is_singleton(*entry)) {
+      // second customer triggers crp creation
+      WordId first = singleton_word(*entry);
+      *entry = restaurants.size();
+      restaurants.emplace_back(0.8, 0);
+      tr.insert(&restaurants.back());  // add to resampler
+
+      // insert the first customer, which by definition creates a table
+      assert (restaurants.back().num_tables() == 0);
+      restaurants.back().increment(first, 1.0, eng);
+    }
+
+    if (restaurants[*entry].increment(w, bo, eng))
+      backoff.increment(w, context, eng);
+  }
+
+  static bool is_singleton(int32_t entry) {
+    return entry < 0;
+  }
+
+  static WordId singleton_word(int32_t entry) {
+    return -entry - 1;
+  }
+
+  size_t num_singletons() const {
+    return contexts.size() - restaurants.size();
+  }
+
+  static ContextKey copy_context(const std::vector<WordId>& context) {
     assert (context.size() >= N-1);
+    ContextKey result;
     for (unsigned i = 0; i < N-1; ++i)
       result[i] = context[context.size() - 1 - i];
+    return result;
   }
 
-  void copy_context_verbose(const std::vector<WordId>& context, std::vector<WordId>& result) const {
+  static ContextKey copy_context_verbose(const std::vector<WordId>& context) {
     assert (context.size() >= N-1);
+    ContextKey result;
     for (unsigned i = 0; i < N-1; ++i) {
       std::cout << "$" << i << " " << (context.size() - 1 - i) << "$ ";
       result[i] = context[context.size() - 1 - i];
     }
+    return result;
   }
 
   double singleton_log_likelihood() const {
-    return singletons.size()*singleton_crp.log_likelihood(tr.get_discount(), tr.get_strength());
+    return num_singletons()*singleton_crp.log_likelihood(tr.get_discount(), tr.get_strength());
   }
 
   oxlm::crp<unsigned> singleton_crp;
@@ -1,12 +1,14 @@
 #ifndef _TIED_RESAMPLER_H_
 #define _TIED_RESAMPLER_H_
 
+#include <limits>
 #include <set>
 #include <vector>
 
 #include "utils/random.h"
 #include "utils/m.h"
 #include "slice_sampler.h"
+#include "pyp/crp.h"
 
 namespace oxlm {
 
@@ -38,31 +40,34 @@ struct tied_parameter_resampler {
   }
 
   double log_likelihood(double d, double s) const {
-    if (s <= -d) return -std::numeric_limits<double>::infinity();
-    double llh = Md::log_beta_density(d, d_alpha, d_beta) +
-                 Md::log_gamma_density(d + s, s_shape, s_rate);
-    for (auto& crp : crps) { llh += crp->log_likelihood(d, s); }
-    return llh;
+    return log_likelihood(statistics(), d, s);
   }
 
   double log_likelihood() const {
     return log_likelihood(discount, strength);
   }
 
+  // The seating arrangements do not change while the hyperparameters are
+  // resampled, so their statistics are aggregated once and every proposal
+  // costs time linear in the number of distinct counts.
   template<typename Engine>
   void resample_hyperparameters(Engine& eng, const unsigned nloop = 5, const unsigned niterations = 10) {
     if (size() == 0) { std::cerr << "EMPTY - not resampling\n"; return; }
+    const crp_statistics stats = statistics();
+    auto log_likelihood = [this, &stats](double d, double s) {
+      return this->log_likelihood(stats, d, s);
+    };
     for (unsigned iter = 0; iter < nloop; ++iter) {
-      strength = slice_sampler1d([this](double prop_s) { return this->log_likelihood(discount, prop_s); },
+      strength = slice_sampler1d([&](double prop_s) { return log_likelihood(discount, prop_s); },
                               strength, eng, -discount + std::numeric_limits<double>::min(),
                               std::numeric_limits<double>::infinity(), 0.0, niterations, 100*niterations);
       double min_discount = std::numeric_limits<double>::min();
       if (strength < 0.0) min_discount -= strength;
-      discount = slice_sampler1d([this](double prop_d) { return this->log_likelihood(prop_d, strength); },
+      discount = slice_sampler1d([&](double prop_d) { return log_likelihood(prop_d, strength); },
                           discount, eng, min_discount,
                           1.0, 0.0, niterations, 100*niterations);
     }
-    strength = slice_sampler1d([this](double prop_s) { return this->log_likelihood(discount, prop_s); },
+    strength = slice_sampler1d([&](double prop_s) { return log_likelihood(discount, prop_s); },
                             strength, eng, -discount + std::numeric_limits<double>::min(),
                             std::numeric_limits<double>::infinity(), 0.0, niterations, 100*niterations);
     std::cerr << "Resampled " << crps.size() << " CRPs (d=" << discount << ",s="
@@ -75,6 +80,19 @@ struct tied_parameter_resampler {
   double get_strength() const { return strength; }
 
  private:
+  crp_statistics statistics() const {
+    crp_statistics stats;
+    for (auto& crp : crps) { crp->add_statistics(stats); }
+    return stats;
+  }
+
+  double log_likelihood(const crp_statistics& stats, double d, double s) const {
+    if (s <= -d) return -std::numeric_limits<double>::infinity();
+    return Md::log_beta_density(d, d_alpha, d_beta) +
+           Md::log_gamma_density(d + s, s_shape, s_rate) +
+           stats.log_likelihood(d, s);
+  }
+
   std::set<CRP*> crps;
   const double d_alpha, d_beta, s_shape, s_rate;
   double discount, strength;
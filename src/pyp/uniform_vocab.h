@@ -1,6 +1,7 @@
 #ifndef _UNIFORM_VOCAB_H_
 #define _UNIFORM_VOCAB_H_
 
+#include <algorithm>
 #include <cassert>
 #include <vector>
 
@@ -19,6 +20,7 @@ struct UniformVocabulary {
   void decrement(int, const std::vector<int>&, const std::vector<int>&, Engine&) { --draws; assert(draws >= 0); }
   double prob(int, const std::vector<int>&) const { return p0; }
   double prob(int, const std::vector<int>&, const std::vector<int>&) const { return p0; }
+  void probs(const std::vector<int>&, std::vector<double>& out) const { std::fill(out.begin(), out.end(), p0); }
   template<typename Engine>
   void resample_hyperparameters(Engine&) {}
   double log_likelihood() const { return draws * log(p0); }
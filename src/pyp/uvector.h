@@ -1,6 +1,7 @@
 #ifndef UVECTOR_H_
 #define UVECTOR_H_
 
+#include <array>
 #include <vector>
 
 struct uvector_hash {
@@ -21,5 +22,15 @@ struct vector_hash {
   }
 };
 
+template <size_t N>
+struct array_hash {
+  size_t operator()(const std::array<int, N>& v) const {
+    size_t h = N;
+    for (auto e : v)
+      h ^= (size_t)e + 0x9e3779b9 + (h<<6) + (h>>2);
+    return h;
+  }
+};
+
 #endif
 
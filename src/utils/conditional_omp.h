@@ -12,4 +12,7 @@ inline omp_int_t omp_get_num_threads() {
 inline omp_int_t omp_get_max_threads() {
     return 1;
 }
+inline omp_int_t omp_in_parallel() {
+    return 0;
+}
 #endif